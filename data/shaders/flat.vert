@@ -5,7 +5,7 @@ precision highp float;
 uniform mat4 proj_modelview;
 
 layout(location=0) in vec2 position;
-layout(location=1) in vec4 color;
+layout(location=2) in vec4 color;
 
 out vec4 frag_color;
 
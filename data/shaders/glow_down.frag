@@ -0,0 +1,27 @@
+#version 300 es
+
+precision highp float;
+
+uniform sampler2D tex;
+
+in vec2 frag_texcoord;
+in vec4 frag_color;
+
+out vec4 out_color;
+
+// dual filter downsample: the center and four bilinear taps on the
+// corners of the destination texel, each covering 2x2 source texels.
+// frag_color.xy is half a destination texel.
+
+void main()
+{
+	vec2 d = frag_color.xy;
+
+	float c = texture(tex, frag_texcoord).a*4.
+		+ texture(tex, frag_texcoord - d).a
+		+ texture(tex, frag_texcoord + d).a
+		+ texture(tex, frag_texcoord + vec2(d.x, -d.y)).a
+		+ texture(tex, frag_texcoord - vec2(d.x, -d.y)).a;
+
+	out_color = vec4(c/8.);
+}
@@ -0,0 +1,30 @@
+#version 300 es
+
+precision highp float;
+
+uniform sampler2D tex;
+
+in vec2 frag_texcoord;
+in vec4 frag_color;
+
+out vec4 out_color;
+
+// dual filter upsample: eight bilinear taps around the texel, which
+// together cover a tent of 4x4 source texels. frag_color.xy is half a
+// destination texel.
+
+void main()
+{
+	vec2 d = frag_color.xy;
+
+	float c = texture(tex, frag_texcoord + vec2(-2.*d.x, 0.)).a
+		+ texture(tex, frag_texcoord + vec2(-d.x, d.y)).a*2.
+		+ texture(tex, frag_texcoord + vec2(0., 2.*d.y)).a
+		+ texture(tex, frag_texcoord + vec2(d.x, d.y)).a*2.
+		+ texture(tex, frag_texcoord + vec2(2.*d.x, 0.)).a
+		+ texture(tex, frag_texcoord + vec2(d.x, -d.y)).a*2.
+		+ texture(tex, frag_texcoord + vec2(0., -2.*d.y)).a
+		+ texture(tex, frag_texcoord + vec2(-d.x, -d.y)).a*2.;
+
+	out_color = vec4(c/12.);
+}
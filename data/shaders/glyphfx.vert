@@ -0,0 +1,42 @@
+#version 300 es
+
+precision highp float;
+
+uniform mat4 proj_modelview;
+uniform vec2 offset;
+uniform float tic;
+
+// one record per effect, repeated for each of its layers
+layout(location=0) in vec4 rect; // center, half size
+layout(location=1) in vec4 texcoords01;
+layout(location=2) in vec4 texcoords23;
+layout(location=3) in float spawn_tic;
+
+out vec2 frag_texcoord;
+out vec4 frag_color;
+
+const int NUM_LAYERS = 8;
+const float TTL = 30.;
+const float PI = 3.14159265;
+
+void main(void)
+{
+	float layer = float(gl_InstanceID % NUM_LAYERS);
+
+	float t = (tic - spawn_tic)/TTL;
+	float s = sin(t*PI);
+
+	// layers grow with the effect and fade out from the inside
+	float q = 1. - layer/float(NUM_LAYERS);
+	float c = q*q*(1. - t)*(1. - t);
+	float f = 1. + .2*s*layer;
+
+	// triangle strip: top left, bottom left, top right, bottom right
+	vec2 corner = vec2((gl_VertexID & 2) != 0 ? 1. : -1., (gl_VertexID & 1) != 0 ? -1. : 1.);
+
+	vec2 texcoords[4] = vec2[4](texcoords01.xy, texcoords01.zw, texcoords23.xy, texcoords23.zw);
+
+	gl_Position = proj_modelview*vec4(offset + rect.xy + f*corner*rect.zw, 0., 1.);
+	frag_texcoord = texcoords[gl_VertexID];
+	frag_color = vec4(c, c, c, 1.);
+}
@@ -33,6 +33,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include <libgen.h> /* for basename(3) */
+#include <stdint.h>
 #include <png.h>
 #include <ft2build.h>
 #include <alloca.h>
@@ -85,12 +86,14 @@ static char texture_filename[PATH_MAX + 1];
 static unsigned *texture;
 
 static char fontdef_filename[PATH_MAX + 1];
+static char fontbin_filename[PATH_MAX + 1];
 
 static int can_transpose;
 static int can_pack;
 static int use_gradient;
 static int drop_shadows;
 static int add_outlines;
+static int write_binary;
 static int drop_shadow_dist;
 static int glyph_border_size = 4;
 
@@ -609,10 +612,9 @@ glyph_compare(const void *p1, const void *p2)
 	return (*(const struct glyph **)p1)->code - (*(const struct glyph **)p2)->code;
 }
 
-static void
-write_fontdef(void)
+static struct glyph **
+sorted_glyphs(void)
 {
-	FILE *fp;
 	struct glyph **glyph_ptrs;
 	int i;
 
@@ -623,46 +625,65 @@ write_fontdef(void)
 
 	qsort(glyph_ptrs, num_glyphs, sizeof *glyph_ptrs, glyph_compare);
 
-	if ((fp = fopen(fontdef_filename, "w")) == NULL)
-		panic("fopen");
+	return glyph_ptrs;
+}
 
-	fprintf(fp, "%s%s\n", texture_path_prefix, texture_filename);
+/* texture coordinates of the four corners, t0 .. t3 */
 
+static void
+glyph_texcoords(const struct glyph *g, float *t)
+{
 	const float ds = 1./texture_width;
 	const float dt = 1./texture_height;
 
-	for (i = 0; i < num_glyphs; i++) {
-		const struct glyph *g = glyph_ptrs[i];
+	t[0] = ds*g->texture_x;
+	t[1] = dt*g->texture_y;
 
-		float t0x, t0y, t1x, t1y, t2x, t2y, t3x, t3y;
+	if (!g->transposed) {
+		t[2] = ds*(g->texture_x + g->width);
+		t[3] = dt*g->texture_y;
 
-		t0x = ds*g->texture_x;
-		t0y = dt*g->texture_y;
+		t[4] = ds*(g->texture_x + g->width);
+		t[5] = dt*(g->texture_y + g->height);
 
-		if (!g->transposed) {
-			t1x = ds*(g->texture_x + g->width); 
-			t1y = dt*g->texture_y;
+		t[6] = ds*g->texture_x;
+		t[7] = dt*(g->texture_y + g->height);
+	} else {
+		t[2] = ds*g->texture_x;
+		t[3] = dt*(g->texture_y + g->width);
 
-			t2x = ds*(g->texture_x + g->width); 
-			t2y = dt*(g->texture_y + g->height);
+		t[4] = ds*(g->texture_x + g->height);
+		t[5] = dt*(g->texture_y + g->width);
 
-			t3x = ds*g->texture_x;
-			t3y = dt*(g->texture_y + g->height);
-		} else {
-			t1x = ds*g->texture_x;
-			t1y = dt*(g->texture_y + g->width);
+		t[6] = ds*(g->texture_x + g->height);
+		t[7] = dt*g->texture_y;
+	}
+}
+
+static void
+write_fontdef(void)
+{
+	FILE *fp;
+	struct glyph **glyph_ptrs;
+	int i;
 
-			t2x = ds*(g->texture_x + g->height);
-			t2y = dt*(g->texture_y + g->width);
+	glyph_ptrs = sorted_glyphs();
 
-			t3x = ds*(g->texture_x + g->height); 
-			t3y = dt*g->texture_y;
-		}
+	if ((fp = fopen(fontdef_filename, "w")) == NULL)
+		panic("fopen");
+
+	fprintf(fp, "%s%s\n", texture_path_prefix, texture_filename);
+
+	for (i = 0; i < num_glyphs; i++) {
+		const struct glyph *g = glyph_ptrs[i];
+		float t[8];
+
+		glyph_texcoords(g, t);
 
 		fprintf(fp, "%d %d %d %d %d %d %d %.4f %.4f %.4f %.4f %.4f %.4f %.4f %.4f\n",
 			g->code, g->width, g->height, g->left, g->top,
 			g->advance_x, g->advance_y,
-			t0x, t0y, t1x, t1y, t2x, t2y, t3x, t3y);
+			t[0], t[1], t[2], t[3], t[4], t[5], t[6], t[7]);
 	}
 
 	fclose(fp);
@@ -670,6 +691,110 @@ write_fontdef(void)
 	free(glyph_ptrs);
 }
 
+/*
+ * Binary atlas, meant to be mapped and used in place (see font.h in the
+ * game). Little endian, every field 4-byte aligned:
+ *
+ *   header        "TFNT", version, number of glyphs, number of pages,
+ *                 size of the texture path (with NUL, padded to 4 bytes)
+ *   texture path
+ *   page index    256 uint16_t, page of each block of 256 codepoints
+ *   pages         256 uint16_t each, glyph index of each codepoint in the
+ *                 block or 0xffff; page 0 is empty
+ *   glyphs        width, height, left, top, advance x/y as int32_t,
+ *                 then the texture coordinates t0 .. t3 as floats
+ */
+
+enum {
+	FONTBIN_VERSION = 1,
+	FONTBIN_PAGE_SIZE = 256,
+	FONTBIN_NUM_PAGES = 0x10000/FONTBIN_PAGE_SIZE,
+	FONTBIN_NO_GLYPH = 0xffff,
+};
+
+static void
+write_fontbin(void)
+{
+	FILE *fp;
+	struct glyph **glyph_ptrs;
+	uint16_t page_index[FONTBIN_NUM_PAGES];
+	uint16_t *pages;
+	uint32_t header[5];
+	char path[2*PATH_MAX + 4];
+	int i, num_pages, path_size;
+
+	if (num_glyphs >= FONTBIN_NO_GLYPH)
+		panic("too many glyphs for binary atlas");
+
+	glyph_ptrs = sorted_glyphs();
+
+	/* pages with at least one glyph, in codepoint order */
+
+	memset(page_index, 0, sizeof page_index);
+
+	num_pages = 1;
+
+	for (i = 0; i < num_glyphs; i++) {
+		const int code = glyph_ptrs[i]->code;
+
+		if (code < 0 || code >= FONTBIN_NUM_PAGES*FONTBIN_PAGE_SIZE)
+			panic("glyph %d out of range for binary atlas", code);
+
+		if (!page_index[code/FONTBIN_PAGE_SIZE])
+			page_index[code/FONTBIN_PAGE_SIZE] = num_pages++;
+	}
+
+	pages = malloc(num_pages*FONTBIN_PAGE_SIZE*sizeof *pages);
+	memset(pages, 0xff, num_pages*FONTBIN_PAGE_SIZE*sizeof *pages);
+
+	for (i = 0; i < num_glyphs; i++) {
+		const int code = glyph_ptrs[i]->code;
+		pages[page_index[code/FONTBIN_PAGE_SIZE]*FONTBIN_PAGE_SIZE + code%FONTBIN_PAGE_SIZE] = i;
+	}
+
+	memset(path, 0, sizeof path);
+	snprintf(path, sizeof path, "%s%s", texture_path_prefix, texture_filename);
+	path_size = (strlen(path) + 1 + 3) & ~3;
+
+	if ((fp = fopen(fontbin_filename, "wb")) == NULL)
+		panic("fopen");
+
+	memcpy(&header[0], "TFNT", 4);
+	header[1] = FONTBIN_VERSION;
+	header[2] = num_glyphs;
+	header[3] = num_pages;
+	header[4] = path_size;
+
+	fwrite(header, sizeof header, 1, fp);
+	fwrite(path, path_size, 1, fp);
+	fwrite(page_index, sizeof page_index, 1, fp);
+	fwrite(pages, num_pages*FONTBIN_PAGE_SIZE*sizeof *pages, 1, fp);
+
+	for (i = 0; i < num_glyphs; i++) {
+		const struct glyph *g = glyph_ptrs[i];
+		int32_t metrics[6];
+		float t[8];
+
+		metrics[0] = g->width;
+		metrics[1] = g->height;
+		metrics[2] = g->left;
+		metrics[3] = g->top;
+		metrics[4] = g->advance_x;
+		metrics[5] = g->advance_y;
+
+		glyph_texcoords(g, t);
+
+		fwrite(metrics, sizeof metrics, 1, fp);
+		fwrite(t, sizeof t, 1, fp);
+	}
+
+	if (fclose(fp) != 0)
+		panic("fclose");
+
+	free(pages);
+	free(glyph_ptrs);
+}
+
 static void
 usage(char *argv0)
 {
@@ -689,6 +814,7 @@ usage(char *argv0)
 	fprintf(stderr, "  -b  background color, in hex\n");
 	fprintf(stderr, "  -p  texture path prefix\n");
 	fprintf(stderr, "  -o  outline\n");
+	fprintf(stderr, "  -B  also write a binary atlas\n");
 
 	exit(1);
 }
@@ -708,7 +834,7 @@ main(int argc, char *argv[])
 	bg_color = 0x00000000;
 	fg_color = 0x00ffffff;
 
-	while ((c = getopt(argc, argv, "S:s:e:I:W:H:g:htdb:f:p:o")) != EOF) {
+	while ((c = getopt(argc, argv, "S:s:e:I:W:H:g:htdb:f:p:oB")) != EOF) {
 		char *after;
 
 		switch (c) {
@@ -774,6 +900,10 @@ main(int argc, char *argv[])
 				add_outlines = 1;
 				break;
 
+			case 'B':
+				write_binary = 1;
+				break;
+
 			case 'h':
 				usage(*argv);
 				break;
@@ -832,10 +962,16 @@ main(int argc, char *argv[])
 	snprintf(fontdef_filename, sizeof fontdef_filename,
 	  "%s_font.fnt", font_basename);
 
+	snprintf(fontbin_filename, sizeof fontbin_filename,
+	  "%s_font.fntb", font_basename);
+
 	gen_glyphs();
 	pack_glyphs();
 	write_texture();
 	write_fontdef();
 
+	if (write_binary)
+		write_fontbin();
+
 	return 0;
 }
@@ -0,0 +1,109 @@
+#include <GL/glew.h>
+
+#include <cstdio>
+#include <chrono>
+
+#include "panic.h"
+#include "thread_pool.h"
+#include "gl_buffer.h"
+#include "gl_texture.h"
+#include "texture_cache.h"
+#include "async_texture.h"
+
+async_texture::async_texture(const std::string& path)
+	: path_(path)
+	, state_(OPENING)
+{
+	texture_file *file = &file_;
+
+	job_ = get_thread_pool().submit(
+			[file, path]
+			{
+				return texture_cache::open(path, *file);
+			});
+}
+
+async_texture::~async_texture()
+{
+	// the worker may still be writing to the pixel buffer
+	if (job_.valid())
+		job_.wait();
+}
+
+void
+async_texture::poll()
+{
+	if (state_ == READY || state_ == FAILED)
+		return;
+
+	if (job_.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return;
+
+	if (!job_.get()) {
+		fprintf(stderr, "failed to load %s\n", path_.c_str());
+		state_ = FAILED;
+		return;
+	}
+
+	switch (state_) {
+		case OPENING:
+			start_reading();
+			break;
+
+		case READING:
+			upload();
+			break;
+
+		default:
+			break;
+	}
+}
+
+const gl::texture *
+async_texture::get() const
+{
+	return state_ == READY ? texture_.get() : nullptr;
+}
+
+void
+async_texture::start_reading()
+{
+	const GLsizeiptr size = file_.get_data_size();
+
+	pixel_buffer_.reset(new gl::buffer(GL_PIXEL_UNPACK_BUFFER));
+
+	pixel_buffer_->bind();
+	pixel_buffer_->set_data(size, nullptr, GL_STREAM_DRAW);
+	void *dest = pixel_buffer_->map_range(0, size, GL_MAP_WRITE_BIT|GL_MAP_INVALIDATE_BUFFER_BIT);
+	pixel_buffer_->unbind();
+
+	texture_file *file = &file_;
+
+	job_ = get_thread_pool().submit(
+			[file, dest]() -> bool
+			{
+				file->read(dest);
+				return true;
+			});
+
+	state_ = READING;
+}
+
+void
+async_texture::upload()
+{
+	pixel_buffer_->bind();
+
+	if (!pixel_buffer_->unmap())
+		panic("pixel buffer for %s was lost", path_.c_str());
+
+	texture_.reset(new gl::texture);
+	texture_->initialize(file_, nullptr);
+
+	pixel_buffer_->unbind();
+	pixel_buffer_.reset();
+
+	fprintf(stderr, "loaded %s (%zu bytes)\n", path_.c_str(), file_.get_data_size());
+
+	state_ = READY;
+}
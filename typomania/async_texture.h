@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <future>
+
+#include <boost/noncopyable.hpp>
+
+#include "texture_file.h"
+
+namespace gl {
+class buffer;
+class texture;
+}
+
+// a texture loaded in the background. a worker thread reads its cached
+// form (see texture_cache.h) straight into a mapped pixel buffer, which is
+// then copied to the texture on the GL thread. draw something else until
+// it's ready, or for good if it failed to load.
+
+class async_texture : private boost::noncopyable
+{
+public:
+	async_texture(const std::string& path);
+	~async_texture();
+
+	// moves the load along; call on the GL thread
+	void poll();
+
+	bool is_ready() const
+	{ return state_ == READY; }
+
+	// nullptr until it's ready
+	const gl::texture *get() const;
+
+private:
+	enum state {
+		OPENING,
+		READING,
+		READY,
+		FAILED,
+	};
+
+	void start_reading();
+	void upload();
+
+	std::string path_;
+	texture_file file_;
+	std::unique_ptr<gl::buffer> pixel_buffer_;
+	std::unique_ptr<gl::texture> texture_;
+	std::future<bool> job_;
+	state state_;
+};
@@ -0,0 +1,953 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include <GL/glew.h>
+
+#include "panic.h"
+#include "radix_sort.h"
+#include "render.h"
+#include "fft.h"
+#include "bourke_fft.h"
+#include "font.h"
+#include "kashi.h"
+#include "song_index.h"
+#include "file_stamp.h"
+#include "thread_pool.h"
+#include "kana.h"
+#include "kana_oracle.h"
+#include "utf8.h"
+#include "headless_context.h"
+
+// times the things that were made faster, against the way they used to be
+// done where that's still around:
+//
+//   sort    the sprite queue: radix sort on packed keys against the old
+//           std::stable_sort of pointers, at 1k, 10k and 100k sprites
+//   fft     one spectrum window: fft_plan against the Bourke FFT it
+//           replaced, whose bins must agree
+//   font    loading each font from the binary atlas and from the text
+//           format, and looking glyphs up in the page table against the
+//           hash map the fonts used to keep
+//   serifu  loading and laying out the lyrics of every bundled song, and
+//           drawing every serifu from its laid out glyphs against
+//           measuring and drawing its strings on every draw
+//   memory  what the lyrics of every bundled song take in their arenas
+//   kana    finding the patterns for the kana of the bundled lyrics in the
+//           compiled tables against the std::map ones they replaced
+//   index   10k songs made from the bundled ones: loading them from a
+//           song index and finding each, against parsing them all
+//   parse   a 16 MB song made of the bundled lyrics: decoding it as UTF-8
+//           a character at a time and with utf8::decode, which must agree,
+//           and reading it with kashi::load
+//
+// the ones that need GL get a headless context. prints the best of a few
+// runs of each. runs every benchmark, or only the
+// ones named on the command line. exits with a non-zero status if one of
+// them finds the fast path disagrees with the old one.
+
+namespace {
+
+const char *KASHI_DIR = "data/lyrics";
+const char *KASHI_EXT = ".kashi";
+
+const int NUM_RUNS = 10;
+
+// best of NUM_RUNS, in ms
+template <typename F>
+double
+time_ms(F f)
+{
+	using clock = std::chrono::steady_clock;
+
+	double best = HUGE_VAL;
+
+	for (int i = 0; i < NUM_RUNS; i++) {
+		const auto start = clock::now();
+		f();
+		best = std::min(best, std::chrono::duration<double, std::milli>(clock::now() - start).count());
+	}
+
+	return best;
+}
+
+// stand-ins for the programs and textures, only compared by address
+struct resource
+{
+	int dummy;
+};
+
+// as big as the sprites in render.cc, so the comparator misses the cache
+// as often
+struct sprite
+{
+	const resource *program;
+	const resource *texture;
+	quad verts;
+	quad texcoords;
+	blend_mode blend;
+	rgba color;
+	int layer;
+};
+
+const int NUM_LAYERS = 8;
+const int NUM_PROGRAMS = 4;
+const int NUM_TEXTURES = 64;
+
+// as render_queue::make_sort_key, with the ids picked directly
+uint64_t
+make_sort_key(int layer, blend_mode blend, int program_id, int texture_id)
+{
+	return (static_cast<uint64_t>(layer + 0x8000) << 48)
+		| (static_cast<uint64_t>(blend) << 40)
+		| (static_cast<uint64_t>(program_id) << 20)
+		| texture_id;
+}
+
+bool
+bench_sort(size_t num_sprites)
+{
+	static resource programs[NUM_PROGRAMS], textures[NUM_TEXTURES];
+
+	std::vector<sprite> sprites(num_sprites);
+	std::vector<uint64_t> keys(num_sprites);
+
+	for (size_t i = 0; i < num_sprites; i++) {
+		sprite& s = sprites[i];
+
+		const int program_id = rand() % NUM_PROGRAMS;
+		const int texture_id = rand() % NUM_TEXTURES;
+
+		s.program = &programs[program_id];
+		s.texture = &textures[texture_id];
+		s.blend = static_cast<blend_mode>(rand() % 3);
+		s.layer = rand() % NUM_LAYERS - NUM_LAYERS/2;
+
+		keys[i] = make_sort_key(s.layer, s.blend, program_id, texture_id);
+	}
+
+	std::vector<const sprite *> radix_sorted(num_sprites), stable_sorted(num_sprites);
+
+	std::vector<uint64_t> sort_keys(num_sprites), scratch_keys(num_sprites);
+	std::vector<const sprite *> scratch_sprites(num_sprites);
+
+	const double radix_ms = time_ms(
+			[&]
+			{
+				// keys are built as sprites are queued, so only
+				// copying them is timed
+				for (size_t i = 0; i < num_sprites; i++)
+					radix_sorted[i] = &sprites[i];
+				std::copy(keys.begin(), keys.end(), sort_keys.begin());
+
+				radix_sort(&sort_keys[0], &radix_sorted[0], &scratch_keys[0], &scratch_sprites[0], num_sprites);
+			});
+
+	const double stable_ms = time_ms(
+			[&]
+			{
+				for (size_t i = 0; i < num_sprites; i++)
+					stable_sorted[i] = &sprites[i];
+
+				std::stable_sort(
+					stable_sorted.begin(),
+					stable_sorted.end(),
+					[](const sprite *s0, const sprite *s1)
+					{
+						if (s0->layer != s1->layer) {
+							return s0->layer < s1->layer;
+						} else if (s0->blend != s1->blend) {
+							return static_cast<int>(s0->blend) < static_cast<int>(s1->blend);
+						} else if (s0->program != s1->program) {
+							return s0->program < s1->program;
+						} else {
+							return s0->texture < s1->texture;
+						}
+					});
+			});
+
+	// programs and textures are in address order, same as their ids, so
+	// both sorts give the same order
+	const bool same = radix_sorted == stable_sorted;
+
+	printf("sort %zu sprites: radix %.3f ms, std::stable_sort %.3f ms%s\n",
+		num_sprites, radix_ms, stable_ms, same ? "" : ", DIFFERENT ORDER");
+
+	return same;
+}
+
+bool
+bench_sort()
+{
+	bool ok = true;
+
+	for (size_t num_sprites : { 1000, 10000, 100000 }) {
+		if (!bench_sort(num_sprites))
+			ok = false;
+	}
+
+	return ok;
+}
+
+bool
+bench_fft()
+{
+	// the window spectrum_bars uses
+	const int LOG2_WINDOW_SIZE = 12;
+	const int WINDOW_SIZE = 1 << LOG2_WINDOW_SIZE;
+
+	// bins are scaled by 1/n, so they're at most half the amplitude. the
+	// old transform builds its twiddles by recurrence, which is off by
+	// about 1e-4 at this size
+	const float MAX_ERROR = 1e-3f;
+
+	std::vector<float> window(WINDOW_SIZE);
+
+	for (int i = 0; i < WINDOW_SIZE; i++)
+		window[i] = sinf(.1f*i) + .5f*sinf(.37f*i) + .25f*(rand()/static_cast<float>(RAND_MAX) - .5f);
+
+	fft_plan plan(LOG2_WINDOW_SIZE);
+
+	std::vector<float> re(WINDOW_SIZE/2), im(WINDOW_SIZE/2);
+	std::vector<float> old_re(WINDOW_SIZE), old_im(WINDOW_SIZE);
+
+	const int NUM_WINDOWS = 100;
+
+	const double plan_ms = time_ms(
+			[&]
+			{
+				for (int i = 0; i < NUM_WINDOWS; i++)
+					plan.forward_real(&window[0], &re[0], &im[0]);
+			});
+
+	const double old_ms = time_ms(
+			[&]
+			{
+				// as spectrum_bars did: the window as the real part,
+				// a zeroed imaginary part
+				for (int i = 0; i < NUM_WINDOWS; i++) {
+					std::copy(window.begin(), window.end(), old_re.begin());
+					std::fill(old_im.begin(), old_im.end(), 0);
+
+					bourke::fft(1, LOG2_WINDOW_SIZE, &old_re[0], &old_im[0]);
+				}
+			});
+
+	float max_error = 0;
+
+	for (int i = 0; i < WINDOW_SIZE/2; i++)
+		max_error = std::max(max_error, std::max(fabsf(re[i] - old_re[i]), fabsf(im[i] - old_im[i])));
+
+	const bool same = max_error <= MAX_ERROR;
+
+	printf("fft %d samples: fft_plan %.4f ms, bourke %.4f ms, max difference %g%s\n",
+		WINDOW_SIZE, plan_ms/NUM_WINDOWS, old_ms/NUM_WINDOWS, max_error, same ? "" : ", TOO BIG");
+
+	return same;
+}
+
+// the paths of every bundled song
+const std::vector<std::string>&
+get_bundled_paths()
+{
+	static std::vector<std::string> paths;
+
+	if (!paths.empty())
+		return paths;
+
+	DIR *dir;
+
+	if (!(dir = opendir(KASHI_DIR)))
+		panic("failed to open %s: %s", KASHI_DIR, strerror(errno));
+
+	while (struct dirent *de = readdir(dir)) {
+		const char *name = de->d_name;
+		const size_t len = strlen(name);
+
+		if (len >= strlen(KASHI_EXT) && !strcmp(name + len - strlen(KASHI_EXT), KASHI_EXT))
+			paths.push_back(std::string(KASHI_DIR) + '/' + name);
+	}
+
+	closedir(dir);
+
+	if (paths.empty())
+		panic("no songs in %s", KASHI_DIR);
+
+	std::sort(paths.begin(), paths.end());
+
+	return paths;
+}
+
+// every bundled song, with its lyrics loaded and laid out
+const std::vector<kashi_ptr>&
+get_bundled_songs()
+{
+	static std::vector<kashi_ptr> songs;
+
+	if (!songs.empty())
+		return songs;
+
+	for (auto& path : get_bundled_paths()) {
+		kashi_ptr p(new kashi);
+
+		if (!p->load(path) || !p->load_lyrics())
+			panic("failed to load %s", path.c_str());
+
+		songs.push_back(std::move(p));
+	}
+
+	return songs;
+}
+
+// what find_glyph had to go through before the page table
+using glyph_map = std::unordered_map<int, std::unique_ptr<font::glyph>>;
+
+// the codepoints listed in a text font, after the texture path
+std::vector<int>
+get_font_codes(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		panic("failed to open %s", path.c_str());
+
+	std::string line;
+	std::getline(file, line);
+
+	std::vector<int> codes;
+
+	while (std::getline(file, line))
+		codes.push_back(atoi(line.c_str()));
+
+	return codes;
+}
+
+// sums the advances of the glyphs of str, through find
+template <typename F>
+double
+time_lookups(const std::wstring& str, F find)
+{
+	const int NUM_PASSES = 100;
+
+	int width = 0;
+
+	const double ms = time_ms(
+			[&]
+			{
+				for (int i = 0; i < NUM_PASSES; i++) {
+					for (wchar_t ch : str)
+						width += find(ch)->advance_x;
+				}
+			});
+
+	// keeps the loop from being thrown away
+	if (width == 42)
+		putchar(' ');
+
+	return 1e6*ms/(NUM_PASSES*str.size());
+}
+
+bool
+bench_font()
+{
+	static const char *FONTS[] = { "small_font", "tiny_font", "medium_font", "big_az_font" };
+
+	// the atlas textures are cached after the first load, so what's timed
+	// is reading the glyphs
+	auto time_load = [](const std::string& path)
+		{
+			return time_ms(
+				[&]
+				{
+					font f;
+					if (!f.load(path))
+						panic("failed to load %s", path.c_str());
+				});
+		};
+
+	for (auto name : FONTS) {
+		const std::string path = std::string("data/fonts/") + name;
+
+		const double binary_ms = time_load(path + ".fntb");
+		const double text_ms = time_load(path + ".fnt");
+
+		printf("font %s: load .fntb %.3f ms, .fnt %.3f ms\n", name, binary_ms, text_ms);
+	}
+
+	// the lyrics fonts, on every character of the lyrics they have, and
+	// on the ascii they have
+
+	std::wstring lyrics_text;
+
+	for (auto& song : get_bundled_songs())
+		lyrics_text += song->get_lyrics().text;
+
+	for (auto name : { "small_font", "tiny_font" }) {
+		const std::string path = std::string("data/fonts/") + name;
+
+		font f;
+		if (!f.load(path + ".fntb"))
+			panic("failed to load %s.fntb", path.c_str());
+
+		glyph_map map;
+		std::wstring ascii_text;
+
+		for (int code : get_font_codes(path + ".fnt")) {
+			map[code].reset(new font::glyph(*f.find_glyph(code)));
+
+			if (code < 128)
+				ascii_text.push_back(code);
+		}
+
+		std::wstring text;
+
+		for (wchar_t ch : lyrics_text) {
+			if (map.count(ch))
+				text.push_back(ch);
+		}
+
+		auto find_in_table = [&f](wchar_t ch) { return f.find_glyph(ch); };
+		auto find_in_map = [&map](wchar_t ch) { return map.find(ch)->second.get(); };
+
+		printf("font %s: lyrics lookup page table %.2f ns, hash map %.2f ns\n",
+			name, time_lookups(text, find_in_table), time_lookups(text, find_in_map));
+
+		printf("font %s: ascii lookup page table %.2f ns, hash map %.2f ns\n",
+			name, time_lookups(ascii_text, find_in_table), time_lookups(ascii_text, find_in_map));
+	}
+
+	return true;
+}
+
+// as kashi.cc
+const float FURIGANA_Y = 26;
+
+// what serifu::draw did before the glyphs were laid out once: measure
+// both strings of every part, and look up every glyph while drawing
+void
+draw_unlaid_out(const serifu_arena& arena, const serifu& s, const rgba& color)
+{
+	render::set_color(color);
+
+	float x = 0;
+
+	for (size_t i = 0; i < s.get_num_parts(); i++) {
+		const serifu_part& part = s.get_part(i);
+
+		const font *kanji_font = arena.fonts[part.kanji_font];
+		const font *kana_font = arena.fonts[part.kana_font];
+
+		const wchar_t *kanji = arena.text.data() + part.kanji_begin;
+		const wchar_t *kana = arena.text.data() + part.kana_begin;
+
+		const size_t kanji_len = part.kana_begin - part.kanji_begin;
+		const size_t kana_len = part.kana_end - part.kana_begin;
+
+		const int kanji_width = kanji_font->get_string_width(kanji, kanji_len);
+		const int kana_width = kana_font->get_string_width(kana, kana_len);
+
+		const int width = std::max(kanji_width, kana_width);
+
+		kanji_font->draw_stringn(kanji, kanji_len, x + .5*width - .5*kanji_width, 0, 0);
+		kana_font->draw_stringn(kana, kana_len, x + .5*width - .5*kana_width, part.kind == serifu_part::FURIGANA ? FURIGANA_Y : 0, 0);
+
+		x += width;
+	}
+}
+
+bool
+bench_serifu()
+{
+	const std::vector<kashi_ptr>& songs = get_bundled_songs();
+
+	size_t num_serifus = 0, num_glyphs = 0;
+
+	for (auto& song : songs) {
+		num_serifus += std::distance(song->begin(), song->end());
+		num_glyphs += song->get_lyrics().text.size();
+	}
+
+	const double load_ms = time_ms(
+			[&]
+			{
+				for (auto& song : songs) {
+					kashi k;
+					k.path = song->path;
+
+					if (!k.load_lyrics())
+						panic("failed to load %s", song->path.c_str());
+				}
+			});
+
+	printf("serifu: load_lyrics of %zu songs, %zu glyphs, %.3f ms\n", songs.size(), num_glyphs, load_ms);
+
+	static bool render_initialized = false;
+
+	if (!render_initialized) {
+		render::init();
+		render_initialized = true;
+	}
+
+	render::set_viewport(0, 800, 0, 600);
+
+	const rgba color[2] = { rgba(0, 1, 1, 1), rgba(1, 1, 1, 1) };
+
+	// one batch per serifu, as a frame of the game draws one. drawn, or
+	// only queued and discarded to leave out the GL driver
+	auto redraw = [&](bool flush, std::function<void(const kashi&, const serifu&)> draw)
+		{
+			for (auto& song : songs) {
+				for (auto& s : *song) {
+					render::begin_batch();
+					render::set_blend_mode(blend_mode::ALPHA_BLEND);
+
+					draw(*song, s);
+
+					if (flush)
+						render::end_batch();
+					else
+						render::discard_batch();
+				}
+			}
+
+			glFinish();
+		};
+
+	auto draw_laid_out = [&](const kashi&, const serifu& s)
+		{
+			s.draw(0, color);
+		};
+
+	auto draw_measured = [&](const kashi& song, const serifu& s)
+		{
+			draw_unlaid_out(song.get_lyrics(), s, color[1]);
+		};
+
+	// the driver's buffers grow to size in the first few batches
+	redraw(true, draw_laid_out);
+
+	for (bool flush : { false, true }) {
+		const double laid_out_ms = time_ms([&] { redraw(flush, draw_laid_out); });
+		const double measured_ms = time_ms([&] { redraw(flush, draw_measured); });
+
+		printf("serifu: %s %zu serifus, laid out %.3f ms, measured on every draw %.3f ms\n",
+			flush ? "draw" : "queue", num_serifus, laid_out_ms, measured_ms);
+	}
+
+	return true;
+}
+
+// bytes used and allocated by a vector or string
+struct footprint
+{
+	size_t used, allocated;
+
+	template <typename T>
+	void add(const T& v)
+	{
+		used += v.size()*sizeof(typename T::value_type);
+		allocated += v.capacity()*sizeof(typename T::value_type);
+	}
+};
+
+bool
+bench_memory()
+{
+	const std::vector<kashi_ptr>& songs = get_bundled_songs();
+
+	footprint text {}, parts {}, clusters {}, stroke_offsets {}, glyphs {};
+	size_t num_serifus = 0;
+
+	for (auto& song : songs) {
+		const serifu_arena& lyrics = song->get_lyrics();
+
+		text.add(lyrics.text);
+		parts.add(lyrics.parts);
+		clusters.add(lyrics.clusters);
+		stroke_offsets.add(lyrics.stroke_offsets);
+		glyphs.add(lyrics.glyphs);
+
+		num_serifus += std::distance(lyrics.begin(), lyrics.end());
+	}
+
+	// the serifu themselves are a vector of fixed-size records, whose
+	// spare capacity isn't visible from here
+	const size_t serifus_size = num_serifus*sizeof(serifu);
+
+	auto print = [](const char *what, const footprint& f)
+		{
+			printf("memory %s: %zu bytes used, %zu allocated\n", what, f.used, f.allocated);
+		};
+
+	print("text", text);
+	print("parts", parts);
+	print("clusters", clusters);
+	print("stroke_offsets", stroke_offsets);
+	print("glyphs", glyphs);
+
+	const size_t used = text.used + parts.used + clusters.used + stroke_offsets.used + glyphs.used + serifus_size;
+	const size_t allocated = text.allocated + parts.allocated + clusters.allocated + stroke_offsets.allocated + glyphs.allocated + serifus_size;
+
+	// six vectors per song, whatever its length
+	printf("memory %zu songs, %zu serifus: %zu bytes used, %zu allocated, in %zu blocks\n",
+		songs.size(), num_serifus, used, allocated, 6*songs.size());
+
+	return true;
+}
+
+// walks the kana a cluster at a time, as serifu_arena does, finding the
+// pattern of each cluster with find(c0, c1, c2), find(c0, c1), find(c0),
+// each returning whether there's one. returns how many kana each cluster
+// took, 0 for a kana with no pattern.
+template <typename F3, typename F2, typename F1>
+std::vector<int>
+find_clusters(const std::wstring& kana, F3 find3, F2 find2, F1 find1)
+{
+	std::vector<int> clusters;
+
+	for (size_t i = 0; i + 2 < kana.size(); ) {
+		int num_kana;
+
+		if (find3(kana[i], kana[i + 1], kana[i + 2]))
+			num_kana = 3;
+		else if (find2(kana[i], kana[i + 1]))
+			num_kana = 2;
+		else if (find1(kana[i]))
+			num_kana = 1;
+		else
+			num_kana = 0;
+
+		clusters.push_back(num_kana);
+
+		i += std::max(num_kana, 1);
+	}
+
+	return clusters;
+}
+
+bool
+bench_kana()
+{
+	// the kana of every serifu, each followed by a 0 that has no pattern
+	std::wstring kana;
+
+	for (auto& song : get_bundled_songs()) {
+		for (auto& s : *song) {
+			kana.append(s.kana_begin(), s.kana_end());
+			kana.push_back(0);
+		}
+	}
+
+	kana.append(2, 0);
+
+	std::vector<int> compiled_clusters, oracle_clusters;
+
+	const double compiled_ms = time_ms(
+			[&]
+			{
+				compiled_clusters = find_clusters(
+					kana,
+					[](wchar_t c0, wchar_t c1, wchar_t c2) { return kana::find_pattern(c0, c1, c2) != pattern_table::END; },
+					[](wchar_t c0, wchar_t c1) { return kana::find_pattern(c0, c1) != pattern_table::END; },
+					[](wchar_t c0) { return kana::find_pattern(c0) != pattern_table::END; });
+			});
+
+	const double oracle_ms = time_ms(
+			[&]
+			{
+				oracle_clusters = find_clusters(
+					kana,
+					[](wchar_t c0, wchar_t c1, wchar_t c2) { return kana_oracle::find_pattern(c0, c1, c2) != nullptr; },
+					[](wchar_t c0, wchar_t c1) { return kana_oracle::find_pattern(c0, c1) != nullptr; },
+					[](wchar_t c0) { return kana_oracle::find_pattern(c0) != nullptr; });
+			});
+
+	const bool same = compiled_clusters == oracle_clusters;
+
+	const size_t num_clusters = compiled_clusters.size();
+
+	printf("kana %zu clusters: compiled tables %.2f ns, std::map %.2f ns per cluster%s\n",
+		num_clusters, 1e6*compiled_ms/num_clusters, 1e6*oracle_ms/num_clusters, same ? "" : ", DIFFERENT CLUSTERS");
+
+	return same;
+}
+
+bool
+bench_index()
+{
+	const int NUM_SONGS = 10000;
+
+	char dir[] = "/tmp/typomania_bench.XXXXXX";
+
+	if (!mkdtemp(dir))
+		panic("mkdtemp failed: %s", strerror(errno));
+
+	// the bundled songs over and over, each under a path of its own
+
+	std::vector<std::string> contents;
+
+	for (auto& path : get_bundled_paths()) {
+		std::ifstream file(path, std::ios::binary);
+		contents.emplace_back(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	std::vector<std::string> paths(NUM_SONGS);
+	std::vector<file_stamp> stamps(NUM_SONGS);
+
+	for (int i = 0; i < NUM_SONGS; i++) {
+		char name[32];
+		snprintf(name, sizeof name, "/song%05d%s", i, KASHI_EXT);
+
+		paths[i] = dir + std::string(name);
+
+		std::ofstream file(paths[i], std::ios::binary);
+		file << contents[i%contents.size()];
+
+		if (!file.flush())
+			panic("failed to write %s", paths[i].c_str());
+	}
+
+	for (int i = 0; i < NUM_SONGS; i++) {
+		if (!get_file_stamp(paths[i], stamps[i]))
+			panic("failed to stat %s", paths[i].c_str());
+	}
+
+	const std::string index_path = dir + std::string("/lyrics.index");
+
+	{
+		song_index index;
+
+		for (int i = 0; i < NUM_SONGS; i++) {
+			kashi k;
+			if (!k.load(paths[i]))
+				panic("failed to load %s", paths[i].c_str());
+
+			index.add(k, stamps[i]);
+		}
+
+		if (!index.save(index_path))
+			panic("failed to save %s: %s", index_path.c_str(), strerror(errno));
+	}
+
+	bool ok = true;
+
+	// what game::load_song_list does for songs that are indexed, stamps
+	// aside
+	const double index_ms = time_ms(
+			[&]
+			{
+				song_index index;
+
+				if (!index.load(index_path))
+					panic("failed to load %s", index_path.c_str());
+
+				for (int i = 0; i < NUM_SONGS; i++) {
+					if (!index.find(paths[i], stamps[i]))
+						ok = false;
+				}
+			});
+
+	const double parse_ms = time_ms(
+			[&]
+			{
+				for (auto& path : paths) {
+					kashi k;
+					if (!k.load(path))
+						panic("failed to load %s", path.c_str());
+				}
+			});
+
+	// and for the ones that aren't
+	const double pool_ms = time_ms(
+			[&]
+			{
+				std::vector<std::future<kashi_ptr>> pending;
+
+				for (auto& path : paths) {
+					pending.push_back(get_thread_pool().submit(
+						[&path]
+						{
+							kashi_ptr p(new kashi);
+
+							if (!p->load(path))
+								p.reset();
+
+							return p;
+						}));
+				}
+
+				for (auto& result : pending) {
+					if (!result.get())
+						panic("failed to load a song");
+				}
+			});
+
+	printf("index %d songs: from the index %.3f ms, parsed %.3f ms, parsed on the thread pool (%u threads) %.3f ms%s\n",
+		NUM_SONGS, index_ms, parse_ms, std::max(1u, std::thread::hardware_concurrency()), pool_ms, ok ? "" : ", SONGS MISSING");
+
+	for (auto& path : paths)
+		unlink(path.c_str());
+
+	unlink(index_path.c_str());
+	rmdir(dir);
+
+	return ok;
+}
+
+bool
+bench_parse()
+{
+	const size_t CORPUS_SIZE = 16 << 20;
+
+	const std::vector<std::string>& paths = get_bundled_paths();
+
+	// the first song's header, then the lyrics of all of them over and
+	// over
+
+	std::string header, lyrics;
+
+	for (auto& path : paths) {
+		std::ifstream file(path, std::ios::binary);
+
+		std::string line;
+		std::getline(file, line);
+
+		if (header.empty())
+			header = line + '\n';
+
+		while (std::getline(file, line))
+			lyrics += line + '\n';
+	}
+
+	std::string corpus = header;
+
+	while (corpus.size() < CORPUS_SIZE)
+		corpus += lyrics;
+
+	const double mb = corpus.size()/double(1 << 20);
+
+	auto mb_per_s = [mb](double ms) { return 1e3*mb/ms; };
+
+	// decoding
+
+	const char *begin = corpus.data(), *end = begin + corpus.size();
+
+	std::wstring decoded, decoded_by_char;
+
+	const double decode_ms = time_ms(
+			[&]
+			{
+				if (utf8::decode(begin, end, decoded))
+					panic("invalid UTF-8 in the lyrics");
+			});
+
+	const double decode_by_char_ms = time_ms(
+			[&]
+			{
+				decoded_by_char.clear();
+
+				for (const char *p = begin; p != end; ) {
+					wchar_t ch = 0;
+
+					if (!(p = utf8::decode(p, end, ch)))
+						panic("invalid UTF-8 in the lyrics");
+
+					decoded_by_char.push_back(ch);
+				}
+			});
+
+	const bool same = decoded == decoded_by_char;
+
+	printf("parse %.1f MB: utf8::decode %.0f MB/s, a character at a time %.0f MB/s%s\n",
+		mb, mb_per_s(decode_ms), mb_per_s(decode_by_char_ms), same ? "" : ", DIFFERENT TEXT");
+
+	// reading the song
+
+	char path[] = "/tmp/typomania_bench.XXXXXX";
+
+	const int fd = mkstemp(path);
+	if (fd == -1)
+		panic("mkstemp failed: %s", strerror(errno));
+
+	if (write(fd, corpus.data(), corpus.size()) != static_cast<ssize_t>(corpus.size()))
+		panic("failed to write %s: %s", path, strerror(errno));
+
+	close(fd);
+
+	const double load_ms = time_ms(
+			[&]
+			{
+				kashi k;
+				if (!k.load(path))
+					panic("failed to load %s", path);
+			});
+
+	unlink(path);
+
+	printf("parse %.1f MB: kashi::load %.0f MB/s\n", mb, mb_per_s(load_ms));
+
+	return same;
+}
+
+struct benchmark
+{
+	const char *name;
+	bool (*run)();
+	bool needs_gl;
+};
+
+const benchmark BENCHMARKS[] = {
+	{ "sort", bench_sort, false },
+	{ "fft", bench_fft, false },
+	{ "font", bench_font, true },
+	{ "serifu", bench_serifu, true },
+	{ "memory", bench_memory, true },
+	{ "kana", bench_kana, true },
+	{ "index", bench_index, false },
+	{ "parse", bench_parse, false },
+};
+
+}
+
+int
+main(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++) {
+		if (std::none_of(std::begin(BENCHMARKS), std::end(BENCHMARKS), [=](const benchmark& b) { return !strcmp(b.name, argv[i]); })) {
+			fprintf(stderr, "unknown benchmark %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	srand(1);
+
+	std::unique_ptr<headless_context> context;
+
+	bool ok = true;
+
+	for (auto& b : BENCHMARKS) {
+		if (argc > 1 && std::none_of(argv + 1, argv + argc, [&](const char *name) { return !strcmp(b.name, name); }))
+			continue;
+
+		if (b.needs_gl && !context)
+			context.reset(new headless_context);
+
+		if (!b.run())
+			ok = false;
+	}
+
+	return ok ? 0 : 1;
+}
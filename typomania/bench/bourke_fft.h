@@ -0,0 +1,12 @@
+#pragma once
+
+// the FFT spectrum_bars used before fft_plan, as it was: an in-place
+// complex-to-complex transform of the 2^m points in x (real) and y
+// (imaginary), forward for dir = 1, scaling all of them by 1/2^m. only
+// here to time fft_plan against.
+
+namespace bourke {
+
+void fft(int dir, long m, float *x, float *y);
+
+}
@@ -0,0 +1,165 @@
+#include <cstdlib>
+
+#include <algorithm>
+
+#include "dxt.h"
+
+namespace {
+
+struct color
+{
+	int r, g, b, a;
+};
+
+uint16_t
+to_565(int r, int g, int b)
+{
+	return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+color
+from_565(uint16_t c)
+{
+	const int r = (c >> 11) & 0x1f;
+	const int g = (c >> 5) & 0x3f;
+	const int b = c & 0x1f;
+
+	return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 0 };
+}
+
+void
+put_le16(uint8_t *dest, uint16_t v)
+{
+	dest[0] = v;
+	dest[1] = v >> 8;
+}
+
+void
+compress_alpha(const color *block, uint8_t *dest)
+{
+	int a_min = 255, a_max = 0;
+
+	for (int i = 0; i < 16; i++) {
+		a_min = std::min(a_min, block[i].a);
+		a_max = std::max(a_max, block[i].a);
+	}
+
+	// a0 > a1 selects the mode with 6 interpolated values
+	int palette[8];
+	palette[0] = a_max;
+	palette[1] = a_min;
+	for (int i = 1; i < 7; i++)
+		palette[i + 1] = ((7 - i)*a_max + i*a_min)/7;
+
+	dest[0] = a_max;
+	dest[1] = a_min;
+
+	uint64_t indices = 0;
+
+	for (int i = 0; i < 16; i++) {
+		int best = 0, best_dist = 256;
+
+		for (int j = 0; j < 8; j++) {
+			const int dist = std::abs(block[i].a - palette[j]);
+			if (dist < best_dist) {
+				best = j;
+				best_dist = dist;
+			}
+		}
+
+		indices |= static_cast<uint64_t>(best) << (3*i);
+	}
+
+	for (int i = 0; i < 6; i++)
+		dest[2 + i] = indices >> (8*i);
+}
+
+void
+compress_color(const color *block, uint8_t *dest)
+{
+	color lo = { 255, 255, 255, 0 }, hi = { 0, 0, 0, 0 };
+
+	for (int i = 0; i < 16; i++) {
+		lo.r = std::min(lo.r, block[i].r);
+		lo.g = std::min(lo.g, block[i].g);
+		lo.b = std::min(lo.b, block[i].b);
+
+		hi.r = std::max(hi.r, block[i].r);
+		hi.g = std::max(hi.g, block[i].g);
+		hi.b = std::max(hi.b, block[i].b);
+	}
+
+	// inset the bounding box a bit, the extremes are rarely hit exactly
+	const color inset = { (hi.r - lo.r) >> 4, (hi.g - lo.g) >> 4, (hi.b - lo.b) >> 4, 0 };
+
+	const uint16_t c0 = to_565(hi.r - inset.r, hi.g - inset.g, hi.b - inset.b);
+	const uint16_t c1 = to_565(lo.r + inset.r, lo.g + inset.g, lo.b + inset.b);
+
+	// DXT5 color blocks always have four colors, whatever the order
+	color palette[4];
+	palette[0] = from_565(c0);
+	palette[1] = from_565(c1);
+	palette[2] = { (2*palette[0].r + palette[1].r)/3, (2*palette[0].g + palette[1].g)/3, (2*palette[0].b + palette[1].b)/3, 0 };
+	palette[3] = { (palette[0].r + 2*palette[1].r)/3, (palette[0].g + 2*palette[1].g)/3, (palette[0].b + 2*palette[1].b)/3, 0 };
+
+	put_le16(dest, c0);
+	put_le16(dest + 2, c1);
+
+	uint32_t indices = 0;
+
+	for (int i = 0; i < 16; i++) {
+		uint32_t best = 0;
+		int best_dist = 3*256*256;
+
+		for (int j = 0; j < 4; j++) {
+			const int dr = block[i].r - palette[j].r;
+			const int dg = block[i].g - palette[j].g;
+			const int db = block[i].b - palette[j].b;
+			const int dist = dr*dr + dg*dg + db*db;
+
+			if (dist < best_dist) {
+				best = j;
+				best_dist = dist;
+			}
+		}
+
+		indices |= best << (2*i);
+	}
+
+	for (int i = 0; i < 4; i++)
+		dest[4 + i] = indices >> (8*i);
+}
+
+}
+
+size_t
+dxt5_size(int width, int height)
+{
+	return ((width + 3)/4)*((height + 3)/4)*16;
+}
+
+void
+compress_dxt5(const unsigned *pixels, int width, int height, uint8_t *dest)
+{
+	for (int by = 0; by < height; by += 4) {
+		for (int bx = 0; bx < width; bx += 4) {
+			color block[16];
+
+			for (int i = 0; i < 4; i++) {
+				const int y = std::min(by + i, height - 1);
+
+				for (int j = 0; j < 4; j++) {
+					const int x = std::min(bx + j, width - 1);
+					const unsigned p = pixels[y*width + x];
+
+					block[i*4 + j] = { static_cast<int>(p & 0xff), static_cast<int>((p >> 8) & 0xff), static_cast<int>((p >> 16) & 0xff), static_cast<int>(p >> 24) };
+				}
+			}
+
+			compress_alpha(block, dest);
+			compress_color(block, dest + 8);
+
+			dest += 16;
+		}
+	}
+}
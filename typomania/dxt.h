@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// DXT5 (BC3) compression: each 4x4 block takes 16 bytes, 8 for the
+// interpolated alpha and 8 for the colors. pixels are RGBA, a byte each.
+
+size_t
+dxt5_size(int width, int height);
+
+// blocks that run past the right or bottom edge repeat the last column or
+// row of pixels
+void
+compress_dxt5(const unsigned *pixels, int width, int height, uint8_t *dest);
@@ -1,74 +1,206 @@
 #include <cmath>
-#include <cstdio>
 
-/* stolen from http://paulbourke.net/miscellaneous/dft/ */
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "fft.h"
 
-void fft(int dir,long m,float *x,float *y)
+namespace {
+
+// one stage of the radix-2 decimation-in-time transform: n points, blocks
+// of 2*l, twiddles w[0 .. l - 1]
+
+void
+butterflies_scalar(float *re, float *im, int n, int l, const float *w_re, const float *w_im)
+{
+	for (int i = 0; i < n; i += 2*l) {
+		float *a_re = re + i, *a_im = im + i;
+		float *b_re = a_re + l, *b_im = a_im + l;
+
+		for (int j = 0; j < l; j++) {
+			const float t_re = w_re[j]*b_re[j] - w_im[j]*b_im[j];
+			const float t_im = w_re[j]*b_im[j] + w_im[j]*b_re[j];
+
+			b_re[j] = a_re[j] - t_re;
+			b_im[j] = a_im[j] - t_im;
+
+			a_re[j] += t_re;
+			a_im[j] += t_im;
+		}
+	}
+}
+
+#if defined(__AVX__)
+
+const int VECTOR_WIDTH = 8;
+
+void
+butterflies_vector(float *re, float *im, int n, int l, const float *w_re, const float *w_im)
+{
+	for (int i = 0; i < n; i += 2*l) {
+		float *a_re = re + i, *a_im = im + i;
+		float *b_re = a_re + l, *b_im = a_im + l;
+
+		for (int j = 0; j < l; j += VECTOR_WIDTH) {
+			const __m256 wr = _mm256_loadu_ps(w_re + j);
+			const __m256 wi = _mm256_loadu_ps(w_im + j);
+
+			const __m256 br = _mm256_loadu_ps(b_re + j);
+			const __m256 bi = _mm256_loadu_ps(b_im + j);
+
+			const __m256 tr = _mm256_sub_ps(_mm256_mul_ps(wr, br), _mm256_mul_ps(wi, bi));
+			const __m256 ti = _mm256_add_ps(_mm256_mul_ps(wr, bi), _mm256_mul_ps(wi, br));
+
+			const __m256 ar = _mm256_loadu_ps(a_re + j);
+			const __m256 ai = _mm256_loadu_ps(a_im + j);
+
+			_mm256_storeu_ps(b_re + j, _mm256_sub_ps(ar, tr));
+			_mm256_storeu_ps(b_im + j, _mm256_sub_ps(ai, ti));
+
+			_mm256_storeu_ps(a_re + j, _mm256_add_ps(ar, tr));
+			_mm256_storeu_ps(a_im + j, _mm256_add_ps(ai, ti));
+		}
+	}
+}
+
+#elif defined(__SSE2__)
+
+const int VECTOR_WIDTH = 4;
+
+void
+butterflies_vector(float *re, float *im, int n, int l, const float *w_re, const float *w_im)
+{
+	for (int i = 0; i < n; i += 2*l) {
+		float *a_re = re + i, *a_im = im + i;
+		float *b_re = a_re + l, *b_im = a_im + l;
+
+		for (int j = 0; j < l; j += VECTOR_WIDTH) {
+			const __m128 wr = _mm_loadu_ps(w_re + j);
+			const __m128 wi = _mm_loadu_ps(w_im + j);
+
+			const __m128 br = _mm_loadu_ps(b_re + j);
+			const __m128 bi = _mm_loadu_ps(b_im + j);
+
+			const __m128 tr = _mm_sub_ps(_mm_mul_ps(wr, br), _mm_mul_ps(wi, bi));
+			const __m128 ti = _mm_add_ps(_mm_mul_ps(wr, bi), _mm_mul_ps(wi, br));
+
+			const __m128 ar = _mm_loadu_ps(a_re + j);
+			const __m128 ai = _mm_loadu_ps(a_im + j);
+
+			_mm_storeu_ps(b_re + j, _mm_sub_ps(ar, tr));
+			_mm_storeu_ps(b_im + j, _mm_sub_ps(ai, ti));
+
+			_mm_storeu_ps(a_re + j, _mm_add_ps(ar, tr));
+			_mm_storeu_ps(a_im + j, _mm_add_ps(ai, ti));
+		}
+	}
+}
+
+#else
+
+const int VECTOR_WIDTH = 0;
+
+void
+butterflies_vector(float *re, float *im, int n, int l, const float *w_re, const float *w_im)
+{
+	butterflies_scalar(re, im, n, l, w_re, w_im);
+}
+
+#endif
+
+}
+
+fft_plan::fft_plan(int log2_size)
+	: size_ { 1 << log2_size }
+	, half_size_ { size_/2 }
+	, bit_reverse_(half_size_)
+	, stage_re_(half_size_ - 1)
+	, stage_im_(half_size_ - 1)
+	, split_re_(half_size_)
+	, split_im_(half_size_)
+	, work_re_(half_size_)
+	, work_im_(half_size_)
+{
+	const int log2_half_size = log2_size - 1;
+
+	for (int i = 0; i < half_size_; i++) {
+		int r = 0;
+
+		for (int j = 0; j < log2_half_size; j++) {
+			if (i & (1 << j))
+				r |= 1 << (log2_half_size - 1 - j);
+		}
+
+		bit_reverse_[i] = r;
+	}
+
+	for (int l = 1; l < half_size_; l *= 2) {
+		for (int j = 0; j < l; j++) {
+			const double a = -M_PI*j/l;
+			stage_re_[l - 1 + j] = cos(a);
+			stage_im_[l - 1 + j] = sin(a);
+		}
+	}
+
+	for (int k = 0; k < half_size_; k++) {
+		const double a = -2.*M_PI*k/size_;
+		split_re_[k] = cos(a);
+		split_im_[k] = sin(a);
+	}
+}
+
+void
+fft_plan::transform(float *re, float *im) const
+{
+	for (int l = 1; l < half_size_; l *= 2) {
+		const float *w_re = &stage_re_[l - 1];
+		const float *w_im = &stage_im_[l - 1];
+
+		if (VECTOR_WIDTH && l >= VECTOR_WIDTH)
+			butterflies_vector(re, im, half_size_, l, w_re, w_im);
+		else
+			butterflies_scalar(re, im, half_size_, l, w_re, w_im);
+	}
+}
+
+void
+fft_plan::forward_real(const float *in, float *re, float *im) const
 {
-   long n,i,i1,j,k,i2,l,l1,l2;
-   float c1,c2,tx,ty,t1,t2,u1,u2,z;
-
-   /* Calculate the number of points */
-   n = 1;
-   for (i=0;i<m;i++) 
-      n *= 2;
-
-   /* Do the bit reversal */
-   i2 = n >> 1;
-   j = 0;
-   for (i=0;i<n-1;i++) {
-      if (i < j) {
-         tx = x[i];
-         ty = y[i];
-         x[i] = x[j];
-         y[i] = y[j];
-         x[j] = tx;
-         y[j] = ty;
-      }
-      k = i2;
-      while (k <= j) {
-         j -= k;
-         k >>= 1;
-      }
-      j += k;
-   }
-
-   /* Compute the FFT */
-   c1 = -1.0; 
-   c2 = 0.0;
-   l2 = 1;
-   for (l=0;l<m;l++) {
-      l1 = l2;
-      l2 <<= 1;
-      u1 = 1.0; 
-      u2 = 0.0;
-      for (j=0;j<l1;j++) {
-         for (i=j;i<n;i+=l2) {
-            i1 = i + l1;
-            t1 = u1 * x[i1] - u2 * y[i1];
-            t2 = u1 * y[i1] + u2 * x[i1];
-            x[i1] = x[i] - t1; 
-            y[i1] = y[i] - t2;
-            x[i] += t1;
-            y[i] += t2;
-         }
-         z =  u1 * c1 - u2 * c2;
-         u2 = u1 * c2 + u2 * c1;
-         u1 = z;
-      }
-      c2 = sqrt((1.0 - c1) / 2.0);
-      if (dir == 1) 
-         c2 = -c2;
-      c1 = sqrt((1.0 + c1) / 2.0);
-   }
-
-   /* Scaling for forward transform */
-   if (dir == 1) {
-      for (i=0;i<n;i++) {
-         x[i] /= n;
-         y[i] /= n;
-      }
-   }
+	// pack even/odd samples as real/imaginary parts, in bit reversed order
+
+	float *z_re = &work_re_[0];
+	float *z_im = &work_im_[0];
+
+	for (int i = 0; i < half_size_; i++) {
+		const int j = bit_reverse_[i];
+		z_re[i] = in[2*j];
+		z_im[i] = in[2*j + 1];
+	}
+
+	transform(z_re, z_im);
+
+	// X[k] = E[k] + W^k O[k], where
+	//   E[k] = (Z[k] + conj(Z[N - k]))/2
+	//   O[k] = -i (Z[k] - conj(Z[N - k]))/2
+
+	const float scale = 1.f/size_;
+
+	for (int k = 0; k < half_size_; k++) {
+		const int m = k ? half_size_ - k : 0;
+
+		const float e_re = .5f*(z_re[k] + z_re[m]);
+		const float e_im = .5f*(z_im[k] - z_im[m]);
+
+		const float o_re = .5f*(z_im[k] + z_im[m]);
+		const float o_im = -.5f*(z_re[k] - z_re[m]);
+
+		const float w_re = split_re_[k];
+		const float w_im = split_im_[k];
+
+		re[k] = scale*(e_re + w_re*o_re - w_im*o_im);
+		im[k] = scale*(e_im + w_re*o_im + w_im*o_re);
+	}
 }
@@ -1,14 +1,45 @@
 #ifndef FFT_H_
 #define FFT_H_
 
-/* stolen from http://paulbourke.net/miscellaneous/dft/ */
+#include <vector>
+
+#include <boost/noncopyable.hpp>
 
 /*
-   This computes an in-place complex-to-complex FFT 
-   x and y are the real and imaginary arrays of 2^m points.
-   dir =  1 gives forward transform
-   dir = -1 gives reverse transform 
+   Forward FFT of 2^m real samples. Twiddles and the bit reversal
+   permutation are computed once when the plan is created; the n real
+   samples are packed into n/2 complex points, transformed with a
+   radix-2 complex FFT and split back into the first n/2 bins.
 */
-void fft(int dir,long m,float *x,float *y);
+
+class fft_plan : private boost::noncopyable
+{
+public:
+	fft_plan(int log2_size);
+
+	int size() const
+	{ return size_; }
+
+	// writes bins 0 .. n/2 - 1 of the transform of in[0 .. n - 1] to
+	// re/im, scaled by 1/n
+	void forward_real(const float *in, float *re, float *im) const;
+
+private:
+	void transform(float *re, float *im) const;
+
+	int size_; // number of real samples
+	int half_size_; // number of points in the complex transform
+
+	std::vector<int> bit_reverse_;
+
+	// twiddles for every stage of the complex transform, stage with
+	// half-size l starts at offset l - 1
+	std::vector<float> stage_re_, stage_im_;
+
+	// twiddles used to split the packed transform into real bins
+	std::vector<float> split_re_, split_im_;
+
+	mutable std::vector<float> work_re_, work_im_;
+};
 
 #endif // FFT_H_
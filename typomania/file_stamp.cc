@@ -0,0 +1,18 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "file_stamp.h"
+
+bool
+get_file_stamp(const std::string& path, file_stamp& stamp)
+{
+	struct stat st;
+
+	if (stat(path.c_str(), &st) == -1)
+		return false;
+
+	stamp.mtime = st.st_mtime;
+	stamp.size = st.st_size;
+
+	return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// modification time and size of a file, to tell whether something derived
+// from it is stale
+
+struct file_stamp
+{
+	int64_t mtime;
+	int64_t size;
+
+	bool operator==(const file_stamp& other) const
+	{ return mtime == other.mtime && size == other.size; }
+
+	bool operator!=(const file_stamp& other) const
+	{ return !(*this == other); }
+};
+
+bool get_file_stamp(const std::string& path, file_stamp& stamp);
@@ -1,21 +1,66 @@
+#include <cstring>
+
 #include <fstream>
 #include <sstream>
-#include <memory>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "resources.h"
 #include "panic.h"
 #include "render.h"
 #include "font.h"
 
+namespace {
+
+const char FONTBIN_MAGIC[4] = { 'T', 'F', 'N', 'T' };
+const uint32_t FONTBIN_VERSION = 1;
+
+struct fontbin_header
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t num_glyphs;
+	uint32_t num_pages;
+	uint32_t texture_path_size;
+};
+
+static_assert(sizeof(font::glyph) == 14*4, "font::glyph must match the binary atlas");
+
+}
+
+font::font()
+	: page_index_(nullptr)
+	, pages_(nullptr)
+	, glyphs_(nullptr)
+	, mapping_(nullptr)
+	, mapping_size_(0)
+	, texture_(nullptr)
+{ }
+
+font::~font()
+{
+	if (mapping_)
+		munmap(mapping_, mapping_size_);
+}
+
 const font::glyph *
 font::find_glyph(int code) const
 {
-	auto i = glyph_map.find(code);
+	if (code >= 0 && code < NUM_PAGES*PAGE_SIZE) {
+		const int index = pages_[page_index_[code/PAGE_SIZE]*PAGE_SIZE + code%PAGE_SIZE];
 
-	if (i == glyph_map.end())
-		panic("glyph %d not found\n", code);
+		if (index != NO_GLYPH)
+			return &glyphs_[index];
+	}
 
-	return i != glyph_map.end() ? i->second.get() : nullptr;
+	panic("glyph %d not found\n", code);
+
+	return nullptr;
 }
 
 int
@@ -46,6 +91,70 @@ font::get_string_width(const wchar_t *str, size_t len) const
 
 bool
 font::load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	char magic[sizeof FONTBIN_MAGIC];
+
+	if (file.read(magic, sizeof magic) && !memcmp(magic, FONTBIN_MAGIC, sizeof magic))
+		return load_binary(path);
+	else
+		return load_text(path);
+}
+
+bool
+font::load_binary(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+
+	if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(fontbin_header)) {
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return false;
+
+	mapping_ = data;
+	mapping_size_ = st.st_size;
+
+	const char *base = static_cast<const char *>(data);
+	const fontbin_header *header = reinterpret_cast<const fontbin_header *>(base);
+
+	if (header->version != FONTBIN_VERSION)
+		return false;
+
+	const size_t tables_offset = sizeof *header + header->texture_path_size;
+	const size_t glyphs_offset = tables_offset + (NUM_PAGES + header->num_pages*PAGE_SIZE)*sizeof(uint16_t);
+
+	if (mapping_size_ < glyphs_offset + header->num_glyphs*sizeof(glyph))
+		return false;
+
+	const char *texture_path = base + sizeof *header;
+
+	if (!header->texture_path_size || texture_path[header->texture_path_size - 1] != '\0')
+		return false;
+
+	texture_ = ::get_texture(texture_path);
+
+	page_index_ = reinterpret_cast<const uint16_t *>(base + tables_offset);
+	pages_ = page_index_ + NUM_PAGES;
+	glyphs_ = reinterpret_cast<const glyph *>(base + glyphs_offset);
+
+	return true;
+}
+
+bool
+font::load_text(const std::string& path)
 {
 	std::ifstream file(path);
 	if (!file)
@@ -57,6 +166,8 @@ font::load(const std::string& path)
 
 	texture_ = ::get_texture(texture_path);
 
+	std::vector<std::pair<int, glyph>> entries;
+
 	std::string line;
 
 	while (std::getline(file, line)) {
@@ -65,19 +176,52 @@ font::load(const std::string& path)
 		int code;
 		ss >> code;
 
-		glyph_ptr g(new glyph);
+		glyph g;
 
-		ss >> g->width >> g->height;
-		ss >> g->left >> g->top;
-		ss >> g->advance_x >> g->advance_y;
-		ss >> g->t0.x >> g->t0.y;
-		ss >> g->t1.x >> g->t1.y;
-		ss >> g->t2.x >> g->t2.y;
-		ss >> g->t3.x >> g->t3.y;
+		ss >> g.width >> g.height;
+		ss >> g.left >> g.top;
+		ss >> g.advance_x >> g.advance_y;
+		ss >> g.t0.x >> g.t0.y;
+		ss >> g.t1.x >> g.t1.y;
+		ss >> g.t2.x >> g.t2.y;
+		ss >> g.t3.x >> g.t3.y;
 
-		glyph_map[code] = std::move(g);
+		if (!ss || code < 0 || code >= NUM_PAGES*PAGE_SIZE)
+			continue;
+
+		entries.emplace_back(code, g);
 	}
 
+	if (entries.size() >= NO_GLYPH)
+		return false;
+
+	// same tables as the binary atlas
+
+	std::vector<uint16_t> page_index(NUM_PAGES, 0);
+	int num_pages = 1;
+
+	for (auto& e : entries) {
+		uint16_t& page = page_index[e.first/PAGE_SIZE];
+		if (!page)
+			page = num_pages++;
+	}
+
+	table_storage_.assign(NUM_PAGES + num_pages*PAGE_SIZE, NO_GLYPH);
+	std::copy(page_index.begin(), page_index.end(), table_storage_.begin());
+
+	glyph_storage_.clear();
+	glyph_storage_.reserve(entries.size());
+
+	for (auto& e : entries) {
+		const int code = e.first;
+		table_storage_[NUM_PAGES + page_index[code/PAGE_SIZE]*PAGE_SIZE + code%PAGE_SIZE] = glyph_storage_.size();
+		glyph_storage_.push_back(e.second);
+	}
+
+	page_index_ = &table_storage_[0];
+	pages_ = page_index_ + NUM_PAGES;
+	glyphs_ = glyph_storage_.empty() ? nullptr : &glyph_storage_[0];
+
 	return true;
 }
 
@@ -126,3 +270,36 @@ font::draw_glyph(const glyph *gi, float x, float y, int layer) const
 		{ gi->t0, gi->t1, gi->t3, gi->t2 },
 		layer);
 }
+
+int
+font::layout_glyphs(const wchar_t *str, size_t len, float x, float y, laid_out_glyph *glyphs) const
+{
+	int width = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		const glyph *gi = find_glyph(str[i]);
+
+		const float x_left = x + gi->left;
+		const float x_right = x + gi->left + gi->width;
+
+		const float y_top = y + gi->top;
+		const float y_bottom = y + gi->top - gi->height;
+
+		glyphs[i] = {
+			{ x, y },
+			{ { x_left, y_top }, { x_right, y_top }, { x_left, y_bottom }, { x_right, y_bottom } },
+			{ gi->t0, gi->t1, gi->t3, gi->t2 } };
+
+		x += gi->advance_x;
+		width += gi->advance_x;
+	}
+
+	return width;
+}
+
+void
+font::draw_glyphs(const laid_out_glyph *glyphs, size_t len, int layer) const
+{
+	for (size_t i = 0; i < len; i++)
+		render::draw_quad(texture_, glyphs[i].verts, glyphs[i].texcoords, layer);
+}
@@ -1,24 +1,34 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
-#include <memory>
-#include <unordered_map>
+#include <vector>
 
 #include <boost/noncopyable.hpp>
 
 #include "vec2.h"
+#include "render.h"
 #include "gl_texture.h"
 
+// loads either the text .fnt written by dumpglyphs or its binary atlas
+// (.fntb, dumpglyphs -B), which is mapped and used in place. glyphs are
+// found through a two-level table: the high byte of the codepoint picks a
+// page of 256 glyph indices, page 0 being empty.
+
 class font : private boost::noncopyable
 {
 public:
+	font();
+	~font();
+
 	bool load(const std::string& path);
 
+	// same layout as the glyph records in the binary atlas
 	struct glyph
 	{
-		int width, height;
-		int left, top;
-		int advance_x, advance_y;
+		int32_t width, height;
+		int32_t left, top;
+		int32_t advance_x, advance_y;
 		vec2f t0, t1, t2, t3; // texture coordinates (0-1)
 	};
 
@@ -32,14 +42,46 @@ public:
 
 	void draw_glyph(wchar_t ch, float x, float y, int layer) const;
 
+	// a glyph laid out once; drawing it doesn't look up anything
+	struct laid_out_glyph
+	{
+		vec2f pen; // pen position
+		quad verts;
+		quad texcoords;
+	};
+
+	// lays out len glyphs into glyphs, starting at pen position (x, y);
+	// returns the width of the string
+	int layout_glyphs(const wchar_t *str, size_t len, float x, float y, laid_out_glyph *glyphs) const;
+
+	void draw_glyphs(const laid_out_glyph *glyphs, size_t len, int layer) const;
+
 	const gl::texture *get_texture() const
 	{ return texture_; }
 
 private:
+	enum {
+		PAGE_SIZE = 256,
+		NUM_PAGES = 0x10000/PAGE_SIZE,
+		NO_GLYPH = 0xffff,
+	};
+
+	bool load_binary(const std::string& path);
+	bool load_text(const std::string& path);
+
 	void draw_glyph(const glyph *gi, float x, float y, int layer) const;
 
-	using glyph_ptr = std::unique_ptr<glyph>;
-	std::unordered_map<int, glyph_ptr> glyph_map;
+	// point into the mapped atlas, or into the vectors below when loaded
+	// from the text format
+	const uint16_t *page_index_;
+	const uint16_t *pages_;
+	const glyph *glyphs_;
+
+	std::vector<uint16_t> table_storage_;
+	std::vector<glyph> glyph_storage_;
+
+	void *mapping_;
+	size_t mapping_size_;
 
 	const gl::texture *texture_;
 };
@@ -6,13 +6,18 @@
 
 #include <sstream>
 #include <algorithm>
+#include <chrono>
 
 #include <sys/types.h>
 #include <dirent.h>
 
 #include "gl_check.h"
+#include "gl_state.h"
 #include "panic.h"
+#include "thread_pool.h"
+#include "song_index.h"
 #include "render.h"
+#include "resources.h"
 #include "common.h"
 #include "in_game_state.h"
 #include "song_menu_state.h"
@@ -20,6 +25,9 @@
 
 static const char *KASHI_DIR = "data/lyrics";
 static const char *KASHI_EXT = ".kashi";
+static const char *SONG_INDEX_PATH = "data/lyrics.index";
+
+static const char *SHADER_DIR = "data/shaders";
 
 game_state::game_state(game *parent)
 	: parent_ { parent }
@@ -29,7 +37,10 @@ game_state::game_state(game *parent)
 game::game(int window_width, int window_height)
 	: window_width_ { window_width }
 	, window_height_ { window_height }
+	, recording_ { nullptr }
+	, audio_stats_ { 0, 0, 1 }
 {
+	load_shaders();
 	load_song_list();
 
 	if (kashi_list_.empty())
@@ -38,6 +49,14 @@ game::game(int window_width, int window_height)
 	push_state(new song_menu_state(this, kashi_list_));
 }
 
+void
+game::add_audio_stats(int num_underruns, float min_ring_fill)
+{
+	++audio_stats_.num_songs;
+	audio_stats_.num_underruns += num_underruns;
+	audio_stats_.min_ring_fill = std::min(audio_stats_.min_ring_fill, min_ring_fill);
+}
+
 game_state *
 game::cur_state()
 {
@@ -53,7 +72,9 @@ game::cur_state() const
 void
 game::redraw() const
 {
-	GL_CHECK(glViewport(0, 0, window_width_, window_height_));
+	render::begin_frame();
+
+	gl::state::set_viewport(0, 0, window_width_, window_height_);
 
 	GL_CHECK(glClearColor(0, 0, 0, 0));
 	GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
@@ -68,6 +89,7 @@ game::redraw() const
 void
 game::update()
 {
+	poll_async_textures();
 	cur_state()->update();
 }
 
@@ -83,14 +105,36 @@ game::on_key_up(int keysym)
 	cur_state()->on_key_up(keysym);
 }
 
+void
+game::load_shaders()
+{
+	const auto start = std::chrono::steady_clock::now();
+
+	const int count = load_programs(SHADER_DIR);
+
+	const double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	fprintf(stderr, "loaded %d programs in %.1f ms\n", count, elapsed_ms);
+}
+
 void
 game::load_song_list()
 {
+	const auto start = std::chrono::steady_clock::now();
+
 	DIR *dir;
 
 	if (!(dir = opendir(KASHI_DIR)))
 		panic("failed to open %s: %s", KASHI_DIR, strerror(errno));
 
+	// songs whose file hasn't changed since the last run come from the
+	// index, the rest are parsed in parallel. lyrics are only kept once a
+	// song is selected, and backgrounds are loaded when first shown
+
+	song_index index;
+	index.load(SONG_INDEX_PATH);
+
+	std::vector<std::pair<file_stamp, std::future<kashi_ptr>>> pending;
+
 	struct dirent *de;
 
 	while ((de = readdir(dir))) {
@@ -98,20 +142,57 @@ game::load_song_list()
 		const size_t len = strlen(name);
 
 		if (len >= strlen(KASHI_EXT) && !strcmp(name + len - strlen(KASHI_EXT), KASHI_EXT)) {
-			std::ostringstream path;
-			path << KASHI_DIR << '/' << name;
+			std::ostringstream os;
+			os << KASHI_DIR << '/' << name;
+
+			const std::string path = os.str();
 
-			fprintf(stderr, "loading %s\n", path.str().c_str());
+			file_stamp stamp;
 
-			kashi_ptr p(new kashi);
+			if (!get_file_stamp(path, stamp))
+				continue;
 
-			if (p->load(path.str().c_str()))
+			if (kashi_ptr p = index.find(path, stamp)) {
 				kashi_list_.push_back(std::move(p));
+				continue;
+			}
+
+			pending.emplace_back(stamp, get_thread_pool().submit(
+						[path]
+						{
+							kashi_ptr p(new kashi);
+
+							if (!p->load(path))
+								p.reset();
+
+							return p;
+						}));
 		}
 	}
 
 	closedir(dir);
 
+	const size_t num_cached = kashi_list_.size();
+
+	for (auto& result : pending) {
+		if (kashi_ptr p = result.second.get()) {
+			index.add(*p, result.first);
+			kashi_list_.push_back(std::move(p));
+		}
+	}
+
+	// rewrite the index if any song was added, changed or removed
+	const size_t num_removed = index.remove_unused();
+
+	if (!pending.empty() || num_removed) {
+		if (!index.save(SONG_INDEX_PATH))
+			fprintf(stderr, "failed to save %s: %s\n", SONG_INDEX_PATH, strerror(errno));
+	}
+
+	const double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	fprintf(stderr, "loaded %zu songs, %zu from %s, in %.1f ms\n", kashi_list_.size(), num_cached, SONG_INDEX_PATH, elapsed_ms);
+
 	std::sort(std::begin(kashi_list_), std::end(kashi_list_),
 			[](const kashi_ptr& a, const kashi_ptr& b)
 			{
@@ -131,9 +212,14 @@ game::pop_state()
 	state_stack_.pop();
 }
 
-void game::enter_in_game_state(const kashi& cur_kashi)
+in_game_state *game::enter_in_game_state(kashi& cur_kashi)
 {
-	push_state(new in_game_state(this, cur_kashi));
+	if (!cur_kashi.load_lyrics())
+		panic("failed to load lyrics from %s", cur_kashi.path.c_str());
+
+	auto state = new in_game_state(this, cur_kashi);
+	push_state(state);
+	return state;
 }
 
 void game::leave_state()
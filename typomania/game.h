@@ -9,6 +9,8 @@
 #include "kashi.h"
 
 class game;
+class in_game_state;
+struct replay;
 
 class game_state
 {
@@ -35,9 +37,31 @@ public:
 	void on_key_up(int keysym);
 	void on_key_down(int keysym);
 
-	void enter_in_game_state(const kashi& cur_kashi);
+	// loads the song's lyrics if they aren't yet
+	in_game_state *enter_in_game_state(kashi& cur_kashi);
 	void leave_state();
 
+	// songs played from now on record their keystrokes to r
+	void set_recording(replay *r)
+	{ recording_ = r; }
+
+	replay *get_recording() const
+	{ return recording_; }
+
+	// playback counters of the songs played so far, for the end-of-run
+	// report
+	struct audio_stats
+	{
+		int num_songs;
+		int num_underruns;
+		float min_ring_fill;
+	};
+
+	void add_audio_stats(int num_underruns, float min_ring_fill);
+
+	const audio_stats& get_audio_stats() const
+	{ return audio_stats_; }
+
 	int get_window_width() const
 	{ return window_width_; }
 
@@ -48,6 +72,7 @@ private:
 	void push_state(game_state *new_state);
 	void pop_state();
 
+	void load_shaders();
 	void load_song_list();
 
 	game_state *cur_state();
@@ -58,4 +83,7 @@ private:
 
 	std::stack<std::unique_ptr<game_state>> state_stack_;
 	std::vector<kashi_ptr> kashi_list_;
+
+	replay *recording_;
+	audio_stats audio_stats_;
 };
@@ -0,0 +1,27 @@
+#include <SDL.h>
+
+#include "game_clock.h"
+
+namespace game_clock {
+
+namespace {
+
+bool virtual_time = false;
+unsigned virtual_ms;
+
+}
+
+unsigned
+get_ms()
+{
+	return virtual_time ? virtual_ms : SDL_GetTicks();
+}
+
+void
+set_virtual_ms(unsigned ms)
+{
+	virtual_time = true;
+	virtual_ms = ms;
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// milliseconds since some arbitrary point. the game reads this instead of
+// calling SDL_GetTicks() directly so that replays can run on virtual time.
+
+namespace game_clock {
+
+unsigned get_ms();
+
+// switches to virtual time: get_ms() returns ms until it's set again
+void set_virtual_ms(unsigned ms);
+
+}
@@ -0,0 +1,52 @@
+#include <GL/glew.h>
+
+#include "gl_check.h"
+#include "gl_buffer.h"
+
+namespace gl {
+
+buffer::buffer(GLenum target)
+	: target_ { target }
+{
+	GL_CHECK(glGenBuffers(1, &id_));
+}
+
+buffer::~buffer()
+{
+	GL_CHECK(glDeleteBuffers(1, &id_));
+}
+
+void
+buffer::bind() const
+{
+	GL_CHECK(glBindBuffer(target_, id_));
+}
+
+void
+buffer::unbind() const
+{
+	GL_CHECK(glBindBuffer(target_, 0));
+}
+
+void
+buffer::set_data(GLsizeiptr size, const GLvoid *data, GLenum usage) const
+{
+	GL_CHECK(glBufferData(target_, size, data, usage));
+}
+
+void *
+buffer::map_range(GLintptr offset, GLsizeiptr length, GLbitfield access) const
+{
+	void *p = GL_CHECK_R(glMapBufferRange(target_, offset, length, access));
+	if (!p)
+		panic("glMapBufferRange failed");
+	return p;
+}
+
+bool
+buffer::unmap() const
+{
+	return GL_CHECK_R(glUnmapBuffer(target_)) == GL_TRUE;
+}
+
+}
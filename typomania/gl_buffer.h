@@ -0,0 +1,30 @@
+#pragma once
+
+#include <GL/gl.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace gl {
+
+class buffer : private boost::noncopyable
+{
+public:
+	buffer(GLenum target);
+	~buffer();
+
+	void bind() const;
+	void unbind() const;
+
+	void set_data(GLsizeiptr size, const GLvoid *data, GLenum usage) const;
+
+	void *map_range(GLintptr offset, GLsizeiptr length, GLbitfield access) const;
+
+	// false if the contents were lost while mapped
+	bool unmap() const;
+
+private:
+	GLenum target_;
+	GLuint id_;
+};
+
+} // gl
@@ -1,10 +1,17 @@
 #include <GL/glew.h>
 
 #include "gl_check.h"
+#include "gl_state.h"
 #include "gl_framebuffer.h"
 
 namespace gl {
 
+namespace {
+
+GLuint default_fbo_id = 0;
+
+}
+
 framebuffer::framebuffer(int width, int height)
 {
 	// initialize texture
@@ -22,20 +29,30 @@ framebuffer::framebuffer(int width, int height)
 
 framebuffer::~framebuffer()
 {
+	if (default_fbo_id == fbo_id_)
+		default_fbo_id = 0;
+
+	state::forget_framebuffer(fbo_id_);
 	GL_CHECK(glDeleteFramebuffers(1, &fbo_id_));
 }
 
 void
 framebuffer::bind() const
 {
-	GL_CHECK(glViewport(0, 0, texture_.texture_width_, texture_.texture_height_));
-	GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, fbo_id_));
+	state::set_viewport(0, 0, texture_.texture_width_, texture_.texture_height_);
+	state::bind_framebuffer(fbo_id_);
 }
 
 void
 framebuffer::unbind()
 {
-	GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+	state::bind_framebuffer(default_fbo_id);
+}
+
+void
+framebuffer::set_as_default() const
+{
+	default_fbo_id = fbo_id_;
 }
 
 const texture *
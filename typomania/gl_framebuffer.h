@@ -13,6 +13,10 @@ public:
 	void bind() const;
 	static void unbind();
 
+	// make unbind() go back to this framebuffer instead of the window's,
+	// so whole frames can be rendered offscreen
+	void set_as_default() const;
+
 	const texture *get_texture() const;
 
 private:
@@ -1,6 +1,15 @@
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <streambuf>
 #include <sstream>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include <GL/glew.h>
 
@@ -9,9 +18,75 @@
 #include "panic.h"
 #include "gl_program.h"
 #include "gl_check.h"
+#include "gl_state.h"
 
 namespace gl {
 
+namespace {
+
+// linked programs are kept here, named after a hash of their sources and
+// of the driver, since a binary only loads on the driver that made it
+const char *PROGRAM_CACHE_DIR = "data/cache";
+
+int skipped_uniform_uploads = 0;
+
+std::string
+read_file(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		panic("failed to open %s", path.c_str());
+
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+
+	return buffer.str();
+}
+
+uint64_t
+fnv1a(const char *data, size_t size, uint64_t hash)
+{
+	for (size_t i = 0; i < size; i++) {
+		hash ^= static_cast<uint8_t>(data[i]);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+bool
+can_cache_binaries()
+{
+	if (!GLEW_ARB_get_program_binary)
+		return false;
+
+	GLint num_formats;
+	GL_CHECK(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats));
+
+	return num_formats > 0;
+}
+
+std::string
+binary_path(const std::string& vert_source, const std::string& frag_source)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const char *str = reinterpret_cast<const char *>(GL_CHECK_R(glGetString(name)));
+		hash = fnv1a(str, strlen(str) + 1, hash);
+	}
+
+	hash = fnv1a(vert_source.c_str(), vert_source.size() + 1, hash);
+	hash = fnv1a(frag_source.c_str(), frag_source.size() + 1, hash);
+
+	char name[64];
+	snprintf(name, sizeof name, "/%016llx.progbin", static_cast<unsigned long long>(hash));
+
+	return PROGRAM_CACHE_DIR + std::string(name);
+}
+
+}
+
 //
 //   s h a d e r
 //
@@ -22,7 +97,6 @@ public:
 	shader(GLenum type);
 
 	void set_source(const std::string& source);
-	void load_source(const std::string& path);
 
 private:
 	friend class program;
@@ -52,26 +126,14 @@ shader::set_source(const std::string& source)
 	}
 }
 
-void
-shader::load_source(const std::string& path)
-{
-	std::ifstream file(path);
-	if (!file) {
-		panic("failed to open %s", path.c_str());
-	}
-
-	std::stringstream buffer;
-	buffer << file.rdbuf();
-
-	set_source(buffer.str());
-}
-
 //
 //   p r o g r a m
 //
 
 program::program()
 	: id_ { GL_CHECK_R(glCreateProgram()) }
+	, proj_modelview_slot_ { nullptr }
+	, tex_slot_ { nullptr }
 { }
 
 bool
@@ -84,20 +146,114 @@ program::load(const std::string& path)
 	Json::Value root;
 	file >> root;
 
+	const std::string vert_source = read_file(root["vs"].asString());
+	const std::string frag_source = read_file(root["fs"].asString());
+
+	const bool cache_binary = can_cache_binaries();
+
+	std::string cache_path;
+
+	if (cache_binary) {
+		cache_path = binary_path(vert_source, frag_source);
+
+		if (load_binary(cache_path)) {
+			find_uniforms();
+			return true;
+		}
+	}
+
 	gl::shader vert_shader(GL_VERTEX_SHADER);
-	vert_shader.load_source(root["vs"].asString());
+	vert_shader.set_source(vert_source);
 
 	gl::shader frag_shader(GL_FRAGMENT_SHADER);
-	frag_shader.load_source(root["fs"].asString());
+	frag_shader.set_source(frag_source);
 
 	attach(vert_shader);
 	attach(frag_shader);
 
+	if (cache_binary)
+		GL_CHECK(glProgramParameteri(id_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+
 	link();
+	find_uniforms();
+
+	if (cache_binary && !save_binary(cache_path))
+		fprintf(stderr, "failed to save %s\n", cache_path.c_str());
 
 	return true;
 }
 
+bool
+program::load_binary(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	std::vector<char> data { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+	GLenum format;
+
+	if (data.size() <= sizeof format)
+		return false;
+
+	memcpy(&format, &data[0], sizeof format);
+
+	// not GL_CHECKed: a driver may reject a binary it doesn't like with
+	// an error rather than a failed link, and either way the program is
+	// then built from source as usual
+	glProgramBinary(id_, format, &data[sizeof format], data.size() - sizeof format);
+
+	bool failed = false;
+
+	while (glGetError() != GL_NO_ERROR)
+		failed = true;
+
+	int rv;
+	GL_CHECK(glGetProgramiv(id_, GL_LINK_STATUS, &rv));
+
+	if (failed || !rv) {
+		fprintf(stderr, "%s was rejected, rebuilding it\n", path.c_str());
+		remove(path.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool
+program::save_binary(const std::string& path) const
+{
+	GLint size;
+	GL_CHECK(glGetProgramiv(id_, GL_PROGRAM_BINARY_LENGTH, &size));
+
+	if (size <= 0)
+		return false;
+
+	GLenum format;
+	std::vector<char> data(size);
+	GL_CHECK(glGetProgramBinary(id_, size, nullptr, &format, &data[0]));
+
+	mkdir(PROGRAM_CACHE_DIR, 0755);
+
+	// written to a temporary first, a truncated binary could upset the driver
+	const std::string temp_path = path + ".tmp";
+
+	{
+		std::ofstream file(temp_path, std::ios::binary);
+		if (!file)
+			return false;
+
+		file.write(reinterpret_cast<const char *>(&format), sizeof format);
+		file.write(&data[0], size);
+
+		if (!file.flush())
+			return false;
+	}
+
+	return rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
 void
 program::attach(const shader& s)
 {
@@ -118,74 +274,186 @@ program::link()
 void
 program::use() const
 {
-	GL_CHECK(glUseProgram(id_));
+	state::use_program(id_);
+}
+
+void
+program::find_uniforms()
+{
+	uniforms_.clear();
+
+	GLint num_uniforms;
+	GL_CHECK(glGetProgramiv(id_, GL_ACTIVE_UNIFORMS, &num_uniforms));
+
+	for (GLint i = 0; i < num_uniforms; i++) {
+		GLchar name[256];
+		GLsizei length;
+		GLint size;
+		GLenum type;
+		GL_CHECK(glGetActiveUniform(id_, i, sizeof name, &length, &size, &type, name));
+
+		// arrays are reported as name[0]
+		std::string uniform_name(name, length);
+		if (uniform_name.size() > 3 && uniform_name.compare(uniform_name.size() - 3, 3, "[0]") == 0)
+			uniform_name.resize(uniform_name.size() - 3);
+
+		const GLint location = GL_CHECK_R(glGetUniformLocation(id_, name));
+		if (location < 0)
+			continue; // in a uniform block
+
+		uniforms_.push_back({ uniform_name, location, 0, { } });
+	}
+
+	// uniforms_ is left alone from here on, so the pointers stay valid
+
+	auto find_slot = [this](const char *name) -> uniform_slot *
+		{
+			for (auto& slot : uniforms_) {
+				if (slot.name == name)
+					return &slot;
+			}
+
+			return nullptr;
+		};
+
+	proj_modelview_slot_ = find_slot("proj_modelview");
+	tex_slot_ = find_slot("tex");
 }
 
 program::uniform
 program::get_uniform(const std::string& name) const
 {
-	GLint location = GL_CHECK_R(glGetUniformLocation(id_, name.c_str()));
-	if (location < 0)
+	auto it = std::find_if(
+			uniforms_.begin(), uniforms_.end(),
+			[&name](const uniform_slot& slot) { return slot.name == name; });
+
+	if (it == uniforms_.end())
 		panic("invalid uniform %s", name.c_str());
-	return uniform(location);
+
+	return uniform(&*it);
+}
+
+program::uniform
+program::get_proj_modelview_uniform() const
+{
+	if (!proj_modelview_slot_)
+		panic("invalid uniform proj_modelview");
+
+	return uniform(proj_modelview_slot_);
+}
+
+program::uniform
+program::get_tex_uniform() const
+{
+	if (!tex_slot_)
+		panic("invalid uniform tex");
+
+	return uniform(tex_slot_);
+}
+
+int
+program::take_skipped_uniform_uploads()
+{
+	const int count = skipped_uniform_uploads;
+	skipped_uniform_uploads = 0;
+	return count;
 }
 
-program::uniform::uniform(GLint location)
-	: location_ { location }
+bool
+program::uniform_slot::update(const void *new_value, GLsizei size)
+{
+	if (value_size == size && memcmp(value, new_value, size) == 0) {
+		++skipped_uniform_uploads;
+		return false;
+	}
+
+	memcpy(value, new_value, size);
+	value_size = size;
+
+	return true;
+}
+
+program::uniform::uniform(uniform_slot *slot)
+	: slot_ { slot }
 { }
 
 void
-program::uniform::set_f(GLfloat v0)
+program::uniform::set_f(GLfloat v0) const
 {
-	GL_CHECK(glUniform1f(location_, v0));
+	const GLfloat value[] = { v0 };
+
+	if (slot_->update(value, sizeof value))
+		GL_CHECK(glUniform1f(slot_->location, v0));
 }
 
 void
-program::uniform::set_f(GLfloat v0, GLfloat v1)
+program::uniform::set_f(GLfloat v0, GLfloat v1) const
 {
-	GL_CHECK(glUniform2f(location_, v0, v1));
+	const GLfloat value[] = { v0, v1 };
+
+	if (slot_->update(value, sizeof value))
+		GL_CHECK(glUniform2f(slot_->location, v0, v1));
 }
 
 void
-program::uniform::set_f(GLfloat v0, GLfloat v1, GLfloat v2)
+program::uniform::set_f(GLfloat v0, GLfloat v1, GLfloat v2) const
 {
-	GL_CHECK(glUniform3f(location_, v0, v1, v2));
+	const GLfloat value[] = { v0, v1, v2 };
+
+	if (slot_->update(value, sizeof value))
+		GL_CHECK(glUniform3f(slot_->location, v0, v1, v2));
 }
 
 void
-program::uniform::set_f(GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3)
+program::uniform::set_f(GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) const
 {
-	GL_CHECK(glUniform4f(location_, v0, v1, v2, v3));
+	const GLfloat value[] = { v0, v1, v2, v3 };
+
+	if (slot_->update(value, sizeof value))
+		GL_CHECK(glUniform4f(slot_->location, v0, v1, v2, v3));
 }
 
 void
-program::uniform::set_i(GLint v0)
+program::uniform::set_i(GLint v0) const
 {
-	GL_CHECK(glUniform1i(location_, v0));
+	const GLint value[] = { v0 };
+
+	if (slot_->update(value, sizeof value))
+		GL_CHECK(glUniform1i(slot_->location, v0));
 }
 
 void
-program::uniform::set_i(GLint v0, GLint v1)
+program::uniform::set_i(GLint v0, GLint v1) const
 {
-	GL_CHECK(glUniform2i(location_, v0, v1));
+	const GLint value[] = { v0, v1 };
+
+	if (slot_->update(value, sizeof value))
+		GL_CHECK(glUniform2i(slot_->location, v0, v1));
 }
 
 void
-program::uniform::set_i(GLint v0, GLint v1, GLint v2)
+program::uniform::set_i(GLint v0, GLint v1, GLint v2) const
 {
-	GL_CHECK(glUniform3i(location_, v0, v1, v2));
+	const GLint value[] = { v0, v1, v2 };
+
+	if (slot_->update(value, sizeof value))
+		GL_CHECK(glUniform3i(slot_->location, v0, v1, v2));
 }
 
 void
-program::uniform::set_i(GLint v0, GLint v1, GLint v2, GLint v3)
+program::uniform::set_i(GLint v0, GLint v1, GLint v2, GLint v3) const
 {
-	GL_CHECK(glUniform4i(location_, v0, v1, v2, v3));
+	const GLint value[] = { v0, v1, v2, v3 };
+
+	if (slot_->update(value, sizeof value))
+		GL_CHECK(glUniform4i(slot_->location, v0, v1, v2, v3));
 }
 
 void
-program::uniform::set_mat4(const GLfloat *mat)
+program::uniform::set_mat4(const GLfloat *mat) const
 {
-	GL_CHECK(glUniformMatrix4fv(location_, 1, 1, mat));
+	if (slot_->update(mat, 16*sizeof(GLfloat)))
+		GL_CHECK(glUniformMatrix4fv(slot_->location, 1, 1, mat));
 }
 
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <GL/gl.h>
 
 #include <boost/noncopyable.hpp>
@@ -11,6 +12,8 @@ class shader;
 
 class program : private boost::noncopyable
 {
+	struct uniform_slot;
+
 public:
 	program();
 
@@ -18,34 +21,68 @@ public:
 
 	void use() const;
 
+	// a handle to one of the program's uniforms, valid as long as the
+	// program. setting the value it already has doesn't call GL.
 	class uniform
 	{
 	public:
-		uniform(GLint location);
+		uniform(uniform_slot *slot);
 
-		void set_f(GLfloat v0);
-		void set_f(GLfloat v0, GLfloat v1);
-		void set_f(GLfloat v0, GLfloat v1, GLfloat v2);
-		void set_f(GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3);
+		void set_f(GLfloat v0) const;
+		void set_f(GLfloat v0, GLfloat v1) const;
+		void set_f(GLfloat v0, GLfloat v1, GLfloat v2) const;
+		void set_f(GLfloat v0, GLfloat v1, GLfloat v2, GLfloat v3) const;
 
-		void set_i(GLint v0);
-		void set_i(GLint v0, GLint v1);
-		void set_i(GLint v0, GLint v1, GLint v2);
-		void set_i(GLint v0, GLint v1, GLint v2, GLint v3);
+		void set_i(GLint v0) const;
+		void set_i(GLint v0, GLint v1) const;
+		void set_i(GLint v0, GLint v1, GLint v2) const;
+		void set_i(GLint v0, GLint v1, GLint v2, GLint v3) const;
 
-		void set_mat4(const GLfloat *mat);
+		void set_mat4(const GLfloat *mat) const;
 
 	private:
-		GLint location_;
+		uniform_slot *slot_;
 	};
 
 	uniform get_uniform(const std::string& name) const;
 
+	// proj_modelview and tex, which the render queue sets on every
+	// program it draws with; looked up once when the program is loaded
+	uniform get_proj_modelview_uniform() const;
+	uniform get_tex_uniform() const;
+
+	// uniform uploads skipped because the value was already set, since
+	// the last call
+	static int take_skipped_uniform_uploads();
+
 private:
+	struct uniform_slot
+	{
+		std::string name;
+		GLint location;
+
+		// last value set, compared as raw bytes
+		GLsizei value_size; // 0 until it's set
+		unsigned char value[16*sizeof(GLfloat)];
+
+		// stores value and returns true unless it's the one already set
+		bool update(const void *value, GLsizei size);
+	};
+
 	void attach(const shader& s);
 	void link();
 
+	// fills the uniform table, once the program is linked
+	void find_uniforms();
+
+	// binaries cached by an earlier run; see gl_program.cc
+	bool load_binary(const std::string& path);
+	bool save_binary(const std::string& path) const;
+
 	GLuint id_;
+	mutable std::vector<uniform_slot> uniforms_;
+	uniform_slot *proj_modelview_slot_; // nullptr if the program has none
+	uniform_slot *tex_slot_;
 };
 
 } // gl
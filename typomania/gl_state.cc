@@ -0,0 +1,140 @@
+#include <GL/glew.h>
+
+#include <array>
+#include <utility>
+
+#include "gl_check.h"
+#include "gl_state.h"
+
+namespace gl {
+namespace state {
+
+namespace {
+
+const int MAX_TEXTURE_UNITS = 8;
+
+// not a valid name, so the first change of anything always goes through
+const GLuint UNKNOWN = ~0u;
+
+struct shadow
+{
+	shadow()
+	: program(UNKNOWN)
+	, active_texture_unit(-1)
+	, blend_enabled(-1)
+	, blend_func(GL_NONE, GL_NONE)
+	, viewport({ { -1, -1, -1, -1 } })
+	, framebuffer(UNKNOWN)
+	{
+		textures.fill(UNKNOWN);
+	}
+
+	GLuint program;
+	int active_texture_unit;
+	std::array<GLuint, MAX_TEXTURE_UNITS> textures;
+	int blend_enabled;
+	std::pair<GLenum, GLenum> blend_func;
+	std::array<GLint, 4> viewport;
+	GLuint framebuffer;
+} cur;
+
+change_counts counts = { 0, 0 };
+
+template <typename T>
+bool
+update(T& current, const T& value)
+{
+	if (current == value) {
+		++counts.elided;
+		return false;
+	}
+
+	current = value;
+	++counts.issued;
+
+	return true;
+}
+
+}
+
+void
+use_program(GLuint id)
+{
+	if (update(cur.program, id))
+		GL_CHECK(glUseProgram(id));
+}
+
+void
+bind_texture(GLuint id, int unit)
+{
+	if (cur.textures[unit] == id) {
+		++counts.elided;
+		return;
+	}
+
+	if (update(cur.active_texture_unit, unit))
+		GL_CHECK(glActiveTexture(GL_TEXTURE0 + unit));
+
+	if (update(cur.textures[unit], id))
+		GL_CHECK(glBindTexture(GL_TEXTURE_2D, id));
+}
+
+void
+enable_blend(GLenum src_factor, GLenum dest_factor)
+{
+	if (update(cur.blend_enabled, 1))
+		GL_CHECK(glEnable(GL_BLEND));
+
+	if (update(cur.blend_func, std::make_pair(src_factor, dest_factor)))
+		GL_CHECK(glBlendFunc(src_factor, dest_factor));
+}
+
+void
+disable_blend()
+{
+	if (update(cur.blend_enabled, 0))
+		GL_CHECK(glDisable(GL_BLEND));
+}
+
+void
+set_viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	const std::array<GLint, 4> viewport = { { x, y, width, height } };
+
+	if (update(cur.viewport, viewport))
+		GL_CHECK(glViewport(x, y, width, height));
+}
+
+void
+bind_framebuffer(GLuint id)
+{
+	if (update(cur.framebuffer, id))
+		GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, id));
+}
+
+void
+forget_texture(GLuint id)
+{
+	for (auto& texture : cur.textures) {
+		if (texture == id)
+			texture = UNKNOWN;
+	}
+}
+
+void
+forget_framebuffer(GLuint id)
+{
+	if (cur.framebuffer == id)
+		cur.framebuffer = UNKNOWN;
+}
+
+change_counts
+take_change_counts()
+{
+	const change_counts result = counts;
+	counts = { 0, 0 };
+	return result;
+}
+
+} // state
+} // gl
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <GL/gl.h>
+
+// shadow copy of the GL state the game changes, so setting something to
+// the value it already has doesn't reach the driver. everything that
+// binds programs, textures or framebuffers, or changes the blend state or
+// viewport, goes through here.
+
+namespace gl {
+namespace state {
+
+void use_program(GLuint id);
+
+void bind_texture(GLuint id, int unit = 0);
+
+void enable_blend(GLenum src_factor, GLenum dest_factor);
+void disable_blend();
+
+void set_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+void bind_framebuffer(GLuint id);
+
+// deleted objects are unbound by GL, and their names can be reused
+void forget_texture(GLuint id);
+void forget_framebuffer(GLuint id);
+
+// state changes that were passed on to GL and ones that were dropped,
+// since the last call
+struct change_counts
+{
+	int issued;
+	int elided;
+};
+
+change_counts take_change_counts();
+
+} // state
+} // gl
@@ -1,7 +1,11 @@
-#include <memory>
+#include <GL/glew.h>
+
+#include <vector>
 
 #include "image.h"
+#include "texture_file.h"
 #include "gl_check.h"
+#include "gl_state.h"
 #include "gl_texture.h"
 
 namespace {
@@ -24,13 +28,28 @@ next_power_of_2(T n)
 namespace gl {
 
 texture::texture()
+	: storage_(this)
+	, texcoord_offset_(0, 0)
+	, texcoord_scale_(1, 1)
 {
 	GL_CHECK(glGenTextures(1, &id_));
 }
 
+texture::texture(const texture& storage, int x, int y, int width, int height)
+	: image_width_(width), image_height_(height)
+	, texture_width_(width), texture_height_(height)
+	, id_(storage.id_)
+	, storage_(&storage)
+	, texcoord_offset_(static_cast<float>(x)/storage.texture_width_, static_cast<float>(y)/storage.texture_height_)
+	, texcoord_scale_(static_cast<float>(width)/storage.texture_width_, static_cast<float>(height)/storage.texture_height_)
+{ }
+
 texture::~texture()
 {
-	GL_CHECK(glDeleteTextures(1, &id_));
+	if (!is_region()) {
+		state::forget_texture(id_);
+		GL_CHECK(glDeleteTextures(1, &id_));
+	}
 }
 
 void
@@ -45,28 +64,49 @@ texture::allocate(int width, int height)
 bool
 texture::load(const std::string& path)
 {
-	image img;
+	png_reader reader;
 
-	if (!img.load(path))
+	if (!reader.open(path))
 		return false;
 
-	image_width_ = img.get_width();
-	image_height_ = img.get_height();
+	return load(reader);
+}
 
-	texture_width_ = next_power_of_2(image_width_);
-	texture_height_ = next_power_of_2(image_height_);
+bool
+texture::load(png_reader& reader)
+{
+	set_size(reader.get_width(), reader.get_height());
 
-	img.resize(texture_width_, texture_height_);
+	// decode straight into the padded buffer
+	std::vector<unsigned> bits(texture_width_*texture_height_);
+	if (!reader.read(&bits[0], texture_width_, texture_height_))
+		return false;
 
-	initialize(img.get_bits());
+	initialize(&bits[0]);
 
 	return true;
 }
 
+void
+texture::set_size(int image_width, int image_height)
+{
+	image_width_ = image_width;
+	image_height_ = image_height;
+
+	texture_width_ = get_texture_size(image_width_);
+	texture_height_ = get_texture_size(image_height_);
+}
+
+int
+texture::get_texture_size(int image_size)
+{
+	return GLEW_ARB_texture_non_power_of_two ? image_size : next_power_of_2(image_size);
+}
+
 void
 texture::bind() const
 {
-	GL_CHECK(glBindTexture(GL_TEXTURE_2D, id_));
+	state::bind_texture(id_);
 }
 
 void
@@ -84,4 +124,46 @@ texture::initialize(const GLvoid *data)
 	GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texture_width_, texture_height_, 0, GL_RGBA, GL_UNSIGNED_BYTE, data));
 }
 
+void
+texture::initialize(const texture_file& file, const GLvoid *data)
+{
+	const auto& levels = file.get_levels();
+
+	image_width_ = file.get_image_width();
+	image_height_ = file.get_image_height();
+
+	texture_width_ = levels[0].width;
+	texture_height_ = levels[0].height;
+
+	bind();
+
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+	GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1));
+	GL_CHECK(glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE));
+
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+
+	for (size_t i = 0; i < levels.size(); i++) {
+		const auto& l = levels[i];
+		const GLvoid *level_data = static_cast<const char *>(data) + l.offset;
+
+		if (file.get_format() == texture_file::format::DXT5)
+			GL_CHECK(glCompressedTexImage2D(GL_TEXTURE_2D, i, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, l.width, l.height, 0, l.size, level_data));
+		else
+			GL_CHECK(glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level_data));
+	}
+}
+
+void
+texture::set_sub_image(int x, int y, int width, int height, const GLvoid *data) const
+{
+	bind();
+
+	GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+	GL_CHECK(glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data));
+}
+
 }
@@ -5,17 +5,48 @@
 
 #include <boost/noncopyable.hpp>
 
+#include "vec2.h"
+
+class png_reader;
+class texture_file;
+
 namespace gl {
 
 class texture : private boost::noncopyable
 {
 public:
 	texture();
+
+	// a width by height rectangle of another texture's pixels, at (x, y)
+	texture(const texture& storage, int x, int y, int width, int height);
+
 	~texture();
 
 	void allocate(int width, int height);
 	bool load(const std::string& path);
 
+	// decodes the rest of an opened PNG
+	bool load(png_reader& reader);
+
+	// sets the image size; the texture is padded to powers of 2 unless
+	// the GL can do without
+	void set_size(int image_width, int image_height);
+
+	// the texture size set_size() picks for an image size
+	static int get_texture_size(int image_size);
+
+	// uploads texture_width by texture_height RGBA pixels. if a pixel
+	// unpack buffer is bound, data is an offset into it.
+	void initialize(const GLvoid *data);
+
+	// uploads the mip chain of a cached texture. if a pixel unpack buffer
+	// is bound, data is an offset into it; otherwise it points at
+	// file.get_data_size() bytes of pixels.
+	void initialize(const texture_file& file, const GLvoid *data);
+
+	// copies width by height RGBA pixels to (x, y)
+	void set_sub_image(int x, int y, int width, int height, const GLvoid *data) const;
+
 	int get_image_width() const
 	{ return image_width_; }
 
@@ -30,13 +61,25 @@ public:
 
 	void bind() const;
 
-private:
-	void initialize(const GLvoid *data);
+	bool is_region() const
+	{ return storage_ != this; }
 
+	// the texture that's actually bound, the atlas if this is a region
+	const texture *get_storage() const
+	{ return storage_; }
+
+	// maps texcoords in this texture to texcoords in get_storage()
+	vec2f map_texcoord(const vec2f& uv) const
+	{ return { texcoord_offset_.x + uv.x*texcoord_scale_.x, texcoord_offset_.y + uv.y*texcoord_scale_.y }; }
+
+private:
 	int image_width_, image_height_;
 	int texture_width_, texture_height_;
 	GLuint id_;
 
+	const texture *storage_;
+	vec2f texcoord_offset_, texcoord_scale_;
+
 	friend class framebuffer;
 };
 
@@ -0,0 +1,72 @@
+#include <GL/glew.h>
+
+#include "gl_check.h"
+#include "gl_timer.h"
+
+namespace gl {
+
+timer::timer()
+	: next_ { 0 }
+	, last_ms_ { 0 }
+{
+	for (auto& p : pairs_) {
+		GL_CHECK(glGenQueries(2, p.queries));
+		p.pending = false;
+	}
+}
+
+timer::~timer()
+{
+	for (auto& p : pairs_)
+		GL_CHECK(glDeleteQueries(2, p.queries));
+}
+
+void
+timer::begin() const
+{
+	// if the GPU is that far behind, the pair's old time is dropped
+	query_pair& p = pairs_[next_];
+	p.pending = false;
+
+	GL_CHECK(glQueryCounter(p.queries[0], GL_TIMESTAMP));
+}
+
+void
+timer::end() const
+{
+	query_pair& p = pairs_[next_];
+
+	GL_CHECK(glQueryCounter(p.queries[1], GL_TIMESTAMP));
+	p.pending = true;
+
+	next_ = (next_ + 1) % NUM_PAIRS;
+}
+
+double
+timer::get_elapsed_ms() const
+{
+	// queries complete in order, so stop at the first one that's not
+	// done yet
+	for (int i = 0; i < NUM_PAIRS; i++) {
+		query_pair& p = pairs_[(next_ + i) % NUM_PAIRS];
+
+		if (!p.pending)
+			continue;
+
+		GLuint available;
+		GL_CHECK(glGetQueryObjectuiv(p.queries[1], GL_QUERY_RESULT_AVAILABLE, &available));
+		if (!available)
+			break;
+
+		GLuint64 start, end;
+		GL_CHECK(glGetQueryObjectui64v(p.queries[0], GL_QUERY_RESULT, &start));
+		GL_CHECK(glGetQueryObjectui64v(p.queries[1], GL_QUERY_RESULT, &end));
+
+		last_ms_ = 1e-6*(end - start);
+		p.pending = false;
+	}
+
+	return last_ms_;
+}
+
+}
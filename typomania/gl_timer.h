@@ -0,0 +1,40 @@
+#pragma once
+
+#include <GL/gl.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace gl {
+
+// GPU time between begin() and end(), from a pair of GL_TIMESTAMP queries
+// rather than GL_TIME_ELAPSED, so timers can nest or overlap. a few pairs
+// are kept in flight, so reading the time never waits for the GPU.
+
+class timer : private boost::noncopyable
+{
+public:
+	timer();
+	~timer();
+
+	void begin() const;
+	void end() const;
+
+	// the time of the latest begin()/end() the GPU has got through, which
+	// may be a frame or two old; 0 until there's one
+	double get_elapsed_ms() const;
+
+private:
+	enum { NUM_PAIRS = 3 };
+
+	struct query_pair
+	{
+		GLuint queries[2]; // start, end
+		bool pending; // ended and not read yet
+	};
+
+	mutable query_pair pairs_[NUM_PAIRS];
+	mutable int next_; // the pair begin() goes to; the oldest pending one
+	mutable double last_ms_;
+};
+
+} // gl
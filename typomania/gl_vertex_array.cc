@@ -0,0 +1,30 @@
+#include <GL/glew.h>
+
+#include "gl_check.h"
+#include "gl_vertex_array.h"
+
+namespace gl {
+
+vertex_array::vertex_array()
+{
+	GL_CHECK(glGenVertexArrays(1, &id_));
+}
+
+vertex_array::~vertex_array()
+{
+	GL_CHECK(glDeleteVertexArrays(1, &id_));
+}
+
+void
+vertex_array::bind() const
+{
+	GL_CHECK(glBindVertexArray(id_));
+}
+
+void
+vertex_array::unbind()
+{
+	GL_CHECK(glBindVertexArray(0));
+}
+
+}
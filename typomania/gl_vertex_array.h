@@ -0,0 +1,22 @@
+#pragma once
+
+#include <GL/gl.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace gl {
+
+class vertex_array : private boost::noncopyable
+{
+public:
+	vertex_array();
+	~vertex_array();
+
+	void bind() const;
+	static void unbind();
+
+private:
+	GLuint id_;
+};
+
+} // gl
@@ -1,50 +1,188 @@
-#include <cmath>
+#include <cstddef>
+#include <algorithm>
 
-#include <SDL.h>
+#include <GL/glew.h>
 
 #include "resources.h"
 #include "render.h"
+#include "gl_check.h"
+#include "gl_state.h"
+#include "gl_program.h"
+#include "gl_texture.h"
+#include "gl_buffer.h"
+#include "gl_vertex_array.h"
 #include "glyph_fx.h"
 
+namespace {
+
+// what glyphfx.vert gets for each effect
+struct instance
+{
+	GLfloat x, y;
+	GLfloat half_width, half_height;
+	GLfloat texcoords[8];
+	GLfloat spawn_tic;
+};
+
+}
+
 glyph_fx::glyph_fx(const font *f, wchar_t ch, const vec2f& p)
-	: texture_(f->get_texture())
+{
+	const font::glyph *gi = f->find_glyph(ch);
+	const gl::texture *t = f->get_texture();
+
+	center = { p.x + gi->left + .5f*gi->width, p.y + gi->top - .5f*gi->height };
+	half_size = { .5f*gi->width, .5f*gi->height };
+
+	texcoords[0] = gi->t0;
+	texcoords[1] = gi->t3;
+	texcoords[2] = gi->t1;
+	texcoords[3] = gi->t2;
+
+	if (t->is_region()) {
+		for (auto& uv : texcoords)
+			uv = t->map_texcoord(uv);
+	}
+
+	texture = t->get_storage();
+}
+
+glyph_fx_list::glyph_fx_list()
+	: tic_(0)
 	, program_(get_program("data/shaders/glyphfx.prog"))
-	, gi_(f->find_glyph(ch))
-	, x_(p.x + gi_->left + .5*gi_->width)
-	, y_(p.y + gi_->top - .5*gi_->height)
-	, tics_(0)
+	, proj_modelview_uniform_(program_->get_proj_modelview_uniform())
+	, tex_uniform_(program_->get_tex_uniform())
+	, offset_uniform_(program_->get_uniform("offset"))
+	, tic_uniform_(program_->get_uniform("tic"))
+	, vertex_array_(new gl::vertex_array)
+	, instance_buffer_(new gl::buffer(GL_ARRAY_BUFFER))
+	, instance_capacity_(0)
+{
+	vertex_array_->bind();
+
+	// every record is used by all the layers of its effect
+	for (int i = 0; i < 4; i++) {
+		GL_CHECK(glEnableVertexAttribArray(i));
+		GL_CHECK(glVertexAttribDivisor(i, NUM_LAYERS));
+	}
+
+	gl::vertex_array::unbind();
+}
+
+glyph_fx_list::~glyph_fx_list()
+{
+}
+
+void
+glyph_fx_list::add(const glyph_fx& fx)
+{
+	fxs_.push_back({ fx, tic_ });
+}
+
+void
+glyph_fx_list::update()
 {
+	++tic_;
+
+	// they all last as long, so the oldest ones are in front
+	while (!fxs_.empty() && tic_ - fxs_.front().spawn_tic >= TTL)
+		fxs_.pop_front();
 }
 
 void
-glyph_fx::draw() const
+glyph_fx_list::reserve_instances(int num_instances) const
 {
-	const vec2f& t0 = gi_->t0;
-	const vec2f& t1 = gi_->t1;
-	const vec2f& t2 = gi_->t2;
-	const vec2f& t3 = gi_->t3;
+	if (num_instances > instance_capacity_) {
+		instance_capacity_ = std::max<int>({ 2*instance_capacity_, num_instances, INSTANCE_CAPACITY });
+		instance_buffer_->set_data(instance_capacity_*sizeof(instance), nullptr, GL_STREAM_DRAW);
+	}
+}
 
-	const float t = static_cast<float>(tics_)/TTL;
-	const float s = sinf(t*M_PI);
+void
+glyph_fx_list::set_instance_pointers(int first_instance) const
+{
+	auto pointer = [first_instance](size_t offset)
+		{
+			return reinterpret_cast<GLvoid *>(first_instance*sizeof(instance) + offset);
+		};
 
-	static const int NUM_LAYERS = 8;
+	GL_CHECK(glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(instance), pointer(offsetof(instance, x))));
+	GL_CHECK(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(instance), pointer(offsetof(instance, texcoords))));
+	GL_CHECK(glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(instance), pointer(offsetof(instance, texcoords) + 4*sizeof(GLfloat))));
+	GL_CHECK(glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(instance), pointer(offsetof(instance, spawn_tic))));
+}
 
-	for (int i = 0; i < NUM_LAYERS; i++) {
-		const float q = 1. - static_cast<float>(i)/NUM_LAYERS;
-		const float c = q*q*(1. - t)*(1. - t);
+void
+glyph_fx_list::draw(const vec2f& offset) const
+{
+	if (fxs_.empty())
+		return;
 
-		const float f = 1 + .2*s*i;
+	// records are grouped by texture, and there's a texture per font, so
+	// only a few groups
 
-		render::set_color({ c, c, c, 1 });
+	groups_.clear();
 
-		const float xo = f*.5*gi_->width;
-		const float yo = f*.5*gi_->height;
+	for (auto& p : fxs_) {
+		auto it = std::find_if(
+				groups_.begin(), groups_.end(),
+				[&p](const fx_group& g) { return g.texture == p.fx.texture; });
 
-		render::draw_quad(
-			program_,
-			texture_,
-			{ { x_ - xo, y_ + yo }, { x_ - xo, y_ - yo }, { x_ + xo, y_ + yo }, { x_ + xo, y_ - yo } },
-			{ t0, t3, t1, t2 },
-			10);
+		if (it == groups_.end())
+			groups_.push_back({ p.fx.texture, 0 });
 	}
+
+	const int num_instances = fxs_.size();
+
+	vertex_array_->bind();
+	instance_buffer_->bind();
+
+	reserve_instances(num_instances);
+
+	auto *dest = static_cast<instance *>(instance_buffer_->map_range(
+				0, num_instances*sizeof(instance),
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+	for (auto& g : groups_) {
+		for (auto& p : fxs_) {
+			if (p.fx.texture != g.texture)
+				continue;
+
+			const glyph_fx& fx = p.fx;
+
+			*dest++ = {
+				fx.center.x, fx.center.y,
+				fx.half_size.x, fx.half_size.y,
+				{ fx.texcoords[0].x, fx.texcoords[0].y, fx.texcoords[1].x, fx.texcoords[1].y,
+				  fx.texcoords[2].x, fx.texcoords[2].y, fx.texcoords[3].x, fx.texcoords[3].y },
+				static_cast<GLfloat>(p.spawn_tic) };
+
+			++g.num_fxs;
+		}
+	}
+
+	instance_buffer_->unmap();
+
+	gl::state::enable_blend(GL_ONE, GL_ONE);
+
+	program_->use();
+	proj_modelview_uniform_.set_mat4(render::get_proj_matrix());
+	tex_uniform_.set_i(0);
+	offset_uniform_.set_f(offset.x, offset.y);
+	tic_uniform_.set_f(static_cast<GLfloat>(tic_));
+
+	int first_instance = 0;
+
+	for (auto& g : groups_) {
+		g.texture->bind();
+		set_instance_pointers(first_instance);
+
+		GL_CHECK(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, g.num_fxs*NUM_LAYERS));
+
+		render::count_draw_call(g.num_fxs*sizeof(instance));
+
+		first_instance += g.num_fxs;
+	}
+
+	gl::vertex_array::unbind();
 }
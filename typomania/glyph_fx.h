@@ -1,31 +1,83 @@
 #pragma once
 
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
 #include "vec2.h"
 #include "font.h"
+#include "gl_program.h"
 
 namespace gl {
-class program;
+class buffer;
+class vertex_array;
 }
 
-class glyph_fx {
-public:
+// a glyph flaring up once its kana has been typed. it's only the record
+// uploaded for the effect; glyphfx.vert expands it into the scaled layers
+// and fades it out.
+
+struct glyph_fx
+{
 	glyph_fx(const font *f, wchar_t ch, const vec2f& p);
 
-	void update()
-	{ ++tics_; }
+	const gl::texture *texture; // the atlas, if the font is in one
+	vec2f center;
+	vec2f half_size;
+	vec2f texcoords[4]; // in triangle strip order
+};
+
+// the effects still going, drawn with one instanced draw per font texture
+
+class glyph_fx_list : private boost::noncopyable
+{
+public:
+	glyph_fx_list();
+	~glyph_fx_list();
+
+	void add(const glyph_fx& fx);
 
-	bool is_active() const
-	{ return tics_ < TTL; }
+	// advances the clock by a tic and drops the effects that are over
+	void update();
 
-	void draw() const;
+	// draws right away, with additive blending, rather than through the
+	// render queue; offset is added to every effect's position
+	void draw(const vec2f& offset) const;
 
 private:
-	enum { TTL = 30 };
+	// TTL and NUM_LAYERS are repeated in glyphfx.vert
+	enum { TTL = 30, NUM_LAYERS = 8, INSTANCE_CAPACITY = 256 };
+
+	struct live_fx
+	{
+		glyph_fx fx;
+		unsigned spawn_tic;
+	};
+
+	struct fx_group
+	{
+		const gl::texture *texture;
+		int num_fxs;
+	};
+
+	void reserve_instances(int num_instances) const;
+	void set_instance_pointers(int first_instance) const;
+
+	unsigned tic_;
+	std::deque<live_fx> fxs_;
 
-	const gl::texture *texture_;
 	const gl::program *program_;
-	const font::glyph *gi_;
-	float x_, y_;
+	gl::program::uniform proj_modelview_uniform_;
+	gl::program::uniform tex_uniform_;
+	gl::program::uniform offset_uniform_;
+	gl::program::uniform tic_uniform_;
+
+	std::unique_ptr<gl::vertex_array> vertex_array_;
+	std::unique_ptr<gl::buffer> instance_buffer_;
+	mutable int instance_capacity_;
 
-	int tics_;
+	// used by draw
+	mutable std::vector<fx_group> groups_;
 };
@@ -0,0 +1,100 @@
+#include <cstdio>
+
+#include <GL/glew.h>
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "panic.h"
+#include "headless_context.h"
+
+#ifdef HAVE_EGL
+
+headless_context::headless_context()
+{
+	// prefer Mesa's surfaceless platform, it needs neither a display
+	// server nor a GPU
+
+	auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+	display_ = EGL_NO_DISPLAY;
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	if (get_platform_display)
+		display_ = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+#endif
+
+	if (display_ == EGL_NO_DISPLAY)
+		display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	if (!eglInitialize(display_, nullptr, nullptr))
+		panic("eglInitialize failed: %x", eglGetError());
+
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_ALPHA_SIZE, 8,
+		EGL_NONE };
+
+	EGLConfig config;
+	EGLint num_configs;
+
+	if (!eglChooseConfig(display_, config_attribs, &config, 1, &num_configs) || num_configs == 0)
+		panic("eglChooseConfig failed");
+
+	if (!eglBindAPI(EGL_OPENGL_API))
+		panic("eglBindAPI failed");
+
+	// whatever's drawn goes to an offscreen gl::framebuffer, the surface
+	// is only needed to make the context current
+
+	const EGLint surface_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+
+	if ((surface_ = eglCreatePbufferSurface(display_, config, surface_attribs)) == EGL_NO_SURFACE)
+		panic("eglCreatePbufferSurface failed");
+
+	if ((context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, nullptr)) == EGL_NO_CONTEXT)
+		panic("eglCreateContext failed");
+
+	if (!eglMakeCurrent(display_, surface_, surface_, context_))
+		panic("eglMakeCurrent failed");
+
+	GLenum rv = glewInit();
+
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+	// GLX entry points aren't needed with EGL
+	if (rv == GLEW_ERROR_NO_GLX_DISPLAY)
+		rv = GLEW_OK;
+#endif
+
+	if (rv != GLEW_OK)
+		panic("glewInit: %s", glewGetErrorString(rv));
+
+	fprintf(stderr, "headless: %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+}
+
+headless_context::~headless_context()
+{
+	eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext(display_, context_);
+	eglDestroySurface(display_, surface_);
+	eglTerminate(display_);
+}
+
+#else
+
+headless_context::headless_context()
+{
+	panic("headless mode needs EGL, which wasn't found at build time");
+}
+
+headless_context::~headless_context()
+{
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#endif
+
+#include <boost/noncopyable.hpp>
+
+// a GL context with no window, made current on the calling thread for as
+// long as it lives: an EGL pbuffer context on Mesa's surfaceless platform
+// when there is one. panics if it can't be created, or if EGL wasn't found
+// at build time.
+
+class headless_context : private boost::noncopyable
+{
+public:
+	headless_context();
+	~headless_context();
+
+private:
+#ifdef HAVE_EGL
+	EGLDisplay display_;
+	EGLSurface surface_;
+	EGLContext context_;
+#endif
+};
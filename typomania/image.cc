@@ -2,23 +2,149 @@
 #include <cerrno>
 #include <cstring>
 
+#include <algorithm>
+
 #include <png.h>
 
 #include "panic.h"
 #include "image.h"
 
+png_reader::png_reader()
+	: fp_(nullptr)
+	, png_ptr_(nullptr)
+	, info_ptr_(nullptr)
+	, width_(0)
+	, height_(0)
+{ }
+
+png_reader::~png_reader()
+{
+	close();
+}
+
+void
+png_reader::close()
+{
+	if (png_ptr_)
+		png_destroy_read_struct(&png_ptr_, &info_ptr_, 0);
+
+	if (fp_)
+		fclose(fp_);
+
+	png_ptr_ = nullptr;
+	info_ptr_ = nullptr;
+	fp_ = nullptr;
+}
+
+bool
+png_reader::open(const std::string& path)
+{
+	close();
+
+	if ((fp_ = fopen(path.c_str(), "rb")) == 0) {
+		fprintf(stderr, "failed to open %s: %s\n", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	if ((png_ptr_ = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0)) == 0
+	  || (info_ptr_ = png_create_info_struct(png_ptr_)) == 0) {
+		fprintf(stderr, "%s: out of memory\n", path.c_str());
+		close();
+		return false;
+	}
+
+	// libpng has already printed what went wrong
+	if (setjmp(png_jmpbuf(png_ptr_))) {
+		fprintf(stderr, "%s: bad PNG header\n", path.c_str());
+		close();
+		return false;
+	}
+
+	png_init_io(png_ptr_, fp_);
+
+	png_read_info(png_ptr_, info_ptr_);
+
+	int color_type = png_get_color_type(png_ptr_, info_ptr_);
+	int bit_depth = png_get_bit_depth(png_ptr_, info_ptr_);
+
+	if (color_type != PNG_COLOR_TYPE_RGBA || bit_depth != 8) {
+		fprintf(stderr, "%s: not 8-bit RGBA\n", path.c_str());
+		close();
+		return false;
+	}
+
+	if (png_get_interlace_type(png_ptr_, info_ptr_) != PNG_INTERLACE_NONE) {
+		fprintf(stderr, "%s: interlaced PNGs aren't supported\n", path.c_str());
+		close();
+		return false;
+	}
+
+	width_ = png_get_image_width(png_ptr_, info_ptr_);
+	height_ = png_get_image_height(png_ptr_, info_ptr_);
+
+	return true;
+}
+
+bool
+png_reader::read(unsigned *dest, int dest_width, int dest_height)
+{
+	if (setjmp(png_jmpbuf(png_ptr_))) {
+		fprintf(stderr, "bad PNG data\n");
+		close();
+		return false;
+	}
+
+	const int rows = std::min(height_, dest_height);
+
+	for (int i = 0; i < rows; i++) {
+		unsigned *row = dest + i*dest_width;
+
+		if (dest_width >= width_) {
+			png_read_row(png_ptr_, reinterpret_cast<png_bytep>(row), nullptr);
+			std::fill(row + width_, row + dest_width, 0);
+		} else {
+			// narrower than the image, decode the whole row elsewhere
+			std::vector<unsigned> temp(width_);
+			png_read_row(png_ptr_, reinterpret_cast<png_bytep>(&temp[0]), nullptr);
+			std::copy(temp.begin(), temp.begin() + dest_width, row);
+		}
+	}
+
+	std::fill(dest + rows*dest_width, dest + dest_height*dest_width, 0);
+
+	close();
+
+	return true;
+}
+
 bool
 image::load(const std::string& path)
+{
+	png_reader reader;
+
+	if (!reader.open(path))
+		return false;
+
+	width_ = reader.get_width();
+	height_ = reader.get_height();
+
+	bits_.resize(width_*height_);
+
+	return reader.read(&bits_[0], width_, height_);
+}
+
+bool
+image::save(const std::string& path) const
 {
 	FILE *fp;
 
-	if ((fp = fopen(path.c_str(), "rb")) == 0)
-		panic("failed to open `%s': %s", path.c_str(), strerror(errno));
+	if ((fp = fopen(path.c_str(), "wb")) == 0)
+		return false;
 
 	png_structp png_ptr;
 
-	if ((png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0)) == 0)
-		panic("png_create_read_struct failed");
+	if ((png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0)) == 0)
+		panic("png_create_write_struct failed");
 
 	png_infop info_ptr;
 
@@ -30,31 +156,34 @@ image::load(const std::string& path)
 
 	png_init_io(png_ptr, fp);
 
-	png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, 0);
-
-	int color_type = png_get_color_type(png_ptr, info_ptr);
-	int bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-
-	if (color_type != PNG_COLOR_TYPE_RGBA || bit_depth != 8)
-		panic("invalid color type or bit depth in PNG");
-
-	width_ = png_get_image_width(png_ptr, info_ptr);
-	height_ = png_get_image_height(png_ptr, info_ptr);
+	png_set_IHDR(png_ptr, info_ptr, width_, height_, 8,
+		PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
-	bits_.resize(width_*height_);
-
-	png_bytep *rows = png_get_rows(png_ptr, info_ptr);
+	png_write_info(png_ptr, info_ptr);
 
 	for (int i = 0; i < height_; i++)
-		memcpy(&bits_[i*width_], rows[i], width_*sizeof(unsigned));
+		png_write_row(png_ptr, reinterpret_cast<png_const_bytep>(&bits_[i*width_]));
 
-	png_destroy_read_struct(&png_ptr, &info_ptr, 0);
+	png_write_end(png_ptr, info_ptr);
+
+	png_destroy_write_struct(&png_ptr, &info_ptr);
 
 	fclose(fp);
 
 	return true;
 }
 
+void
+image::flip_vertically()
+{
+	for (int i = 0; i < height_/2; i++) {
+		unsigned *top = &bits_[i*width_];
+		unsigned *bottom = &bits_[(height_ - 1 - i)*width_];
+		std::swap_ranges(top, top + width_, bottom);
+	}
+}
+
 void
 image::resize(int new_width, int new_height)
 {
@@ -1,10 +1,46 @@
 #pragma once
 
+#include <cstdio>
 #include <vector>
 #include <string>
 
+#include <png.h>
+
 #include <boost/noncopyable.hpp>
 
+// reads an 8-bit RGBA PNG in two steps, so the destination can be sized
+// (and padded) once the dimensions are known. each step may run on a
+// different thread, but not at the same time.
+
+class png_reader : private boost::noncopyable
+{
+public:
+	png_reader();
+	~png_reader();
+
+	// opens the file and reads the header
+	bool open(const std::string& path);
+
+	int get_width() const
+	{ return width_; }
+
+	int get_height() const
+	{ return height_; }
+
+	// decodes the rows straight into dest, which is dest_width by
+	// dest_height pixels; anything outside the image is cleared. false
+	// if the data is corrupt.
+	bool read(unsigned *dest, int dest_width, int dest_height);
+
+private:
+	void close();
+
+	FILE *fp_;
+	png_structp png_ptr_;
+	png_infop info_ptr_;
+	int width_, height_;
+};
+
 class image : private boost::noncopyable
 {
 public:
@@ -17,6 +53,7 @@ public:
 	{ }
 
 	bool load(const std::string& path);
+	bool save(const std::string& path) const;
 
 	int get_width() const
 	{ return width_; }
@@ -27,6 +64,11 @@ public:
 	const unsigned *get_bits() const
 	{ return &bits_[0]; }
 
+	unsigned *get_bits()
+	{ return &bits_[0]; }
+
+	void flip_vertically();
+
 	void resize(int new_width, int new_height);
 
 private:
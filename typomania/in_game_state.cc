@@ -9,10 +9,13 @@
 #include "resources.h"
 #include "render.h"
 #include "gl_check.h"
+#include "gl_state.h"
 #include "gl_framebuffer.h"
+#include "gl_timer.h"
 #include "pattern.h"
 #include "kana.h"
 #include "glyph_fx.h"
+#include "game_clock.h"
 #include "in_game_state.h"
 
 #ifdef WIN32
@@ -21,6 +24,12 @@
 
 static const char *STREAM_DIR = "data/streams";
 
+static const float SERIFU_BASE_X = 20;
+static const float SERIFU_BASE_Y = 70;
+
+// how bright the time bars' halo is where all its quads overlap
+static const float TIME_BAR_HALO_INTENSITY = .2;
+
 enum {
 	MISS_SCORE = 601,
 	HIT_SCORE = 311,
@@ -28,8 +37,11 @@ enum {
 	FADE_IN_TICS = 60,
 	FADE_OUT_TICS = 60,
 	RESULTS_START_TIC = 120,
+	RESULTS_END_TIC = RESULTS_START_TIC + 180, // the last line has faded in
 
 	COMBO_BUMP_TICS = 20,
+
+	TIME_BAR_HALO_QUADS = 6,
 };
 
 class kana_buffer
@@ -37,7 +49,9 @@ class kana_buffer
 public:
 	kana_buffer(in_game_state *parent)
 	: parent_(parent)
-	, cur_pattern(nullptr)
+	, serifu_(nullptr)
+	, next_cluster_(0)
+	, cur_pattern(pattern_table::END)
 	, num_consumed(0)
 	{ }
 
@@ -52,9 +66,11 @@ public:
 	{ return prev_num_consumed; }
 
 	serifu::romaji_iterator get_romaji_iterator() const
-	{ return serifu::romaji_iterator(kana_iter_, cur_pattern); }
+	{ return serifu::romaji_iterator(serifu_, next_cluster_, cur_pattern); }
 
-	using fx_cont = std::vector<std::unique_ptr<glyph_fx>>;
+	// romaji left to type in the line
+	int get_num_strokes() const
+	{ return kana::get_patterns().get_num_strokes(cur_pattern) + serifu_->get_num_strokes(next_cluster_); }
 
 	const fx_cont& get_prev_fx() const
 	{ return prev_fx; }
@@ -64,8 +80,10 @@ private:
 	void clear_prev_fx();
 
 	in_game_state *parent_;
-	const pattern_node *cur_pattern;
-	serifu::kana_iterator kana_iter_, kana_end_;
+	const serifu *serifu_;
+	size_t next_cluster_;
+	pattern_table::state cur_pattern;
+	serifu::kana_iterator kana_iter_;
 
 	int num_consumed, prev_num_consumed;
 
@@ -77,10 +95,11 @@ kana_buffer::set_serifu(const serifu *s)
 {
 	clear_prev_fx();
 
-	cur_pattern = nullptr;
+	serifu_ = s;
+	next_cluster_ = 0;
+	cur_pattern = pattern_table::END;
 
 	kana_iter_ = s->kana_begin();
-	kana_end_ = s->kana_end();
 
 	prev_num_consumed = 0;
 	num_consumed = consume_kana();
@@ -89,23 +108,25 @@ kana_buffer::set_serifu(const serifu *s)
 int
 kana_buffer::consume_kana()
 {
-	for (auto& p : prev_fx)
-		parent_->add_glyph_fx(std::move(p));
+	for (auto& fx : prev_fx)
+		parent_->add_glyph_fx(fx);
 	prev_fx.clear();
 
-	if (kana_iter_ != kana_end_) {
-		int consumed;
+	if (next_cluster_ < serifu_->get_num_clusters()) {
+		const kana_cluster& cluster = serifu_->get_cluster(next_cluster_++);
 
-		std::tie(cur_pattern, consumed) = kana::find_pattern(kana_iter_);
+		cur_pattern = cluster.pattern;
 
-		for (int i = 0; i < consumed; i++) {
+		for (int i = 0; i < cluster.num_kana; i++) {
 			kana_iter_.get_glyph_fx(prev_fx);
 			++kana_iter_;
 		}
 
-		return consumed;
+		return cluster.num_kana;
 	}
 
+	cur_pattern = pattern_table::END;
+
 	return 0;
 }
 
@@ -117,21 +138,12 @@ kana_buffer::on_key_down(int keysym)
 	if (keysym >= 'a' && keysym <= 'z')
 		keysym += 'A' - 'a';
 
-	if (!cur_pattern->match(keysym)) {
-		if (!cur_pattern->is_optional) {
-			return false;
-		} else {
-			// failed to match but was optional, so try next one
+	const pattern_table::state next = kana::get_patterns().next(cur_pattern, keysym);
 
-			if (cur_pattern->next && cur_pattern->next->match(keysym)) {
-				cur_pattern = cur_pattern->next;
-			} else {
-				return false;
-			}
-		}
-	}
+	if (next == pattern_table::REJECT)
+		return false;
 
-	if (!(cur_pattern = cur_pattern->next)) {
+	if (!(cur_pattern = next)) {
 		prev_num_consumed = num_consumed;
 		num_consumed += consume_kana();
 	}
@@ -163,19 +175,24 @@ in_game_state::in_game_state(game *parent, const kashi& cur_kashi)
 , miss(0)
 , total_strokes(0)
 , hit_tics_(0)
-, tiny_font(get_font("data/fonts/tiny_font.fnt"))
-, small_font(get_font("data/fonts/small_font.fnt"))
-, medium_font(get_font("data/fonts/medium_font.fnt"))
-, big_az_font(get_font("data/fonts/big_az_font.fnt"))
+, tiny_font(get_font("data/fonts/tiny_font.fntb"))
+, small_font(get_font("data/fonts/small_font.fntb"))
+, medium_font(get_font("data/fonts/medium_font.fntb"))
+, big_az_font(get_font("data/fonts/big_az_font.fntb"))
 , bg_overlay_texture_(get_texture("data/images/bg-overlay.png"))
 , input_buffer_( new kana_buffer(this))
-, blur_program_(get_program("data/shaders/blur.prog"))
+, glyph_fxs_(new glyph_fx_list)
+, glow_down_program_(get_program("data/shaders/glow_down.prog"))
+, glow_up_program_(get_program("data/shaders/glow_up.prog"))
+, glow_valid_(false)
+, glow_drawn_(false)
+, glow_timer_(new gl::timer)
 {
 	const int w = parent_->get_window_width();
 	const int h = parent_->get_window_height();
 
-	glow_framebuffers_[0].reset(new gl::framebuffer(w/2, h/2));
-	glow_framebuffers_[1].reset(new gl::framebuffer(w/2, h/2));
+	for (int i = 0; i < NUM_GLOW_LEVELS; i++)
+		glow_framebuffers_[i].reset(new gl::framebuffer(w >> (i + 1), h >> (i + 1)));
 
 	std::ostringstream path;
 	path << STREAM_DIR << '/' << cur_kashi.stream;
@@ -186,13 +203,31 @@ in_game_state::in_game_state(game *parent, const kashi& cur_kashi)
 	song_duration = static_cast<int>(player.get_track_duration()*1000);
 
 	player.set_gain(1.);
+#else
+	song_duration = 0;
+
+	for (auto& s : cur_kashi)
+		song_duration += s.duration();
 #endif
 
-	set_cur_serifu(cur_serifu->get(), cur_serifu + 1 == cur_kashi.end());
+	set_cur_serifu(&*cur_serifu, cur_serifu + 1 == cur_kashi.end());
+
+	if (replay *r = parent_->get_recording()) {
+		r->clear();
+		r->kashi_path = cur_kashi.path;
+		r->song_duration = song_duration;
+	}
 }
 
 in_game_state::~in_game_state()
-{ }
+{
+#ifndef MUTE
+	if (cur_state != INTRO) {
+		player.stop();
+		parent_->add_audio_stats(player.get_num_underruns(), player.get_min_ring_fill());
+	}
+#endif
+}
 
 void
 in_game_state::redraw() const
@@ -206,11 +241,11 @@ in_game_state::redraw() const
 
 	draw_background(alpha);
 
-	bind_glow_layer();
-	draw_hud(true);
 	draw_glow_layer();
 
 	draw_hud(false);
+
+	draw_glyph_fxs();
 }
 
 void
@@ -275,9 +310,13 @@ in_game_state::update()
 
 	if (cur_state == INTRO) {
 		if (state_tics == FADE_IN_TICS) {
+#ifndef MUTE
 			player.start();
-			spectrum.update(0);
-			start_ms = start_serifu_ms = SDL_GetTicks();
+			spectrum.update();
+#else
+			start_ms = game_clock::get_ms();
+#endif
+			start_serifu_ms = 0;
 			set_state(PLAYING);
 		}
 
@@ -286,28 +325,34 @@ in_game_state::update()
 
 	if (cur_state == OUTRO && state_tics == FADE_OUT_TICS) {
 		if (cur_serifu != cur_kashi.end()) {
-			int n = std::distance(input_buffer_->get_romaji_iterator(), (*cur_serifu)->romaji_end());
+			int n = input_buffer_->get_num_strokes();
 
-			for (++cur_serifu; cur_serifu != cur_kashi.end(); ++cur_serifu) {
-				n += std::distance((*cur_serifu)->romaji_begin(), (*cur_serifu)->romaji_end());
-			}
+			for (++cur_serifu; cur_serifu != cur_kashi.end(); ++cur_serifu)
+				n += cur_serifu->get_num_strokes();
 
 			miss += n;
 			total_strokes += n;
 			score -= MISS_SCORE*n;
 		}
+
+		if (replay *r = parent_->get_recording()) {
+			r->final_results = get_results();
+			r->has_results = true;
+		}
 	}
 
-	unsigned now = SDL_GetTicks();
+#ifndef MUTE
+	player.update();
+#endif
 
-	total_ms = now - start_ms;
+	total_ms = get_song_ms();
 
 	if (cur_serifu != cur_kashi.end()) {
-		serifu_ms = now - start_serifu_ms;
+		serifu_ms = total_ms - start_serifu_ms;
 
 		if (cur_state == PLAYING) {
 			if (serifu_ms >= cur_serifu_duration) {
-				int n = std::distance(input_buffer_->get_romaji_iterator(), (*cur_serifu)->romaji_end());
+				int n = input_buffer_->get_num_strokes();
 
 				if (n > 0) {
 					miss += n;
@@ -322,7 +367,7 @@ in_game_state::update()
 				if (++cur_serifu == cur_kashi.end()) {
 					set_state(OUTRO);
 				} else {
-					set_cur_serifu(cur_serifu->get(), cur_serifu + 1 == cur_kashi.end());
+					set_cur_serifu(&*cur_serifu, cur_serifu + 1 == cur_kashi.end());
 				}
 			}
 		}
@@ -333,13 +378,28 @@ in_game_state::update()
 		display_score = score;
 
 #ifndef MUTE
-	player.update();
-	spectrum.update(total_ms);
+	spectrum.update();
 #endif
 
 	update_glyph_fxs();
 }
 
+unsigned
+in_game_state::get_song_ms() const
+{
+#ifndef MUTE
+	return player.get_ms_played();
+#else
+	return game_clock::get_ms() - start_ms;
+#endif
+}
+
+bool
+in_game_state::is_finished() const
+{
+	return cur_state == OUTRO && state_tics >= FADE_OUT_TICS;
+}
+
 void
 in_game_state::on_key_up(int keysym)
 { }
@@ -348,6 +408,9 @@ void
 in_game_state::on_key_down(int keysym)
 {
 	if (cur_state == PLAYING) {
+		if (replay *r = parent_->get_recording())
+			r->events.push_back({ get_song_ms(), keysym });
+
 		if (keysym == SDLK_ESCAPE) {
 			set_state(OUTRO);
 #ifndef MUTE
@@ -439,6 +502,21 @@ in_game_state::draw_time_bar(float y, const wchar_t *label, int partial, int tot
 
 		render::set_color({ 1, 1, 1, .25f*alpha });
 		render::draw_quad({ { xm, y0 }, { xm, y1 }, { x1, y0 }, { x1, y1 } }, 0);
+
+		// the bars move every tic, so rather than having the glow layer
+		// drawn again for them they get a halo of their own: a few
+		// growing quads, fading out like the blur would
+		render::set_blend_mode(blend_mode::ADDITIVE_BLEND);
+
+		for (int i = 1; i <= TIME_BAR_HALO_QUADS; i++) {
+			const float d = 2*i;
+			const float a = TIME_BAR_HALO_INTENSITY*alpha/TIME_BAR_HALO_QUADS;
+
+			render::set_color({ a, .61f*a, 0, a });
+			render::draw_quad({ { x0 - d, y0 - d }, { x0 - d, y1 + d }, { xm + d, y0 - d }, { xm + d, y1 + d } }, -20);
+		}
+
+		render::set_blend_mode(blend_mode::ALPHA_BLEND);
 	}
 }
 
@@ -449,9 +527,7 @@ in_game_state::draw_time_bars(float alpha, bool glow_layer) const
 		return;
 
 	draw_time_bar(170, L"INTERVAL", serifu_ms, cur_serifu_duration, alpha, glow_layer);
-#ifndef MUTE
 	draw_time_bar(190, L"TOTAL TIME", total_ms, song_duration, alpha, glow_layer);
-#endif
 }
 
 void
@@ -494,40 +570,30 @@ in_game_state::draw_serifu(float alpha) const
 	int highlighted;
 
 	if (!input_buffer_->finished()) {
-		serifu = cur_serifu->get();
+		serifu = &*cur_serifu;
 		highlighted = input_buffer_->get_num_consumed();
 	} else {
 		kashi::const_iterator next_serifu = cur_serifu + 1;
 
 		if (next_serifu != cur_kashi.end()) {
-			serifu = next_serifu->get();
+			serifu = &*next_serifu;
 			alpha *= .5;
 			highlighted = 0;
 		}
 	}
 
-	const float base_x = 20;
-	const float base_y = 70;
-
 	if (serifu) {
 		const rgba color[2] = { rgba(0, 1, 1, alpha), rgba(1, 1, 1, alpha) };
 
 		render::set_blend_mode(blend_mode::ALPHA_BLEND);
 
 		render::push_matrix();
-		render::translate(base_x, base_y);
+		render::translate(SERIFU_BASE_X, SERIFU_BASE_Y);
 
 		serifu->draw(highlighted, color);
 
 		render::pop_matrix();
 	}
-
-	render::push_matrix();
-	render::translate(base_x, base_y);
-
-	draw_glyph_fxs();
-
-	render::pop_matrix();
 }
 
 void
@@ -649,11 +715,11 @@ in_game_state::get_class() const
 void
 in_game_state::draw_background(float alpha) const
 {
-	if (cur_kashi.background) {
+	if (const gl::texture *background = cur_kashi.get_background()) {
 		render::set_color({ 1, 1, 1, alpha });
 
 		render::set_blend_mode(blend_mode::NO_BLEND);
-		render::draw_quad(cur_kashi.background, { 0, 0 }, -30);
+		render::draw_quad(background, { 0, 0 }, -30);
 
 		render::set_blend_mode(blend_mode::ALPHA_BLEND);
 		render::draw_quad(bg_overlay_texture_, { 0, 0 }, -25);
@@ -668,13 +734,8 @@ in_game_state::bind_glow_layer() const
 
 	render::end_batch();
 
-	auto fb_texture = glow_framebuffers_[0]->get_texture();
-
-	const int fb_width = fb_texture->get_texture_width();
-	const int fb_height = fb_texture->get_texture_height();
-
-	glow_framebuffers_[0]->bind();
-
+	// queued now, drawn into glow_framebuffers_[0] by draw_glow_layer() if
+	// it's any different from last time
 	render::set_viewport(0, width, height, 0);
 	render::begin_batch();
 
@@ -683,52 +744,108 @@ in_game_state::bind_glow_layer() const
 	render::draw_quad({ { 0, 0 }, { 0, height }, { width, 0 }, { width, height } }, -1);
 }
 
+bool
+in_game_state::glow_key::operator==(const glow_key& other) const
+{
+	return state == other.state && tic == other.tic &&
+	  combo == other.combo && hit_tics == other.hit_tics && display_score == other.display_score &&
+	  score == other.score && max_combo == other.max_combo && miss == other.miss && total_strokes == other.total_strokes;
+}
+
+in_game_state::glow_key
+in_game_state::get_glow_key() const
+{
+	// fading in and out, and the results coming in line by line
+	int tic = 0;
+
+	if (cur_state == INTRO)
+		tic = state_tics;
+	else if (cur_state == OUTRO)
+		tic = std::min<int>(state_tics, RESULTS_END_TIC);
+
+	// the combo only shows from 2 up
+	const bool show_combo = combo > 1;
+
+	// and the rest of the counters only in the results
+	const bool show_results = cur_state == OUTRO;
+
+	return {
+		cur_state, tic,
+		show_combo ? combo : 0, show_combo ? hit_tics_ : 0, display_score,
+		show_results ? score : 0, show_results ? max_combo : 0, show_results ? miss : 0, show_results ? total_strokes : 0 };
+}
+
 void
 in_game_state::draw_glow_layer() const
 {
 	const int width = parent_->get_window_width();
 	const int height = parent_->get_window_height();
 
-	render::end_batch();
+	const glow_key key = get_glow_key();
 
-	// blur horizontally from fb0 to fb1
+	// otherwise the blurred layer left in fb0 is still good, and the
+	// background stays queued with the rest of the screen
+	glow_drawn_ = !glow_valid_ || !(key == glow_key_);
 
-	auto fb_texture = glow_framebuffers_[0]->get_texture();
-	const int fb_width = fb_texture->get_texture_width();
-	const int fb_height = fb_texture->get_texture_height();
+	if (glow_drawn_) {
+		glow_key_ = key;
+		glow_valid_ = true;
 
-	glow_framebuffers_[1]->bind();
+		bind_glow_layer();
+		draw_hud(true);
 
-	render::begin_batch();
-	render::set_color({ 0, 1.f/fb_height, 0, 0 });
-	render::draw_quad(blur_program_, glow_framebuffers_[0]->get_texture(), { { 0, 0 }, { 0, height }, { width, 0 }, { width, height } }, 0);
-	render::end_batch();
+		glow_timer_->begin();
 
-	// blur vertically from fb1 to fb0
+		glow_framebuffers_[0]->bind();
+		render::end_batch();
 
-	glow_framebuffers_[0]->bind();
+		for (int i = 1; i < NUM_GLOW_LEVELS; i++)
+			blur_glow_level(glow_down_program_, i - 1, i);
 
-	render::begin_batch();
-	render::set_color({ 1.f/fb_width, 0, 0, 0 });
-	render::draw_quad(blur_program_, glow_framebuffers_[1]->get_texture(), { { 0, 0 }, { 0, height }, { width, 0 }, { width, height } }, 0);
-	render::end_batch();
+		for (int i = NUM_GLOW_LEVELS - 1; i > 0; i--)
+			blur_glow_level(glow_up_program_, i, i - 1);
 
-	// fb0 to screen
+		glow_timer_->end();
 
-	// HACK!
-	glow_framebuffers_[0]->unbind();
-	GL_CHECK(glViewport(0, 0, width, height));
+		// HACK!
+		glow_framebuffers_[0]->unbind();
+		gl::state::set_viewport(0, 0, width, height);
 
-	render::set_viewport(0, width, 0, height);
+		render::set_viewport(0, width, 0, height);
 
-	// render the result
+		render::begin_batch();
+	}
+
+	// fb0 to screen
 
-	render::begin_batch();
 	render::set_blend_mode(blend_mode::ADDITIVE_BLEND);
 	render::set_color({ 1, .61f, 0, 1 });
 	render::draw_quad(glow_framebuffers_[0]->get_texture(), { { 0, 0 }, { 0, height }, { width, 0 }, { width, height } }, -20);
 }
 
+void
+in_game_state::blur_glow_level(const gl::program *program, int from, int to) const
+{
+	const int width = parent_->get_window_width();
+	const int height = parent_->get_window_height();
+
+	auto to_texture = glow_framebuffers_[to]->get_texture();
+
+	glow_framebuffers_[to]->bind();
+
+	// the shaders take half a destination texel in the color
+	render::begin_batch();
+	render::set_color({ .5f/to_texture->get_texture_width(), .5f/to_texture->get_texture_height(), 0, 0 });
+	render::draw_quad(program, glow_framebuffers_[from]->get_texture(), { { 0, 0 }, { 0, height }, { width, 0 }, { width, height } }, 0);
+	render::end_batch();
+}
+
+double
+in_game_state::get_glow_gpu_ms() const
+{
+	return glow_drawn_ ? glow_timer_->get_elapsed_ms() : 0;
+}
+
 void
 in_game_state::draw_song_info() const
 {
@@ -782,7 +899,7 @@ in_game_state::draw_results(int tic, bool glow_layer) const
 
 	base_y -= 30;
 
-	render::set_color({ 1, 1, 1, LINE_FADE_IN_TIC ? static_cast<float>(tic)/LINE_FADE_IN_TIC : 1 });
+	render::set_color({ 1, 1, 1, std::min(static_cast<float>(tic)/LINE_FADE_IN_TIC, 1.f) });
 
 	DRAW_LABEL(small_font, L"CLASS")
 	draw_string(big_az_font, base_x + 2*digit_width, base_y, get_class());
@@ -799,42 +916,43 @@ in_game_state::set_state(state next_state)
 void
 in_game_state::set_cur_serifu(const serifu *s, bool is_last)
 {
-	input_buffer_->set_serifu(cur_serifu->get());
+	input_buffer_->set_serifu(&*cur_serifu);
 
-	cur_serifu_duration = (*cur_serifu)->duration();
-#ifndef MUTE
-	if (is_last || cur_serifu_duration > song_duration - total_ms)
-		cur_serifu_duration = song_duration - total_ms;
-#endif
+	cur_serifu_duration = cur_serifu->duration();
+
+	// nothing runs past the end of the song
+	const unsigned left_ms = song_duration > total_ms ? song_duration - total_ms : 0;
+
+	if (is_last || cur_serifu_duration > left_ms)
+		cur_serifu_duration = left_ms;
 }
 
 void
-in_game_state::draw_glyph_fxs() const
+in_game_state::set_song_duration(unsigned ms)
 {
-	render::set_blend_mode(blend_mode::ADDITIVE_BLEND);
+	assert(cur_state == INTRO);
 
-	for (auto& p : glyph_fxs_)
-		p->draw();
+	song_duration = ms;
+	set_cur_serifu(&*cur_serifu, cur_serifu + 1 == cur_kashi.end());
 }
 
 void
-in_game_state::update_glyph_fxs()
+in_game_state::draw_glyph_fxs() const
 {
-	for (auto& p : glyph_fxs_)
-		p->update();
-
-	while (!glyph_fxs_.empty()) {
-		auto& p = glyph_fxs_.front();
-
-		if (p->is_active())
-			break;
+	// drawn over everything else, so flush what's been queued so far
+	render::end_batch();
+	glyph_fxs_->draw({ SERIFU_BASE_X, SERIFU_BASE_Y });
+	render::begin_batch();
+}
 
-		glyph_fxs_.pop_front();
-	}
+void
+in_game_state::update_glyph_fxs()
+{
+	glyph_fxs_->update();
 }
 
 void
-in_game_state::add_glyph_fx(std::unique_ptr<glyph_fx> p)
+in_game_state::add_glyph_fx(const glyph_fx& fx)
 {
-	glyph_fxs_.push_back(std::move(p));
+	glyph_fxs_->add(fx);
 }
@@ -1,17 +1,20 @@
 #pragma once
 
-#include <list>
+#include <array>
 
 #include "ogg_player.h"
 #include "spectrum_bars.h"
+#include "replay.h"
 #include "game.h"
 
 namespace gl {
 class texture;
 class framebuffer;
+class timer;
 }
 
 class kana_buffer;
+class glyph_fx_list;
 
 class in_game_state : public game_state
 {
@@ -24,13 +27,51 @@ public:
 	void on_key_up(int keysym) override;
 	void on_key_down(int keysym) override;
 
-	void add_glyph_fx(std::unique_ptr<glyph_fx> p);
+	void add_glyph_fx(const glyph_fx& fx);
+
+	// song time in ms, only meaningful while playing
+	unsigned get_song_ms() const;
+
+	// for replays, which are played without music but must end the song
+	// where it ended when they were recorded. only before it starts.
+	void set_song_duration(unsigned ms);
+
+	bool is_playing() const
+	{ return cur_state == PLAYING; }
+
+	// true once the song is over and every stroke has been counted
+	bool is_finished() const;
+
+	replay::results get_results() const
+	{ return { score, max_combo, miss }; }
+
+	// GPU time spent on the glow layer the last time the GPU got through
+	// drawing it, 0 if it didn't change and wasn't drawn again
+	double get_glow_gpu_ms() const;
+
+	// whether the last redraw drew the glow layer again
+	bool is_glow_drawn() const
+	{ return glow_drawn_; }
 
 private:
 	void set_cur_serifu(const serifu *s, bool is_last);
 
+	// what the glow layer is drawn from; it's only drawn again when this
+	// changes
+	struct glow_key
+	{
+		int state, tic;
+		int combo, hit_tics, display_score;
+		int score, max_combo, miss, total_strokes;
+
+		bool operator==(const glow_key& other) const;
+	};
+
+	glow_key get_glow_key() const;
+
 	void bind_glow_layer() const;
 	void draw_glow_layer() const;
+	void blur_glow_level(const gl::program *program, int from, int to) const;
 	void draw_background(float alpha) const;
 	void draw_song_info() const;
 
@@ -70,7 +111,8 @@ private:
 
 	kashi::const_iterator cur_serifu;
 
-	unsigned start_ms, start_serifu_ms;
+	unsigned start_ms; // only used when MUTE, otherwise the player's clock is used
+	unsigned start_serifu_ms; // song time at which the current serifu started
 	unsigned total_ms, serifu_ms;
 
 	unsigned song_duration, cur_serifu_duration; // in ms
@@ -89,10 +131,20 @@ private:
 	const font *big_az_font;
 
 	std::unique_ptr<kana_buffer> input_buffer_;
-	std::list<std::unique_ptr<glyph_fx>> glyph_fxs_;
+	std::unique_ptr<glyph_fx_list> glyph_fxs_;
 
 	const gl::texture *bg_overlay_texture_;
 
-	const gl::program *blur_program_;
-	std::array<std::unique_ptr<gl::framebuffer>, 2> glow_framebuffers_;
+	// the glow layer is drawn at half resolution, then blurred by going
+	// down to an eighth and back up
+	enum { NUM_GLOW_LEVELS = 3 };
+
+	const gl::program *glow_down_program_;
+	const gl::program *glow_up_program_;
+	std::array<std::unique_ptr<gl::framebuffer>, NUM_GLOW_LEVELS> glow_framebuffers_;
+
+	mutable glow_key glow_key_; // what's in the glow layer now
+	mutable bool glow_valid_;
+	mutable bool glow_drawn_;
+	std::unique_ptr<gl::timer> glow_timer_;
 };
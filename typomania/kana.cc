@@ -1,166 +1,414 @@
-#include <map>
-#include <memory>
-
 #include "pattern.h"
 #include "kana.h"
 
+const pattern_table::state pattern_table::END;
+const pattern_table::state pattern_table::REJECT;
+
+// everything here is built by the compiler: the romaji patterns are parsed
+// into the transition table, and the kana are looked up in tables indexed
+// by their offset in the hiragana/katakana block. nothing is done at
+// startup.
+
 namespace kana {
 
 namespace {
 
-using pattern_ptr = std::shared_ptr<pattern_node>;
+using state = pattern_table::state;
+
+struct kana_romaji
+{
+	const wchar_t *kana; // a single kana, a pair or a triple
+	const char *romaji;
+};
+
+// sorted by the number of kana. katakana are found through the hiragana
+// with the same romaji.
+constexpr kana_romaji KANA_ROMAJI[]
+	{ { L"あ", "A"  }, { L"い", "I"  }, { L"う", "U"  }, { L"え", "E"  }, { L"お", "O"  },
+	  { L"か", "KA" }, { L"き", "KI" }, { L"く", "KU" }, { L"け", "KE" }, { L"こ", "KO" },
+	  { L"さ", "SA" }, { L"し", "SH?I" }, { L"す", "SU" }, { L"せ", "SE" }, { L"そ", "SO" },
+	  { L"た", "TA" }, { L"ち", "[TC]H?I" }, { L"つ", "TS?U" }, { L"て", "TE" }, { L"と", "TO" },
+	  { L"な", "NA" }, { L"に", "NI" }, { L"ぬ", "NU" }, { L"ね", "NE" }, { L"の", "NO" },
+	  { L"は", "HA" }, { L"ひ", "HI" }, { L"ふ", "[HF]U" }, { L"へ", "HE" }, { L"ほ", "HO" },
+	  { L"ま", "MA" }, { L"み", "MI" }, { L"む", "MU" }, { L"め", "ME" }, { L"も", "MO" },
+	  { L"や", "YA" }, { L"ゆ", "YU" }, { L"よ", "YO" },
+	  { L"ら", "RA" }, { L"り", "RI" }, { L"る", "RU" }, { L"れ", "RE" }, { L"ろ", "RO" },
+	  { L"わ", "WA" }, { L"を", "WO" },
+	  { L"ん", "N"  }, { L"ー", "-" },
+	  { L"が", "GA" }, { L"ぎ", "GI" }, { L"ぐ", "GU" }, { L"げ", "GE" }, { L"ご", "GO" },
+	  { L"ざ", "ZA" }, { L"じ", "[ZJ]I" }, { L"ず", "ZU" }, { L"ぜ", "ZE" }, { L"ぞ", "ZO" },
+	  { L"だ", "DA" }, { L"ぢ", "DI" }, { L"づ", "[DZ]U" }, { L"で", "DE" }, { L"ど", "DO" },
+	  { L"ば", "BA" }, { L"び", "BI" }, { L"ぶ", "BU" }, { L"べ", "BE" }, { L"ぼ", "BO" },
+	  { L"ぱ", "PA" }, { L"ぴ", "PI" }, { L"ぷ", "PU" }, { L"ぺ", "PE" }, { L"ぽ", "PO" },
+	  { L"ぁ", "[LX]A"  }, { L"ぃ", "[LX]I"  }, { L"ぅ", "[LX]U"  }, { L"ぇ", "[LX]E"  }, { L"ぉ", "[LX]O"  },
+	  { L"っ", "[LX]TS?U" },
+
+	  // letters and digits, also typed as themselves in lower case and full
+	  // width
+	  { L"A", "A" }, { L"B", "B" }, { L"C", "C" }, { L"D", "D" }, { L"E", "E" }, { L"F", "F" },
+	  { L"G", "G" }, { L"H", "H" }, { L"I", "I" }, { L"J", "J" }, { L"K", "K" }, { L"L", "L" },
+	  { L"M", "M" }, { L"N", "N" }, { L"O", "O" }, { L"P", "P" }, { L"Q", "Q" }, { L"R", "R" },
+	  { L"S", "S" }, { L"T", "T" }, { L"U", "U" }, { L"V", "V" }, { L"W", "W" }, { L"X", "X" },
+	  { L"Y", "Y" }, { L"Z", "Z" },
+	  { L"0", "0" }, { L"1", "1" }, { L"2", "2" }, { L"3", "3" }, { L"4", "4" },
+	  { L"5", "5" }, { L"6", "6" }, { L"7", "7" }, { L"8", "8" }, { L"9", "9" },
+
+	  { L"きゃ", "KYA" }, { L"きゅ", "KYU" }, { L"きょ", "KYO" },
+	  { L"しゃ", "S[YH]A" }, { L"しゅ", "S[YH]U" }, { L"しょ", "S[YH]O" },
+	  { L"ちゃ", "[TC][YH]A" }, { L"ちゅ", "[TC][YH]U" }, { L"ちょ", "[TC][YH]O" },
+	  { L"にゃ", "NYA" }, { L"にゅ", "NYU" }, { L"にょ", "NYO" },
+	  { L"ひゃ", "HYA" }, { L"ひゅ", "HYU" }, { L"ひょ", "HYO" },
+	  { L"みゃ", "MYA" }, { L"みゅ", "MYU" }, { L"みょ", "MYO" },
+	  { L"りゃ", "RYA" }, { L"りゅ", "RYU" }, { L"りょ", "RYO" },
+	  { L"ぎゃ", "GYA" }, { L"ぎゅ", "GYU" }, { L"ぎょ", "GYO" },
+	  { L"じゃ", "[JZ]Y?A"  }, { L"じゅ", "[JZ]Y?U"  }, { L"じょ", "[JZ]Y?O"  }, // XXX:should display ZYA/ZYU/ZYO for consistency
+	  { L"びゃ", "BYA" }, { L"びゅ", "BYU" }, { L"びょ", "BYO" },
+	  { L"ぴゃ", "PYA" }, { L"ぴゅ", "PYU" }, { L"ぴょ", "PYO" },
+	  { L"った", "TTA" }, { L"っち", "TTI" }, { L"っつ", "TTU" }, { L"って", "TTE" }, { L"っと", "TTO" },
+	  { L"っさ", "SSA" }, { L"っし", "SSI" }, { L"っす", "SSU" }, { L"っせ", "SSE" }, { L"っそ", "SSO" },
+	  { L"っか", "KKA" }, { L"っき", "KKI" }, { L"っく", "KKU" }, { L"っけ", "KKE" }, { L"っこ", "KKO" },
+	  { L"っぱ", "PPA" }, { L"っぴ", "PPI" }, { L"っぷ", "PPU" }, { L"っぺ", "PPE" }, { L"っぽ", "PPO" },
+
+	  { L"っきゃ", "KKYA" }, { L"っきゅ", "KKYU" }, { L"っきょ", "KKYO" },
+	  { L"っしゃ", "SS[YH]A" }, { L"っしゅ", "SS[YH]U" }, { L"っしょ", "SS[YH]O" },
+	  { L"っちゃ", "[TC][TC][YH]A" }, { L"っちゅ", "[TC][TC][YH]U" }, { L"っちょ", "[TC][TC][YH]O" },
+	  { L"っひゃ", "HHYA" }, { L"っひゅ", "HHYU" }, { L"っひょ", "HHYO" },
+	  { L"っみゃ", "MMYA" }, { L"っみゅ", "MMYU" }, { L"っみょ", "MMYO" },
+	  { L"っりゃ", "RRYA" }, { L"っりゅ", "RRYU" }, { L"っりょ", "RRYO" },
+	  { L"っぎゃ", "GGYA" }, { L"っぎゅ", "GGYU" }, { L"っぎょ", "GGYO" },
+	  { L"っじゃ", "[JZ][JZ]Y?A"  }, { L"っじゅ", "[JZ][JZ]Y?U"  }, { L"っじょ", "[JZ][JZ]Y?O"  }, // XXX:should display ZYA/ZYU/ZYO for consistency
+	  { L"っびゃ", "BBYA" }, { L"っびゅ", "BBYU" }, { L"っびょ", "BBYO" },
+	  { L"っぴゃ", "PPYA" }, { L"っぴゅ", "PPYU" }, { L"っぴょ", "PPYO" } };
+
+constexpr size_t NUM_ENTRIES = sizeof KANA_ROMAJI/sizeof *KANA_ROMAJI;
+
+// C++11 has no std::index_sequence; this one is built in log(N) steps so
+// the large tables don't hit the template depth limit
+
+template <size_t... I>
+struct index_list
+{ };
+
+template <typename A, typename B>
+struct concat_index_lists;
+
+template <size_t... I, size_t... J>
+struct concat_index_lists<index_list<I...>, index_list<J...>>
+{
+	using type = index_list<I..., (sizeof...(I) + J)...>;
+};
+
+template <size_t N>
+struct make_index_list
+{
+	using type = typename concat_index_lists<typename make_index_list<N/2>::type, typename make_index_list<N - N/2>::type>::type;
+};
+
+template <>
+struct make_index_list<0>
+{
+	using type = index_list<>;
+};
+
+template <>
+struct make_index_list<1>
+{
+	using type = index_list<0>;
+};
+
+template <typename T, size_t N>
+struct table
+{
+	T data[N];
+};
 
-wchar_t
-hira_to_kata(wchar_t ch)
+// a table with F(i) in the i-th entry
+template <typename T, T (*F)(size_t), size_t... I>
+constexpr table<T, sizeof...(I)>
+make_table_from_list(index_list<I...>)
 {
-	return ch - L'あ' + L'ア';
+	return {{ F(I)... }};
 }
 
-wchar_t
-half_to_full(wchar_t ch)
+template <typename T, size_t N, T (*F)(size_t)>
+constexpr table<T, N>
+make_table()
 {
-	return ch - L'a' + L'ａ';
+	return make_table_from_list<T, F>(typename make_index_list<N>::type());
 }
 
-std::map<wchar_t, pattern_ptr> init_kana_to_pattern_map()
+// states are numbered pattern by pattern, after END
+
+constexpr size_t
+get_start_state(size_t entry)
 {
-	std::map<wchar_t, pattern_ptr> map;
+	return entry == 0 ? 1 : get_start_state(entry - 1) + pattern_syntax::get_length(KANA_ROMAJI[entry - 1].romaji);
+}
 
-	static const std::pair<wchar_t, const char *> kana_to_romaji[]
-		{ { L'あ', "A"  }, { L'い', "I"  }, { L'う', "U"  }, { L'え', "E"  }, { L'お', "O"  },
-		  { L'か', "KA" }, { L'き', "KI" }, { L'く', "KU" }, { L'け', "KE" }, { L'こ', "KO" },
-		  { L'さ', "SA" }, { L'し', "SH?I" }, { L'す', "SU" }, { L'せ', "SE" }, { L'そ', "SO" },
-		  { L'た', "TA" }, { L'ち', "[TC]H?I" }, { L'つ', "TS?U" }, { L'て', "TE" }, { L'と', "TO" },
-		  { L'な', "NA" }, { L'に', "NI" }, { L'ぬ', "NU" }, { L'ね', "NE" }, { L'の', "NO" },
-		  { L'は', "HA" }, { L'ひ', "HI" }, { L'ふ', "[HF]U" }, { L'へ', "HE" }, { L'ほ', "HO" },
-		  { L'ま', "MA" }, { L'み', "MI" }, { L'む', "MU" }, { L'め', "ME" }, { L'も', "MO" },
-		  { L'や', "YA" }, { L'ゆ', "YU" }, { L'よ', "YO" },
-		  { L'ら', "RA" }, { L'り', "RI" }, { L'る', "RU" }, { L'れ', "RE" }, { L'ろ', "RO" },
-		  { L'わ', "WA" }, { L'を', "WO" },
-		  { L'ん', "N"  }, { L'ー', "-" },
-		  { L'が', "GA" }, { L'ぎ', "GI" }, { L'ぐ', "GU" }, { L'げ', "GE" }, { L'ご', "GO" },
-		  { L'ざ', "ZA" }, { L'じ', "[ZJ]I" }, { L'ず', "ZU" }, { L'ぜ', "ZE" }, { L'ぞ', "ZO" },
-		  { L'だ', "DA" }, { L'ぢ', "DI" }, { L'づ', "[DZ]U" }, { L'で', "DE" }, { L'ど', "DO" },
-		  { L'ば', "BA" }, { L'び', "BI" }, { L'ぶ', "BU" }, { L'べ', "BE" }, { L'ぼ', "BO" },
-		  { L'ぱ', "PA" }, { L'ぴ', "PI" }, { L'ぷ', "PU" }, { L'ぺ', "PE" }, { L'ぽ', "PO" },
-		  { L'ぁ', "[LX]A"  }, { L'ぃ', "[LX]I"  }, { L'ぅ', "[LX]U"  }, { L'ぇ', "[LX]E"  }, { L'ぉ', "[LX]O"  },
-		  { L'っ', "[LX]TS?U" } };
+constexpr auto START_STATES = make_table<size_t, NUM_ENTRIES + 1, get_start_state>();
 
-	for (auto& p : kana_to_romaji) {
-		pattern_ptr pattern(parse_pattern(p.second));
+constexpr size_t NUM_STATES = START_STATES.data[NUM_ENTRIES];
 
-		map.insert(std::make_pair(p.first, pattern));
-		map.insert(std::make_pair(hira_to_kata(p.first), pattern));
-	}
+static_assert(NUM_STATES < pattern_table::REJECT, "too many pattern states");
 
-	for (char i = 'A'; i <= 'Z'; i++) {
-		char pattern_str[] { i, '\0' };
-		pattern_ptr pattern(parse_pattern(pattern_str));
+constexpr size_t
+find_entry(size_t s, size_t entry = 0)
+{
+	return START_STATES.data[entry + 1] > s ? entry : find_entry(s, entry + 1);
+}
 
-		map.insert(std::make_pair(i, pattern));
-		map.insert(std::make_pair(half_to_full(i), pattern));
+// where each state's position starts in its pattern
+constexpr const char *
+get_state_position(size_t s)
+{
+	return s == 0 ? nullptr : pattern_syntax::get_position(KANA_ROMAJI[find_entry(s)].romaji, s - START_STATES.data[find_entry(s)]);
+}
 
-		map.insert(std::make_pair(i - 'A' + 'a', pattern));
-		map.insert(std::make_pair(half_to_full(i - 'A' + 'a'), pattern));
-	}
+constexpr auto STATE_POSITIONS = make_table<const char *, NUM_STATES, get_state_position>();
 
-	for (char i = '0'; i <= '9'; i++) {
-		char pattern_str[] { i, '\0' };
-		pattern_ptr pattern(parse_pattern(pattern_str));
+constexpr bool
+is_last_position(size_t s)
+{
+	return *pattern_syntax::skip_position(STATE_POSITIONS.data[s]) == '\0';
+}
 
-		map.insert(std::make_pair(i, pattern));
-		map.insert(std::make_pair(half_to_full(i), pattern));
-	}
+constexpr int
+get_num_strokes(size_t s)
+{
+	return (pattern_syntax::is_optional(STATE_POSITIONS.data[s]) ? 0 : 1) + (is_last_position(s) ? 0 : get_num_strokes(s + 1));
+}
 
-	return map;
+constexpr pattern_table::state_info
+get_state_info(size_t s)
+{
+	return s == 0
+		? pattern_table::state_info { 0, false, 0 }
+		: pattern_table::state_info {
+			pattern_syntax::get_char(STATE_POSITIONS.data[s]),
+			pattern_syntax::is_optional(STATE_POSITIONS.data[s]),
+			static_cast<uint8_t>(get_num_strokes(s)) };
 }
 
-std::map<std::pair<wchar_t, wchar_t>, pattern_ptr> init_kana_pair_to_pattern_map()
+constexpr state
+get_successor(size_t s)
 {
-	std::map<std::pair<wchar_t, wchar_t>, pattern_ptr> map;
+	return is_last_position(s) ? pattern_table::END : s + 1;
+}
 
-	static const std::pair<const wchar_t *, const char *> kana_pair_to_romaji[]
-		{ { L"きゃ", "KYA" }, { L"きゅ", "KYU" }, { L"きょ", "KYO" },
-		  { L"しゃ", "S[YH]A" }, { L"しゅ", "S[YH]U" }, { L"しょ", "S[YH]O" },
-		  { L"ちゃ", "[TC][YH]A" }, { L"ちゅ", "[TC][YH]U" }, { L"ちょ", "[TC][YH]O" },
-		  { L"にゃ", "NYA" }, { L"にゅ", "NYU" }, { L"にょ", "NYO" },
-		  { L"ひゃ", "HYA" }, { L"ひゅ", "HYU" }, { L"ひょ", "HYO" },
-		  { L"みゃ", "MYA" }, { L"みゅ", "MYU" }, { L"みょ", "MYO" },
-		  { L"りゃ", "RYA" }, { L"りゅ", "RYU" }, { L"りょ", "RYO" },
-		  { L"ぎゃ", "GYA" }, { L"ぎゅ", "GYU" }, { L"ぎょ", "GYO" },
-		  { L"じゃ", "[JZ]Y?A"  }, { L"じゅ", "[JZ]Y?U"  }, { L"じょ", "[JZ]Y?O"  }, // XXX:should display ZYA/ZYU/ZYO for consistency
-		  { L"びゃ", "BYA" }, { L"びゅ", "BYU" }, { L"びょ", "BYO" },
-		  { L"ぴゃ", "PYA" }, { L"ぴゅ", "PYU" }, { L"ぴょ", "PYO" },
-		  { L"った", "TTA" }, { L"っち", "TTI" }, { L"っつ", "TTU" }, { L"って", "TTE" }, { L"っと", "TTO" },
-		  { L"っさ", "SSA" }, { L"っし", "SSI" }, { L"っす", "SSU" }, { L"っせ", "SSE" }, { L"っそ", "SSO" },
-		  { L"っか", "KKA" }, { L"っき", "KKI" }, { L"っく", "KKU" }, { L"っけ", "KKE" }, { L"っこ", "KKO" },
-		  { L"っぱ", "PPA" }, { L"っぴ", "PPI" }, { L"っぷ", "PPU" }, { L"っぺ", "PPE" }, { L"っぽ", "PPO" } };
+// a key that doesn't match an optional position may match the next one
+constexpr state
+get_transition(size_t s, int keysym)
+{
+	return s == 0 ? pattern_table::REJECT
+		: pattern_syntax::matches(STATE_POSITIONS.data[s], keysym) ? get_successor(s)
+		: pattern_syntax::is_optional(STATE_POSITIONS.data[s]) && !is_last_position(s) && pattern_syntax::matches(STATE_POSITIONS.data[s + 1], keysym) ? get_successor(s + 1)
+		: pattern_table::REJECT;
+}
 
-	for (auto& p : kana_pair_to_romaji) {
-		pattern_ptr pattern(parse_pattern(p.second));
+constexpr state
+get_transition(size_t i)
+{
+	return get_transition(i/pattern_table::NUM_SYMBOLS, pattern_table::get_key(i%pattern_table::NUM_SYMBOLS));
+}
 
-		auto kana = p.first;
-		map.insert(std::make_pair(std::make_pair(kana[0], kana[1]), pattern));
-		map.insert(std::make_pair(std::make_pair(hira_to_kata(kana[0]), hira_to_kata(kana[1])), pattern));
-	}
+// every key in a pattern must have a column in the transition table
 
-	return map;
+constexpr bool
+keys_are_valid(const char *p)
+{
+	return *p == '\0' || ((*p == '[' || *p == ']' || *p == '?' || pattern_table::get_symbol(*p) != -1) && keys_are_valid(p + 1));
 }
 
-std::map<std::tuple<wchar_t, wchar_t, wchar_t>, pattern_ptr> init_kana_triple_to_pattern_map()
+constexpr bool
+patterns_are_valid(size_t entry = 0)
 {
-	std::map<std::tuple<wchar_t, wchar_t, wchar_t>, pattern_ptr> map;
+	return entry == NUM_ENTRIES || (keys_are_valid(KANA_ROMAJI[entry].romaji) && patterns_are_valid(entry + 1));
+}
+
+static_assert(patterns_are_valid(), "invalid key in a romaji pattern");
+
+constexpr auto STATE_INFO = make_table<pattern_table::state_info, NUM_STATES, get_state_info>();
+constexpr auto TRANSITIONS = make_table<state, NUM_STATES*pattern_table::NUM_SYMBOLS, get_transition>();
+
+constexpr pattern_table PATTERNS(STATE_INFO.data, TRANSITIONS.data, NUM_STATES);
+
+// kana lookup. pairs are either a kana followed by a small ya/yu/yo, or
+// a small tsu followed by a kana; triples are both.
 
-	static const std::pair<const wchar_t *, const char *> kana_triple_to_romaji[]
-		{ { L"っきゃ", "KKYA" }, { L"っきゅ", "KKYU" }, { L"っきょ", "KKYO" },
-		  { L"っしゃ", "SS[YH]A" }, { L"っしゅ", "SS[YH]U" }, { L"っしょ", "SS[YH]O" },
-		  { L"っちゃ", "[TC][TC][YH]A" }, { L"っちゅ", "[TC][TC][YH]U" }, { L"っちょ", "[TC][TC][YH]O" },
-		  { L"っひゃ", "HHYA" }, { L"っひゅ", "HHYU" }, { L"っひょ", "HHYO" },
-		  { L"っみゃ", "MMYA" }, { L"っみゅ", "MMYU" }, { L"っみょ", "MMYO" },
-		  { L"っりゃ", "RRYA" }, { L"っりゅ", "RRYU" }, { L"っりょ", "RRYO" },
-		  { L"っぎゃ", "GGYA" }, { L"っぎゅ", "GGYU" }, { L"っぎょ", "GGYO" },
-		  { L"っじゃ", "[JZ][JZ]Y?A"  }, { L"っじゅ", "[JZ][JZ]Y?U"  }, { L"っじょ", "[JZ][JZ]Y?O"  }, // XXX:should display ZYA/ZYU/ZYO for consistency
-		  { L"っびゃ", "BBYA" }, { L"っびゅ", "BBYU" }, { L"っびょ", "BBYO" },
-		  { L"っぴゃ", "PPYA" }, { L"っぴゅ", "PPYU" }, { L"っぴょ", "PPYO" } };
+enum : wchar_t {
+	KANA_BLOCK_START = 0x3040,
+	KANA_BLOCK_SIZE = 0xc0,
+	KATAKANA_OFFSET = L'ア' - L'あ',
+	FULL_WIDTH_OFFSET = L'ａ' - L'a',
+};
 
-	for (auto& p : kana_triple_to_romaji) {
-		pattern_ptr pattern(parse_pattern(p.second));
-
-		auto kana = p.first;
-		map.insert(std::make_pair(std::make_tuple(kana[0], kana[1], kana[2]), pattern));
-		map.insert(std::make_pair(std::make_tuple(hira_to_kata(kana[0]), hira_to_kata(kana[1]), hira_to_kata(kana[2])), pattern));
-	}
+constexpr const wchar_t *SMALL_TSU = L"っッ";
+constexpr const wchar_t *SMALL_YA_YU_YO = L"ゃゅょャュョ";
 
-	return map;
+enum { NUM_SMALL_TSU = 2, NUM_SMALL_YA_YU_YO = 6 };
+
+constexpr bool
+in_kana_block(wchar_t ch)
+{
+	return ch >= KANA_BLOCK_START && ch < KANA_BLOCK_START + KANA_BLOCK_SIZE;
 }
 
+// kana entries also match their katakana; 0 ends a shorter sequence
+constexpr bool
+same_kana(const wchar_t *kana, wchar_t kana0, wchar_t kana1, wchar_t kana2, wchar_t offset)
+{
+	return kana[0] + offset == kana0
+		&& (kana[1] == 0 ? kana1 == 0 : kana[1] + offset == kana1
+		&& (kana[2] == 0 ? kana2 == 0 : kana[2] + offset == kana2));
 }
 
-const pattern_node *
-find_pattern(wchar_t kana)
+constexpr int
+get_kana_length(const wchar_t *kana)
 {
-	static const std::map<wchar_t, pattern_ptr> map(init_kana_to_pattern_map());
+	return *kana == 0 ? 0 : 1 + get_kana_length(kana + 1);
+}
 
-	auto it = map.find(kana);
-	return it != map.end() ? it->second.get() : nullptr;
+constexpr size_t
+find_first_entry(int kana_length, size_t entry = 0)
+{
+	return entry == NUM_ENTRIES || get_kana_length(KANA_ROMAJI[entry].kana) >= kana_length ? entry : find_first_entry(kana_length, entry + 1);
 }
 
-const pattern_node *
-find_pattern(wchar_t kana0, wchar_t kana1)
+// the entries for single kana, pairs and triples
+constexpr size_t PAIRS_START = find_first_entry(2);
+constexpr size_t TRIPLES_START = find_first_entry(3);
+
+constexpr state
+search(wchar_t kana0, wchar_t kana1, wchar_t kana2, size_t entry, size_t end)
 {
-	static const std::map<std::pair<wchar_t, wchar_t>, pattern_ptr> map(init_kana_pair_to_pattern_map());
+	return entry == end ? pattern_table::END
+		: same_kana(KANA_ROMAJI[entry].kana, kana0, kana1, kana2, 0)
+		  || (in_kana_block(KANA_ROMAJI[entry].kana[0]) && same_kana(KANA_ROMAJI[entry].kana, kana0, kana1, kana2, KATAKANA_OFFSET))
+			? START_STATES.data[entry]
+		: search(kana0, kana1, kana2, entry + 1, end);
+}
 
-	auto it = map.find(std::make_pair(kana0, kana1));
-	return it != map.end() ? it->second.get() : nullptr;
+constexpr wchar_t
+to_upper(wchar_t ch)
+{
+	return ch >= 'a' && ch <= 'z' ? ch - 'a' + 'A' : ch;
 }
 
-const pattern_node *
-find_pattern(wchar_t kana0, wchar_t kana1, wchar_t kana2)
+constexpr state
+get_ascii(size_t i)
+{
+	return search(to_upper(i), 0, 0, 0, PAIRS_START);
+}
+
+constexpr state
+get_single(size_t i)
+{
+	return search(KANA_BLOCK_START + i, 0, 0, 0, PAIRS_START);
+}
+
+constexpr state
+get_youon(size_t i)
+{
+	return search(KANA_BLOCK_START + i/NUM_SMALL_YA_YU_YO, SMALL_YA_YU_YO[i%NUM_SMALL_YA_YU_YO], 0, PAIRS_START, TRIPLES_START);
+}
+
+constexpr state
+get_sokuon(size_t i)
+{
+	return search(SMALL_TSU[i/KANA_BLOCK_SIZE], KANA_BLOCK_START + i%KANA_BLOCK_SIZE, 0, PAIRS_START, TRIPLES_START);
+}
+
+constexpr state
+get_sokuon_youon(size_t i)
+{
+	return search(
+		SMALL_TSU[i/(KANA_BLOCK_SIZE*NUM_SMALL_YA_YU_YO)],
+		KANA_BLOCK_START + i/NUM_SMALL_YA_YU_YO%KANA_BLOCK_SIZE,
+		SMALL_YA_YU_YO[i%NUM_SMALL_YA_YU_YO],
+		TRIPLES_START, NUM_ENTRIES);
+}
+
+constexpr auto ASCII = make_table<state, 0x80, get_ascii>();
+constexpr auto SINGLES = make_table<state, KANA_BLOCK_SIZE, get_single>();
+constexpr auto YOUON = make_table<state, KANA_BLOCK_SIZE*NUM_SMALL_YA_YU_YO, get_youon>();
+constexpr auto SOKUON = make_table<state, NUM_SMALL_TSU*KANA_BLOCK_SIZE, get_sokuon>();
+constexpr auto SOKUON_YOUON = make_table<state, NUM_SMALL_TSU*KANA_BLOCK_SIZE*NUM_SMALL_YA_YU_YO, get_sokuon_youon>();
+
+constexpr int
+index_of(const wchar_t *str, wchar_t ch, int index = 0)
+{
+	return str[index] == 0 ? -1 : str[index] == ch ? index : index_of(str, ch, index + 1);
+}
+
+constexpr state
+lookup(wchar_t kana)
+{
+	return kana >= 0 && kana < 0x80 ? ASCII.data[kana]
+		: in_kana_block(kana) ? SINGLES.data[kana - KANA_BLOCK_START]
+		: kana > FULL_WIDTH_OFFSET && kana < FULL_WIDTH_OFFSET + 0x80 ? ASCII.data[kana - FULL_WIDTH_OFFSET]
+		: pattern_table::END;
+}
+
+constexpr state
+lookup(wchar_t kana0, wchar_t kana1)
+{
+	return !in_kana_block(kana0) || !in_kana_block(kana1) ? pattern_table::END
+		: index_of(SMALL_YA_YU_YO, kana1) != -1
+			? YOUON.data[(kana0 - KANA_BLOCK_START)*NUM_SMALL_YA_YU_YO + index_of(SMALL_YA_YU_YO, kana1)]
+		: index_of(SMALL_TSU, kana0) != -1
+			? SOKUON.data[index_of(SMALL_TSU, kana0)*KANA_BLOCK_SIZE + kana1 - KANA_BLOCK_START]
+		: pattern_table::END;
+}
+
+constexpr state
+lookup(wchar_t kana0, wchar_t kana1, wchar_t kana2)
 {
-	static const std::map<std::tuple<wchar_t, wchar_t, wchar_t>, pattern_ptr> map(init_kana_triple_to_pattern_map());
+	return !in_kana_block(kana1) || index_of(SMALL_TSU, kana0) == -1 || index_of(SMALL_YA_YU_YO, kana2) == -1 ? pattern_table::END
+		: SOKUON_YOUON.data[(index_of(SMALL_TSU, kana0)*KANA_BLOCK_SIZE + kana1 - KANA_BLOCK_START)*NUM_SMALL_YA_YU_YO + index_of(SMALL_YA_YU_YO, kana2)];
+}
+
+// every entry must be reachable through the tables above
+
+constexpr state
+lookup_entry(const wchar_t *kana)
+{
+	return kana[1] == 0 ? lookup(kana[0])
+		: kana[2] == 0 ? lookup(kana[0], kana[1])
+		: lookup(kana[0], kana[1], kana[2]);
+}
+
+constexpr bool
+entries_are_indexed(size_t entry = 0)
+{
+	return entry == NUM_ENTRIES || (lookup_entry(KANA_ROMAJI[entry].kana) == START_STATES.data[entry] && entries_are_indexed(entry + 1));
+}
+
+static_assert(entries_are_indexed(), "a kana sequence can't be looked up");
+
+}
+
+const pattern_table&
+get_patterns()
+{
+	return PATTERNS;
+}
+
+state
+find_pattern(wchar_t kana)
+{
+	return lookup(kana);
+}
 
-	auto it = map.find(std::make_tuple(kana0, kana1, kana2));
-	return it != map.end() ? it->second.get() : nullptr;
+state
+find_pattern(wchar_t kana0, wchar_t kana1)
+{
+	return lookup(kana0, kana1);
+}
+
+state
+find_pattern(wchar_t kana0, wchar_t kana1, wchar_t kana2)
+{
+	return lookup(kana0, kana1, kana2);
 }
 
 }
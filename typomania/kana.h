@@ -1,15 +1,22 @@
 #pragma once
 
-struct pattern_node;
+#include <utility>
+
+#include "pattern.h"
 
 namespace kana {
 
-const pattern_node *find_pattern(wchar_t kana0, wchar_t kana1, wchar_t kana2);
-const pattern_node *find_pattern(wchar_t kana0, wchar_t kana1);
-const pattern_node *find_pattern(wchar_t kana);
+// every pattern returned by find_pattern() is in here
+const pattern_table& get_patterns();
+
+// start state of the pattern for a kana, or pattern_table::END if there's
+// none
+pattern_table::state find_pattern(wchar_t kana0, wchar_t kana1, wchar_t kana2);
+pattern_table::state find_pattern(wchar_t kana0, wchar_t kana1);
+pattern_table::state find_pattern(wchar_t kana);
 
 template <typename Iterator>
-std::pair<const pattern_node *, int> find_pattern(Iterator it)
+std::pair<pattern_table::state, int> find_pattern(Iterator it)
 {
 	wchar_t c0 = *it;
 	++it;
@@ -28,7 +35,7 @@ std::pair<const pattern_node *, int> find_pattern(Iterator it)
 	if (auto p = find_pattern(c0))
 		return { p, 1 };
 
-	return { nullptr, 0 };
+	return { pattern_table::END, 0 };
 }
 
 }
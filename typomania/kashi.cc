@@ -1,18 +1,24 @@
-#include <cassert>
-
-#include <iostream>
-#include <fstream>
-#include <codecvt>
-
-#include <boost/algorithm/string.hpp>
-#include <boost/lexical_cast.hpp>
+#include <cerrno>
+#include <cstdarg>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "panic.h"
 #include "resources.h"
+#include "async_texture.h"
 #include "render.h"
 #include "pattern.h"
 #include "kana.h"
 #include "glyph_fx.h"
+#include "utf8.h"
 #include "kashi.h"
 
 static bool
@@ -27,73 +33,381 @@ is_kana(wchar_t ch)
 	  || (ch >= '0' && ch <= '9') || (ch >= L'０' && ch <= L'９');
 }
 
+static const float FURIGANA_Y = 26;
+
+// draws the kana of a part, the first num_highlighted of them in color[0];
+// returns how many are left to highlight
+static int
+draw_kana(const serifu_arena& arena, const serifu_part& part, int num_highlighted, const rgba color[2])
+{
+	const font *f = arena.fonts[part.kana_font];
+
+	size_t pos = part.kana_begin;
+
+	if (num_highlighted) {
+		while (pos < part.kana_end) {
+			if (is_kana(arena.text[pos++])) {
+				if (!--num_highlighted)
+					break;
+			}
+		}
+	}
+
+	if (pos > part.kana_begin) {
+		render::set_color(color[0]);
+		f->draw_glyphs(arena.glyphs.data() + part.kana_begin, pos - part.kana_begin, 0);
+	}
+
+	if (pos < part.kana_end) {
+		render::set_color(color[1]);
+		f->draw_glyphs(arena.glyphs.data() + pos, part.kana_end - pos, 0);
+	}
+
+	return num_highlighted;
+}
+
 kashi::kashi()
-	: background(nullptr)
+	: level(0)
+	, num_strokes(0)
 { }
 
 kashi::~kashi()
 {
 }
 
+namespace {
+
+// a .kashi file, mapped and read in place a line at a time. fields are
+// separated by tabs, a run of them counting as one; a run at the end of a
+// line is followed by an empty field. errors are reported with their line
+// and column.
+
+class kashi_reader : private boost::noncopyable
+{
+public:
+	kashi_reader(const std::string& path);
+	~kashi_reader();
+
+	bool open();
+
+	// moves on to the next line; false at the end of the file
+	bool next_line();
+
+	bool has_field() const
+	{ return field_ != nullptr; }
+
+	// the next field of the line, or false if it has no more. what is the
+	// field's name, for the error.
+	bool read_field(const char *&begin, const char *&end, const char *what);
+
+	bool read_string(std::string& str, const char *what);
+	bool read_text(std::wstring& str, const char *what);
+	bool read_int(int& value, const char *what);
+
+	// pos is in the current line
+	void error(const char *pos, const char *fmt, ...) const;
+
+private:
+	std::string path_;
+
+	void *mapping_;
+	size_t mapping_size_;
+
+	const char *next_, *end_; // rest of the file
+	const char *line_, *line_end_; // current line
+	const char *field_; // rest of the line, nullptr past the last field
+	int line_num_;
+};
+
+kashi_reader::kashi_reader(const std::string& path)
+	: path_(path)
+	, mapping_(nullptr)
+	, mapping_size_(0)
+	, next_(nullptr)
+	, end_(nullptr)
+	, line_(nullptr)
+	, line_end_(nullptr)
+	, field_(nullptr)
+	, line_num_(0)
+{ }
+
+kashi_reader::~kashi_reader()
+{
+	if (mapping_)
+		munmap(mapping_, mapping_size_);
+}
+
 bool
-kashi::load(const std::string& path)
+kashi_reader::open()
 {
-	std::ifstream file(path);
-	if (!file)
+	int fd = ::open(path_.c_str(), O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "%s: %s\n", path_.c_str(), strerror(errno));
 		return false;
+	}
 
-	std::string line;
-	if (!std::getline(file, line))
+	struct stat st;
+
+	if (fstat(fd, &st) == -1) {
+		fprintf(stderr, "%s: %s\n", path_.c_str(), strerror(errno));
+		close(fd);
 		return false;
+	}
+
+	// an empty file can't be mapped, but it's only missing its header
+	if (st.st_size > 0) {
+		void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-	std::vector<std::string> tokens;
-	auto is_tab = [](char ch) { return ch == '\t'; };
-	boost::split(tokens, line, is_tab, boost::token_compress_on);
-	if (tokens.size() < 4)
+		if (data == MAP_FAILED) {
+			fprintf(stderr, "%s: %s\n", path_.c_str(), strerror(errno));
+			close(fd);
+			return false;
+		}
+
+		mapping_ = data;
+		mapping_size_ = st.st_size;
+	}
+
+	close(fd);
+
+	next_ = static_cast<const char *>(mapping_);
+	end_ = next_ + mapping_size_;
+
+	return true;
+}
+
+bool
+kashi_reader::next_line()
+{
+	if (next_ == end_)
+		return false;
+
+	line_ = next_;
+
+	if (const char *nl = static_cast<const char *>(memchr(line_, '\n', end_ - line_))) {
+		line_end_ = nl;
+		next_ = nl + 1;
+	} else {
+		line_end_ = next_ = end_;
+	}
+
+	if (line_end_ != line_ && line_end_[-1] == '\r')
+		--line_end_;
+
+	field_ = line_;
+	++line_num_;
+
+	return true;
+}
+
+bool
+kashi_reader::read_field(const char *&begin, const char *&end, const char *what)
+{
+	if (!has_field()) {
+		error(line_end_, "expected %s", what);
 		return false;
+	}
 
-	std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> utf8conv;
+	begin = field_;
 
-	name = utf8conv.from_bytes(tokens[0]); // utf8_to_wchar(tokens[0].c_str());
-	artist = utf8conv.from_bytes(tokens[1]);
-	genre = utf8conv.from_bytes(tokens[2]);
-	stream = tokens[3];
+	if (const char *tab = static_cast<const char *>(memchr(field_, '\t', line_end_ - field_))) {
+		end = tab;
 
-	std::string texture_path;
-	if (tokens.size() > 4) {
-		texture_path = tokens[4];
+		for (field_ = tab; field_ != line_end_ && *field_ == '\t'; ++field_)
+			;
 	} else {
-		texture_path = "data/images/aozora.png";
+		end = line_end_;
+		field_ = nullptr;
 	}
 
-	background = get_texture(texture_path);
+	return true;
+}
 
-	while (std::getline(file, line)) {
-		std::vector<std::string> tokens;
-		boost::split(tokens, line, is_tab, boost::token_compress_on);
-		if (tokens.size() != 2)
+bool
+kashi_reader::read_string(std::string& str, const char *what)
+{
+	const char *begin, *end;
+
+	if (!read_field(begin, end, what))
+		return false;
+
+	str.assign(begin, end);
+
+	return true;
+}
+
+bool
+kashi_reader::read_text(std::wstring& str, const char *what)
+{
+	const char *begin, *end;
+
+	if (!read_field(begin, end, what))
+		return false;
+
+	if (const char *bad = utf8::decode(begin, end, str)) {
+		error(bad, "invalid UTF-8");
+		return false;
+	}
+
+	return true;
+}
+
+bool
+kashi_reader::read_int(int& value, const char *what)
+{
+	const char *begin, *end;
+
+	if (!read_field(begin, end, what))
+		return false;
+
+	if (begin == end) {
+		error(begin, "expected %s", what);
+		return false;
+	}
+
+	value = 0;
+
+	for (const char *p = begin; p != end; p++) {
+		if (*p < '0' || *p > '9' || value > (INT_MAX - (*p - '0'))/10) {
+			error(p, "bad %s", what);
 			return false;
+		}
+
+		value = 10*value + (*p - '0');
+	}
+
+	return true;
+}
+
+void
+kashi_reader::error(const char *pos, const char *fmt, ...) const
+{
+	if (line_num_)
+		fprintf(stderr, "%s:%d:%zu: ", path_.c_str(), line_num_, 1 + utf8::count(line_, pos));
+	else
+		fprintf(stderr, "%s: ", path_.c_str());
 
-		serifu_ptr p(new serifu(boost::lexical_cast<int>(tokens[0])));
-		p->parse(utf8conv.from_bytes(tokens[1]));
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
 
-		serifu_list.push_back(std::move(p));
+	fputc('\n', stderr);
+}
+
+// the lines after the header
+bool
+read_serifus(kashi_reader& reader, serifu_arena& lyrics)
+{
+	while (reader.next_line()) {
+		int duration;
+
+		if (!reader.read_int(duration, "duration"))
+			return false;
+
+		const char *begin, *end;
+
+		if (!reader.read_field(begin, end, "serifu"))
+			return false;
+
+		if (reader.has_field()) {
+			reader.error(end, "extra field after the serifu");
+			return false;
+		}
+
+		// the line is kept as far as it makes sense
+		serifu_arena::syntax_error error;
+
+		if (!lyrics.add_serifu(duration, begin, end, error))
+			reader.error(error.pos, "%s", error.what);
+	}
+
+	return true;
+}
+
+}
+
+bool
+kashi::load(const std::string& path)
+{
+	kashi_reader reader(path);
+
+	if (!reader.open())
+		return false;
+
+	this->path = path;
+
+	if (!reader.next_line()) {
+		reader.error(nullptr, "empty file");
+		return false;
 	}
 
-	init_level();
+	if (!reader.read_text(name, "name")
+	  || !reader.read_text(artist, "artist")
+	  || !reader.read_text(genre, "genre")
+	  || !reader.read_string(stream, "stream"))
+		return false;
+
+	if (reader.has_field()) {
+		if (!reader.read_string(background_path, "background"))
+			return false;
+	} else {
+		background_path = "data/images/aozora.png";
+	}
+
+	// the level needs the lyrics, but they're only kept once the song
+	// is played
+
+	serifu_arena lyrics;
+
+	if (!read_serifus(reader, lyrics))
+		return false;
+
+	init_level(lyrics);
 
 	return true;
 }
 
+bool
+kashi::load_lyrics()
+{
+	if (!lyrics_.empty())
+		return true;
+
+	kashi_reader reader(path);
+
+	if (!reader.open() || !reader.next_line())
+		return false;
+
+	if (!read_serifus(reader, lyrics_)) {
+		lyrics_.clear();
+		return false;
+	}
+
+	lyrics_.layout();
+
+	return true;
+}
+
+const gl::texture *
+kashi::get_background() const
+{
+	return get_texture_async(background_path)->get();
+}
+
 void
-kashi::init_level()
+kashi::init_level(const serifu_arena& lyrics)
 {
 	float top_kana_per_ms = 0;
 
-	for (auto& serifu : serifu_list) {
-		int kana_count = std::distance(serifu->romaji_begin(), serifu->romaji_end());
+	num_strokes = 0;
 
-		float kana_per_ms = static_cast<float>(kana_count)/serifu->duration();
+	for (auto& serifu : lyrics) {
+		int kana_count = serifu.get_num_strokes();
+
+		num_strokes += kana_count;
+
+		float kana_per_ms = static_cast<float>(kana_count)/serifu.duration();
 
 		if (kana_per_ms > top_kana_per_ms)
 			top_kana_per_ms = kana_per_ms;
@@ -105,12 +419,13 @@ kashi::init_level()
 		level = 99;
 }
 
-serifu::serifu(int duration)
-	: duration_(duration)
+serifu_arena::serifu_arena()
+	: stroke_offsets(1, 0)
+	, fonts()
 { }
 
 bool
-serifu::parse(const std::wstring& text)
+serifu_arena::add_serifu(int duration, const char *line, const char *end, syntax_error& error)
 {
 	enum state {
 		NONE,
@@ -120,62 +435,202 @@ serifu::parse(const std::wstring& text)
 	};
 	state cur_state = NONE;
 
-	serifu_part_ptr cur_part;
+	serifus_.push_back(serifu(this, duration));
+	serifu& s = serifus_.back();
 
-	for (wchar_t ch : text) {
-		if (ch == '(') {
-			if (cur_state == KANJI || cur_state == FURIGANA)
-				return false;
-			else if (cur_state == KANA)
-				section_list.push_back(std::move(cur_part));
+	s.begin_part_ = parts.size();
 
-			cur_part.reset(new serifu_furigana_part);
-			cur_state = KANJI;
-		} else if (ch == '|') {
-			if (cur_state != KANJI)
-				return false;
+	// the part being parsed is parts.back(), with its text at the end of
+	// the buffer; kana_end follows the text as it's added
 
-			cur_state = FURIGANA;
-		} else if (ch == ')') {
-			if (cur_state != FURIGANA)
-				return false;
+	error = { nullptr, nullptr };
 
-			section_list.push_back(std::move(cur_part));
-			cur_state = NONE;
+	for (const char *p = line; p != end && !error.pos; ) {
+		// the markup is ASCII, so it can't be part of a longer sequence;
+		// the text between it is decoded a run at a time
+		const char ch = *p;
+
+		if (ch == '(') {
+			if (cur_state == KANJI || cur_state == FURIGANA) {
+				error = { p, "'(' inside (kanji|furigana)" };
+			} else {
+				const uint32_t offset = text.size();
+				parts.push_back({ serifu_part::FURIGANA, SMALL_FONT, TINY_FONT, 0, offset, offset, offset });
+				cur_state = KANJI;
+				++p;
+			}
+		} else if (ch == '|') {
+			if (cur_state != KANJI) {
+				error = { p, "'|' outside (kanji|furigana)" };
+			} else {
+				cur_state = FURIGANA;
+				++p;
+			}
+		} else if (ch == ')') {
+			if (cur_state != FURIGANA) {
+				error = { p, "')' outside (kanji|furigana)" };
+			} else {
+				cur_state = NONE;
+				++p;
+			}
 		} else {
-			switch (cur_state) {
-				case NONE:
-					cur_part.reset(new serifu_kana_part);
-					cur_state = KANA;
-					// FALLTHROUGH
-
-				case KANA:
-					dynamic_cast<serifu_kana_part *>(cur_part.get())->kana.push_back(ch);
-					break;
+			const char *run_end = p;
 
-				case KANJI:
-					dynamic_cast<serifu_furigana_part *>(cur_part.get())->kanji.push_back(ch);
-					break;
+			while (run_end != end && *run_end != '(' && *run_end != '|' && *run_end != ')')
+				++run_end;
 
-				case FURIGANA:
-					dynamic_cast<serifu_furigana_part *>(cur_part.get())->furigana.push_back(ch);
-					break;
+			if (cur_state == NONE) {
+				const uint32_t offset = text.size();
+				parts.push_back({ serifu_part::KANA, SMALL_FONT, SMALL_FONT, 0, offset, offset, offset });
+				cur_state = KANA;
 			}
+
+			const size_t run_begin = text.size();
+
+			// what's before a malformed sequence is kept, as if it
+			// had been decoded a character at a time
+			if (const char *bad = utf8::append(p, run_end, text))
+				error = { bad, "invalid UTF-8" };
+
+			serifu_part& part = parts.back();
+
+			if (cur_state == KANJI) {
+				part.kana_begin = part.kana_end = text.size();
+			} else {
+				part.kana_end = text.size();
+				part.num_kana += std::count_if(text.begin() + run_begin, text.end(), is_kana);
+			}
+
+			p = run_end;
 		}
 	}
 
-	if (cur_state != NONE)
-		section_list.push_back(std::move(cur_part));
+	// the part with the error is dropped; one left open at the end of the
+	// line is kept
+	if (error.pos && cur_state != NONE) {
+		text.resize(parts.back().kanji_begin);
+		parts.pop_back();
+	}
 
-	return true;
+	s.end_part_ = parts.size();
+
+	init_clusters(s);
+
+	return !error.pos;
+}
+
+void
+serifu_arena::init_clusters(serifu& s)
+{
+	s.begin_cluster_ = clusters.size();
+
+	// the line's kana in a row, like kana_iterator would go over them, and
+	// two past the end for find_pattern to look ahead
+	kana_.clear();
+
+	for (size_t i = s.begin_part_; i < s.end_part_; i++) {
+		for (size_t j = parts[i].kana_begin; j < parts[i].kana_end; j++) {
+			if (is_kana(text[j]))
+				kana_.push_back(text[j]);
+		}
+	}
+
+	const size_t num_kana = kana_.size();
+
+	kana_.resize(num_kana + 2, L'\0');
+
+	for (const wchar_t *p = kana_.data(), *end = p + num_kana; p != end; ) {
+		pattern_table::state pattern;
+		int consumed;
+
+		std::tie(pattern, consumed) = kana::find_pattern(p);
+		if (!pattern)
+			break;
+
+		clusters.push_back({ pattern, consumed });
+		stroke_offsets.push_back(stroke_offsets.back() + kana::get_patterns().get_num_strokes(pattern));
+
+		p += consumed;
+	}
+
+	s.end_cluster_ = clusters.size();
+}
+
+void
+serifu_arena::layout()
+{
+	fonts[SMALL_FONT] = get_font("data/fonts/small_font.fntb");
+	fonts[TINY_FONT] = get_font("data/fonts/tiny_font.fntb");
+
+	glyphs.resize(text.size());
+
+	for (auto& s : serifus_) {
+		float x = 0;
+
+		for (size_t i = s.begin_part_; i < s.end_part_; i++) {
+			const serifu_part& part = parts[i];
+
+			const font *kanji_font = fonts[part.kanji_font];
+			const font *kana_font = fonts[part.kana_font];
+
+			const size_t kanji_len = part.kana_begin - part.kanji_begin;
+			const size_t kana_len = part.kana_end - part.kana_begin;
+
+			const int kanji_width = kanji_font->get_string_width(text.data() + part.kanji_begin, kanji_len);
+			const int kana_width = kana_font->get_string_width(text.data() + part.kana_begin, kana_len);
+
+			const int width = std::max(kanji_width, kana_width);
+
+			// both centered over the part, with the furigana above the kanji
+			kanji_font->layout_glyphs(
+					text.data() + part.kanji_begin, kanji_len,
+					x + .5*width - .5*kanji_width, 0,
+					glyphs.data() + part.kanji_begin);
+
+			kana_font->layout_glyphs(
+					text.data() + part.kana_begin, kana_len,
+					x + .5*width - .5*kana_width, part.kind == serifu_part::FURIGANA ? FURIGANA_Y : 0,
+					glyphs.data() + part.kana_begin);
+
+			x += width;
+		}
+	}
+}
+
+void
+serifu_arena::clear()
+{
+	serifus_.clear();
+
+	text.clear();
+	parts.clear();
+	clusters.clear();
+	stroke_offsets.assign(1, 0);
+	glyphs.clear();
 }
 
+serifu::serifu(const serifu_arena *arena, int duration)
+	: arena_(arena)
+	, duration_(duration)
+	, begin_part_(0)
+	, end_part_(0)
+	, begin_cluster_(0)
+	, end_cluster_(0)
+{ }
+
 void
 serifu::draw(int num_highlighted, const rgba color[2]) const
 {
-	for (auto& section : section_list) {
-		num_highlighted = section->draw(num_highlighted, color);
-		render::translate(section->get_width(), 0);
+	for (size_t i = begin_part_; i < end_part_; i++) {
+		const serifu_part& part = arena_->parts[i];
+
+		if (part.kind == serifu_part::FURIGANA) {
+			render::set_color(color[num_highlighted < part.num_kana]);
+			arena_->fonts[part.kanji_font]->draw_glyphs(
+					arena_->glyphs.data() + part.kanji_begin, part.kana_begin - part.kanji_begin, 0);
+		}
+
+		num_highlighted = draw_kana(*arena_, part, num_highlighted, color);
 	}
 }
 
@@ -188,143 +643,78 @@ serifu::duration() const
 serifu::kana_iterator
 serifu::kana_begin() const
 {
-	return kana_iterator(std::begin(section_list), std::end(section_list));
+	return kana_iterator(arena_, begin_part_, end_part_);
 }
 
 serifu::kana_iterator
 serifu::kana_end() const
 {
-	return kana_iterator(std::end(section_list), std::end(section_list));
+	return kana_iterator(arena_, end_part_, end_part_);
 }
 
-serifu::romaji_iterator
-serifu::romaji_begin() const
+size_t
+serifu::get_num_parts() const
 {
-	return romaji_iterator(kana_begin());
+	return end_part_ - begin_part_;
 }
 
-serifu::romaji_iterator
-serifu::romaji_end() const
+const serifu_part&
+serifu::get_part(size_t index) const
 {
-	return romaji_iterator(kana_end());
+	return arena_->parts[begin_part_ + index];
 }
 
-int
-serifu_part::draw_kana(const font *f, float x, float y, const std::wstring& kana, int num_highlighted, const rgba color[2]) const
+size_t
+serifu::get_num_clusters() const
 {
-	size_t len = 0;
-
-	if (num_highlighted) {
-		while (len < kana.size()) {
-			if (is_kana(kana[len++])) {
-				if (!--num_highlighted)
-					break;
-			}
-		}
-	}
-
-	if (len) {
-		render::set_color(color[0]);
-		x = f->draw_stringn(&kana[0], len, x, y, 0);
-	}
-
-	if (len < kana.size()) {
-		render::set_color(color[1]);
-		f->draw_stringn(&kana[len], kana.size() - len, x, y, 0);
-	}
-
-	return num_highlighted;
+	return end_cluster_ - begin_cluster_;
 }
 
-serifu_kana_part::serifu_kana_part()
-	: kana_font(get_font("data/fonts/small_font.fnt"))
-{ }
-
-int
-serifu_kana_part::get_width() const
+const kana_cluster&
+serifu::get_cluster(size_t index) const
 {
-	return kana_font->get_string_width(&kana[0], kana.size());
+	return arena_->clusters[begin_cluster_ + index];
 }
 
 int
-serifu_kana_part::draw(int num_highlighted, const rgba color[2]) const
+serifu::get_num_strokes() const
 {
-	return draw_kana(kana_font, 0, 0, kana, num_highlighted, color);
+	return get_num_strokes(0);
 }
 
-void
-serifu_kana_part::get_kana_glyph_fx(size_t index, const vec2f& offset, fx_cont& fx_list) const
-{
-	assert(index >= 0 && index < kana.size());
-
-	float x = 0;
-	for (size_t i = 0; i < index; i++)
-		x += kana_font->find_glyph(kana[i])->advance_x;
-
-	fx_list.emplace_back(new glyph_fx(kana_font, kana[index], vec2f(x, 0) + offset));
-}
-
-serifu_furigana_part::serifu_furigana_part()
-	: kanji_font(get_font("data/fonts/small_font.fnt"))
-	  , furigana_font(get_font("data/fonts/tiny_font.fnt"))
-{ }
-
 int
-serifu_furigana_part::get_width() const
+serifu::get_num_strokes(size_t first_cluster) const
 {
-	return std::max(kanji_font->get_string_width(&kanji[0], kanji.size()),
-			furigana_font->get_string_width(&furigana[0], furigana.size()));
+	return arena_->stroke_offsets[end_cluster_] - arena_->stroke_offsets[begin_cluster_ + first_cluster];
 }
 
-int
-serifu_furigana_part::draw(int num_highlighted, const rgba color[2]) const
+serifu::romaji_iterator
+serifu::romaji_begin() const
 {
-	const int width = get_width();
-
-	int num_kana = std::count_if(furigana.begin(), furigana.end(), is_kana);
-
-	render::set_color(color[num_highlighted < num_kana]);
-
-	kanji_font->draw_stringn(&kanji[0], kanji.size(),
-			.5*width - .5*(kanji_font->get_string_width(&kanji[0], kanji.size())), 0, 0);
-
-	return draw_kana(furigana_font,
-			.5*width - .5*(furigana_font->get_string_width(&furigana[0], furigana.size())), 26,
-			furigana, num_highlighted, color);
+	return romaji_iterator(this, 0, pattern_table::END);
 }
 
-void
-serifu_furigana_part::get_kana_glyph_fx(size_t index, const vec2f& offset, fx_cont& fx_list) const
+serifu::romaji_iterator
+serifu::romaji_end() const
 {
-	assert(index >= 0 && index < furigana.size());
-
-	float x = .5*get_width() - .5*(furigana_font->get_string_width(&furigana[0], furigana.size()));
-
-	for (size_t i = 0; i < index; i++)
-		x += furigana_font->find_glyph(furigana[i])->advance_x;
-
-	fx_list.emplace_back(new glyph_fx(furigana_font, furigana[index], offset + vec2f(x, 26)));
-
-	if (index == furigana.size() - 1) {
-		float x = .5*get_width() - .5*(kanji_font->get_string_width(&kanji[0], kanji.size()));
-
-		for (wchar_t ch : kanji) {
-			fx_list.emplace_back(new glyph_fx(kanji_font, ch, offset + vec2f(x, 0)));
-			x += kanji_font->find_glyph(ch)->advance_x;
-		}
-	}
+	return romaji_iterator(this, get_num_clusters(), pattern_table::END);
 }
 
 serifu::kana_iterator::kana_iterator()
+	: arena_(nullptr)
+	, part_(0)
+	, end_part_(0)
+	, pos_(0)
 {
 }
 
-serifu::kana_iterator::kana_iterator(const std::vector<serifu_part_ptr>::const_iterator& it, const std::vector<serifu_part_ptr>::const_iterator& end)
-	: iter_(it)
-	, end_(end) // XXX will remove this
-	, cur_part_index_(0)
-	, base_x_(0)
+serifu::kana_iterator::kana_iterator(const serifu_arena *arena, size_t part, size_t end_part)
+	: arena_(arena)
+	, part_(part)
+	, end_part_(end_part)
+	, pos_(part != end_part ? arena->parts[part].kana_begin : 0)
 {
+	skip_empty_parts();
 	skip_non_kana();
 }
 
@@ -337,13 +727,13 @@ serifu::kana_iterator::operator*() const
 bool
 serifu::kana_iterator::operator!=(const kana_iterator& other) const
 {
-	return iter_ != other.iter_ || cur_part_index_ != other.cur_part_index_;
+	return part_ != other.part_ || pos_ != other.pos_;
 }
 
 serifu::kana_iterator&
 serifu::kana_iterator::operator++()
 {
-	if (iter_ != end_) {
+	if (part_ != end_part_) {
 		next();
 		skip_non_kana();
 	}
@@ -363,44 +753,52 @@ serifu::kana_iterator::skip_non_kana()
 wchar_t
 serifu::kana_iterator::cur_kana() const
 {
-	if (iter_ != end_) {
-		const std::wstring& cur_kana = (*iter_)->get_kana();
-		return cur_kana[cur_part_index_];
-	} else {
-		return L'\0';
-	}
+	return part_ != end_part_ ? arena_->text[pos_] : L'\0';
 }
 
 void
 serifu::kana_iterator::next()
 {
-	if (iter_ != end_) {
-		if (++cur_part_index_ == (*iter_)->get_kana().size()) {
-			base_x_ += (*iter_)->get_width();
-			++iter_;
-			cur_part_index_ = 0;
-		}
+	if (part_ != end_part_) {
+		++pos_;
+		skip_empty_parts();
 	}
 }
 
+// past the kana of a part, on to the next one that has any
 void
-serifu::kana_iterator::get_glyph_fx(fx_cont& fx_list) const
+serifu::kana_iterator::skip_empty_parts()
 {
-	return (*iter_)->get_kana_glyph_fx(cur_part_index_, vec2f(base_x_, 0), fx_list);
+	while (part_ != end_part_ && pos_ == arena_->parts[part_].kana_end) {
+		if (++part_ != end_part_)
+			pos_ = arena_->parts[part_].kana_begin;
+		else
+			pos_ = 0;
+	}
 }
 
-serifu::romaji_iterator::romaji_iterator(const serifu::kana_iterator& kana_it)
-: kana_it_(kana_it)
-, cur_pattern_(nullptr)
+void
+serifu::kana_iterator::get_glyph_fx(fx_cont& fx_list) const
 {
-	consume_kana();
-	skip_optional_pattern();
+	const serifu_part& part = arena_->parts[part_];
+
+	fx_list.emplace_back(arena_->fonts[part.kana_font], arena_->text[pos_], arena_->glyphs[pos_].pen);
+
+	// the kanji flares up with the last of its furigana
+	if (pos_ == part.kana_end - 1) {
+		for (size_t i = part.kanji_begin; i < part.kana_begin; i++)
+			fx_list.emplace_back(arena_->fonts[part.kanji_font], arena_->text[i], arena_->glyphs[i].pen);
+	}
 }
 
-serifu::romaji_iterator::romaji_iterator(const serifu::kana_iterator& kana_it, const pattern_node *cur_pattern)
-	: kana_it_(kana_it)
+serifu::romaji_iterator::romaji_iterator(const serifu *s, size_t next_cluster, pattern_table::state cur_pattern)
+	: serifu_(s)
+	, next_cluster_(next_cluster)
 	, cur_pattern_(cur_pattern)
 {
+	if (!cur_pattern_)
+		consume_cluster();
+
 	skip_optional_pattern();
 }
 
@@ -418,33 +816,32 @@ serifu::romaji_iterator::operator++()
 char
 serifu::romaji_iterator::operator*() const
 {
-	return cur_pattern_ ? cur_pattern_->get_char() : 0;
+	return cur_pattern_ ? kana::get_patterns().get_char(cur_pattern_) : 0;
 }
 
 bool
 serifu::romaji_iterator::operator!=(const serifu::romaji_iterator& other) const
 {
-	return kana_it_ != other.kana_it_ || cur_pattern_ != other.cur_pattern_;
+	return next_cluster_ != other.next_cluster_ || cur_pattern_ != other.cur_pattern_;
 }
 
 void
 serifu::romaji_iterator::next()
 {
-	if ((cur_pattern_ = cur_pattern_->next) == nullptr)
-		consume_kana();
+	if ((cur_pattern_ = kana::get_patterns().next(cur_pattern_)) == pattern_table::END)
+		consume_cluster();
 }
 
 void
-serifu::romaji_iterator::consume_kana()
+serifu::romaji_iterator::consume_cluster()
 {
-	int consumed;
-	std::tie(cur_pattern_, consumed) = kana::find_pattern(kana_it_);
-	std::advance(kana_it_, consumed);
+	if (next_cluster_ < serifu_->get_num_clusters())
+		cur_pattern_ = serifu_->get_cluster(next_cluster_++).pattern;
 }
 
 void
 serifu::romaji_iterator::skip_optional_pattern()
 {
-	while (cur_pattern_ && cur_pattern_->is_optional)
+	while (cur_pattern_ && kana::get_patterns().is_optional(cur_pattern_))
 		next();
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <memory>
@@ -8,77 +9,45 @@
 
 #include "rgba.h"
 #include "vec2.h"
+#include "font.h"
+#include "pattern.h"
 
-struct font;
 struct glyph_fx;
 
 namespace gl {
 class texture;
 }
 
-using fx_cont = std::vector<std::unique_ptr<glyph_fx>>;
+using fx_cont = std::vector<glyph_fx>;
 
+class serifu_arena;
+
+// a run of kana, or of kanji with furigana over it. its text is in the
+// arena: the kanji (empty for kana) and then the kana.
 struct serifu_part
 {
-	serifu_part() { }
-	virtual ~serifu_part() { }
+	enum kind_type : uint8_t { KANA, FURIGANA };
 
-	virtual const std::wstring& get_kana() const = 0;
-	virtual int get_width() const = 0;
-	virtual int draw(int num_highlighted, const rgba color[2]) const = 0;
-	virtual void get_kana_glyph_fx(size_t index, const vec2f& offset, fx_cont& cont) const = 0;
+	kind_type kind;
+	uint8_t kanji_font, kana_font; // in serifu_arena::fonts
+	uint16_t num_kana; // the kanji is highlighted once they're typed
 
-	int draw_kana(const font *f, float x, float y, const std::wstring& kana, int num_highlighted, const rgba color[2]) const;
+	uint32_t kanji_begin, kana_begin, kana_end;
 };
 
-using serifu_part_ptr = std::unique_ptr<serifu_part>;
-
-struct serifu_kana_part : serifu_part
+// kana typed as a unit, like ちゃ, and the start state of its pattern
+struct kana_cluster
 {
-	serifu_kana_part();
-
-	const std::wstring& get_kana() const override
-	{ return kana; }
-
-	int get_width() const override;
-
-	int draw(int num_highlighted, const rgba color[2]) const override;
-
-	void get_kana_glyph_fx(size_t index, const vec2f& offset, fx_cont& cont) const override;
-
-	std::wstring kana;
-	const font *kana_font;
+	pattern_table::state pattern;
+	int num_kana;
 };
 
-struct serifu_furigana_part : serifu_part
-{
-	serifu_furigana_part();
-
-	const std::wstring& get_kana() const override
-	{ return furigana; }
-
-	int get_width() const override;
-
-	int draw(int num_highlighted, const rgba color[2]) const override;
+// a line of the lyrics; its parts, clusters and glyphs are ranges in the
+// arena it was added to
 
-	void get_kana_glyph_fx(size_t index, const vec2f& offset, fx_cont& cont) const override;
-
-	std::wstring kanji;
-	std::wstring furigana;
-
-	const font *kanji_font;
-	const font *furigana_font;
-};
-
-struct pattern_node;
-
-struct serifu
+class serifu
 {
 public:
-	serifu(int duration);
-
-	bool parse(const std::wstring& text);
-
 	void draw(int num_highlighted, const rgba color[2]) const;
 
 	int duration() const;
@@ -87,7 +56,7 @@ public:
 	{
 	public:
 		kana_iterator();
-		kana_iterator(const std::vector<serifu_part_ptr>::const_iterator& it, const std::vector<serifu_part_ptr>::const_iterator& end);
+		kana_iterator(const serifu_arena *arena, size_t part, size_t end_part);
 
 		wchar_t operator*() const;
 
@@ -99,22 +68,38 @@ public:
 
 	private:
 		void next();
+		void skip_empty_parts();
 		void skip_non_kana();
 		wchar_t cur_kana() const;
 
-		std::vector<serifu_part_ptr>::const_iterator iter_, end_;
-		size_t cur_part_index_;
-		float base_x_;
+		const serifu_arena *arena_;
+		size_t part_, end_part_;
+		size_t pos_; // in the arena's text
 	};
 
 	kana_iterator kana_begin() const;
 	kana_iterator kana_end() const;
 
+	size_t get_num_parts() const;
+	const serifu_part& get_part(size_t index) const;
+
+	// the clusters up to the end of the line, or to the first kana without
+	// a pattern
+	size_t get_num_clusters() const;
+	const kana_cluster& get_cluster(size_t index) const;
+
+	// romaji needed to type the whole line, typing the keys shown
+	int get_num_strokes() const;
+
+	// romaji needed to type the clusters from first_cluster on
+	int get_num_strokes(size_t first_cluster) const;
+
 	struct romaji_iterator : public std::iterator<std::forward_iterator_tag, char>
 	{
 	public:
-		romaji_iterator(const kana_iterator& kana_it);
-		romaji_iterator(const kana_iterator& kana_it, const pattern_node *cur_pattern);
+		// cur_pattern is in the cluster before next_cluster, or
+		// pattern_table::END to start at next_cluster
+		romaji_iterator(const serifu *s, size_t next_cluster, pattern_table::state cur_pattern);
 
 		char operator*() const;
 
@@ -125,24 +110,74 @@ public:
 	private:
 		void next();
 		void skip_optional_pattern();
-		void consume_kana();
+		void consume_cluster();
 
-		serifu::kana_iterator kana_it_;
-		const pattern_node *cur_pattern_;
+		const serifu *serifu_;
+		size_t next_cluster_;
+		pattern_table::state cur_pattern_;
 	};
 
 	romaji_iterator romaji_begin() const;
 	romaji_iterator romaji_end() const;
 
 private:
+	serifu(const serifu_arena *arena, int duration);
+
+	const serifu_arena *arena_;
 	int duration_;
-	std::vector<serifu_part_ptr> section_list;
+	uint32_t begin_part_, end_part_;
+	uint32_t begin_cluster_, end_cluster_;
 
-	friend class kana_iterator;
+	friend class serifu_arena;
 };
 
-using serifu_ptr = std::unique_ptr<serifu>;
+// the lyrics of a song, in a few flat arrays shared by all its serifu
+// rather than in objects of their own
+
+class serifu_arena : private boost::noncopyable
+{
+public:
+	serifu_arena();
+
+	// what's wrong with a line, and where
+	struct syntax_error
+	{
+		const char *pos;
+		const char *what;
+	};
+
+	// parses a line like "(漢|かん)じ" in UTF-8, decoding it straight into
+	// the text buffer. a malformed one keeps the parts before the error.
+	bool add_serifu(int duration, const char *line, const char *end, syntax_error& error);
+
+	// lays out every glyph; needs the fonts, so only on the GL thread
+	void layout();
+
+	void clear();
 
+	using const_iterator = std::vector<serifu>::const_iterator;
+
+	const_iterator begin() const { return serifus_.begin(); }
+	const_iterator end() const { return serifus_.end(); }
+
+	bool empty() const
+	{ return serifus_.empty(); }
+
+	enum { SMALL_FONT, TINY_FONT, NUM_FONTS };
+
+	std::wstring text; // every part's text, back to back
+	std::vector<serifu_part> parts;
+	std::vector<kana_cluster> clusters;
+	std::vector<int> stroke_offsets; // romaji before each cluster, then the total
+	std::vector<font::laid_out_glyph> glyphs; // one per character of text, after layout()
+	const font *fonts[NUM_FONTS];
+
+private:
+	void init_clusters(serifu& s);
+
+	std::vector<serifu> serifus_;
+	std::vector<wchar_t> kana_; // used by init_clusters
+};
 
 class kashi : private boost::noncopyable
 {
@@ -150,31 +185,40 @@ public:
 	kashi();
 	~kashi();
 
+	// reads the song info and works out the level. doesn't touch GL, so
+	// it can run on any thread; the lyrics aren't kept.
 	bool load(const std::string& path);
 
-	using serifu_cont = std::vector<serifu_ptr>;
-	using iterator = serifu_cont::iterator;
-	using const_iterator = serifu_cont::const_iterator;
+	// parses and lays out the lyrics, before the song is played
+	bool load_lyrics();
+
+	// nullptr until it's been loaded in the background
+	const gl::texture *get_background() const;
+
+	using const_iterator = serifu_arena::const_iterator;
 
-	iterator begin() { return serifu_list.begin(); }
-	iterator end() { return serifu_list.end(); }
+	const_iterator begin() const { return lyrics_.begin(); }
+	const_iterator end() const { return lyrics_.end(); }
 
-	const_iterator begin() const { return serifu_list.begin(); }
-	const_iterator end() const { return serifu_list.end(); }
+	// empty until load_lyrics()
+	const serifu_arena& get_lyrics() const
+	{ return lyrics_; }
 
 	std::wstring name;
 	std::wstring artist;
 	std::wstring genre;
 
 	int level;
+	int num_strokes; // romaji needed to type the whole song
 
+	std::string path;
 	std::string stream;
-	const gl::texture *background;
+	std::string background_path;
 
 private:
-	void init_level();
+	void init_level(const serifu_arena& lyrics);
 
-	serifu_cont serifu_list;
+	serifu_arena lyrics_;
 };
 
 using kashi_ptr = std::unique_ptr<kashi>;
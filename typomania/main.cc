@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
 #include <cassert>
 #include <cstring>
@@ -6,6 +7,10 @@
 
 #include <sstream>
 #include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
 
 #include <SDL.h>
 
@@ -18,16 +23,37 @@
 #include "render.h"
 #include "sfx.h"
 #include "common.h"
+#include "image.h"
+#include "gl_check.h"
+#include "gl_framebuffer.h"
+#include "gl_timer.h"
+#include "headless_context.h"
+#include "game_clock.h"
+#include "kashi.h"
+#include "replay.h"
+#include "in_game_state.h"
 #include "game.h"
 
 class game_app
 {
 public:
-	game_app(int window_width, int window_height);
+	game_app(int window_width, int window_height, bool headless);
 	~game_app();
 
 	void event_loop();
 
+	// runs num_frames fixed-rate tics with no window, rendering offscreen;
+	// prints per-frame timings and optionally dumps each frame as a PNG
+	void run_headless(int num_frames, const char *dump_dir);
+
+	// plays back a recorded replay on virtual time as fast as possible,
+	// prints update/redraw timings per tic and checks the final counters
+	// against the recorded ones. returns false if they don't match.
+	bool run_replay(const char *replay_path);
+
+	void set_recording(replay *r)
+	{ game_->set_recording(r); }
+
 private:
 	void redraw();
 	void handle_events();
@@ -35,35 +61,68 @@ private:
 	void init_sdl(int window_width, int window_height);
 	void release_sdl();
 
+	void init_glew();
+
 	void init_openal();
 	void release_openal();
 
+	void dump_frame(const char *dump_dir, int frame) const;
+
+	// underruns of the songs played with music, if any
+	void print_audio_stats() const;
+
 	bool running_;
+	bool headless_;
+
+	int window_width_;
+	int window_height_;
 
 	ALCdevice *al_device_;
 	ALCcontext *al_context_;
 
+	std::unique_ptr<headless_context> headless_context_;
+
+	std::unique_ptr<gl::framebuffer> offscreen_framebuffer_;
+
 	std::unique_ptr<game> game_;
 };
 
-game_app::game_app(int window_width, int window_height)
+game_app::game_app(int window_width, int window_height, bool headless)
 	: running_ { false }
+	, headless_ { headless }
+	, window_width_ { window_width }
+	, window_height_ { window_height }
 {
-	init_sdl(window_width, window_height);
+	if (headless_)
+		headless_context_.reset(new headless_context);
+	else
+		init_sdl(window_width, window_height);
+
 	init_openal();
 
 	render::init();
 	sfx::init();
 
+	if (headless_) {
+		offscreen_framebuffer_.reset(new gl::framebuffer(window_width, window_height));
+		offscreen_framebuffer_->set_as_default();
+		gl::framebuffer::unbind();
+	}
+
 	game_.reset(new game(window_width, window_height));
 }
 
 game_app::~game_app()
 {
 	game_.reset(nullptr);
+	offscreen_framebuffer_.reset(nullptr);
 
 	release_openal();
-	release_sdl();
+
+	if (headless_)
+		headless_context_.reset(nullptr);
+	else
+		release_sdl();
 }
 
 void
@@ -77,8 +136,7 @@ game_app::init_sdl(int window_width, int window_height)
 
 	SDL_WM_SetCaption("typomania", nullptr);
 
-	if (GLenum rv = glewInit())
-		panic("glewInit: %s", glewGetErrorString(rv));
+	init_glew();
 }
 
 void
@@ -87,6 +145,14 @@ game_app::release_sdl()
 	SDL_Quit();
 }
 
+void
+game_app::init_glew()
+{
+	GLenum rv = glewInit();
+	if (rv != GLEW_OK)
+		panic("glewInit: %s", glewGetErrorString(rv));
+}
+
 void
 game_app::init_openal()
 {
@@ -166,8 +232,279 @@ game_app::event_loop()
 	}
 }
 
+void
+game_app::run_headless(int num_frames, const char *dump_dir)
+{
+	using clock = std::chrono::steady_clock;
+
+	auto elapsed_ms = [](clock::time_point from, clock::time_point to)
+		{
+			return std::chrono::duration<double, std::milli>(to - from).count();
+		};
+
+	gl::timer gpu_timer;
+
+	double total_update_ms = 0, total_redraw_ms = 0, total_gpu_ms = 0;
+
+	for (int frame = 0; frame < num_frames; frame++) {
+		const auto t0 = clock::now();
+
+		game_->update();
+
+		const auto t1 = clock::now();
+
+		gpu_timer.begin();
+		game_->redraw();
+		gpu_timer.end();
+
+		const auto t2 = clock::now();
+
+		const double update_ms = elapsed_ms(t0, t1);
+		const double redraw_ms = elapsed_ms(t1, t2);
+		// doesn't wait for the GPU, so it may be a frame or two behind
+		const double gpu_ms = gpu_timer.get_elapsed_ms();
+
+		total_update_ms += update_ms;
+		total_redraw_ms += redraw_ms;
+		total_gpu_ms += gpu_ms;
+
+		if (dump_dir)
+			dump_frame(dump_dir, frame);
+
+		// stats for a frame are available once the next one starts
+		render::begin_frame();
+		const render::frame_stats& stats = render::get_last_frame_stats();
+
+		printf("frame %d: update %.3f ms, redraw %.3f ms, gpu %.3f ms, %d draw calls, %zu bytes uploaded, %d uniform uploads skipped, %d/%d state changes issued\n",
+			frame, update_ms, redraw_ms, gpu_ms, stats.draw_calls, stats.bytes_uploaded, stats.skipped_uniform_uploads,
+			stats.state_changes, stats.state_changes + stats.state_changes_elided);
+	}
+
+	if (num_frames > 0) {
+		printf("average: update %.3f ms, redraw %.3f ms, gpu %.3f ms\n",
+			total_update_ms/num_frames, total_redraw_ms/num_frames, total_gpu_ms/num_frames);
+	}
+
+	print_audio_stats();
+}
+
+bool
+game_app::run_replay(const char *replay_path)
+{
+#ifndef MUTE
+	// with music the song clock is the audio device's, which can't be
+	// made to run faster than real time
+	panic("replays need a build with MUTE defined");
+#endif
+
+	replay r;
+
+	if (!r.load(replay_path))
+		panic("failed to load replay %s", replay_path);
+
+	kashi cur_kashi;
+
+	if (!cur_kashi.load(r.kashi_path))
+		panic("failed to load %s", r.kashi_path.c_str());
+
+	using clock = std::chrono::steady_clock;
+
+	auto elapsed_ms = [](clock::time_point from, clock::time_point to)
+		{
+			return std::chrono::duration<double, std::milli>(to - from).count();
+		};
+
+	unsigned tic = 0;
+	game_clock::set_virtual_ms(0);
+
+	in_game_state *state = game_->enter_in_game_state(cur_kashi);
+
+	if (r.song_duration)
+		state->set_song_duration(r.song_duration);
+
+	auto next_event = r.events.begin();
+
+	double total_update_ms = 0, total_redraw_ms = 0, total_glow_gpu_ms = 0;
+	double max_update_ms = 0, max_redraw_ms = 0;
+	unsigned glow_tics = 0;
+
+	const auto start = clock::now();
+
+	while (!state->is_finished()) {
+		// keystrokes are delivered at the start of the first tic that
+		// reaches their song time
+
+		if (state->is_playing()) {
+			const unsigned song_ms = state->get_song_ms();
+
+			for (; next_event != r.events.end() && next_event->song_ms <= song_ms; ++next_event)
+				game_->on_key_down(next_event->keysym);
+		}
+
+		const auto t0 = clock::now();
+
+		game_->update();
+
+		const auto t1 = clock::now();
+
+		game_->redraw();
+		GL_CHECK(glFinish());
+		const auto t2 = clock::now();
+
+		const double update_ms = elapsed_ms(t0, t1);
+		const double redraw_ms = elapsed_ms(t1, t2);
+		const double glow_gpu_ms = state->get_glow_gpu_ms();
+
+		printf("tic %u: update %.3f ms, redraw %.3f ms, glow gpu %.3f ms\n", tic, update_ms, redraw_ms, glow_gpu_ms);
+
+		total_update_ms += update_ms;
+		total_redraw_ms += redraw_ms;
+		total_glow_gpu_ms += glow_gpu_ms;
+
+		if (state->is_glow_drawn())
+			++glow_tics;
+
+		max_update_ms = std::max(max_update_ms, update_ms);
+		max_redraw_ms = std::max(max_redraw_ms, redraw_ms);
+
+		++tic;
+		game_clock::set_virtual_ms(tic*1000/TICS_PER_SECOND);
+	}
+
+	const double wall_ms = elapsed_ms(start, clock::now());
+
+	printf("%u tics (%.1f s of game time) in %.1f s\n", tic, static_cast<double>(tic)/TICS_PER_SECOND, 1e-3*wall_ms);
+	printf("update: average %.3f ms, max %.3f ms\n", total_update_ms/tic, max_update_ms);
+	printf("redraw: average %.3f ms, max %.3f ms\n", total_redraw_ms/tic, max_redraw_ms);
+	printf("glow gpu: average %.3f ms, drawn on %u tics\n", total_glow_gpu_ms/tic, glow_tics);
+
+	if (next_event != r.events.end())
+		printf("warning: %zu keystrokes left over\n", static_cast<size_t>(r.events.end() - next_event));
+
+	const replay::results results = state->get_results();
+
+	printf("score %d, max combo %d, miss %d\n", results.score, results.max_combo, results.miss);
+
+	game_->leave_state();
+
+	print_audio_stats();
+
+	if (r.has_results && !(results == r.final_results)) {
+		const replay::results& expected = r.final_results;
+		printf("MISMATCH: expected score %d, max combo %d, miss %d\n", expected.score, expected.max_combo, expected.miss);
+		return false;
+	}
+
+	return true;
+}
+
+void
+game_app::print_audio_stats() const
+{
+	const game::audio_stats& stats = game_->get_audio_stats();
+
+	if (stats.num_songs > 0)
+		printf("audio: %d songs, %d underruns, min ring fill %.2f\n", stats.num_songs, stats.num_underruns, stats.min_ring_fill);
+}
+
+void
+game_app::dump_frame(const char *dump_dir, int frame) const
+{
+	image frame_image(window_width_, window_height_);
+
+	GL_CHECK(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+	GL_CHECK(glReadPixels(0, 0, window_width_, window_height_, GL_RGBA, GL_UNSIGNED_BYTE, frame_image.get_bits()));
+
+	// GL's first row is the bottom one
+	frame_image.flip_vertically();
+
+	std::ostringstream path;
+	path << dump_dir << "/frame-";
+	path.width(5);
+	path.fill('0');
+	path << frame << ".png";
+
+	if (!frame_image.save(path.str()))
+		panic("failed to save %s: %s", path.str().c_str(), strerror(errno));
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [options]\n", argv0);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Options are:\n");
+	fprintf(stderr, "  -o  headless, render offscreen with no window\n");
+	fprintf(stderr, "  -n  number of frames to run in headless mode\n");
+	fprintf(stderr, "  -d  dump headless frames as PNGs to this directory\n");
+	fprintf(stderr, "  -r  play back a replay headless and check its results\n");
+	fprintf(stderr, "  -w  record the keystrokes of the last song played to a replay\n");
+	fprintf(stderr, "  -h  show usage\n");
+
+	exit(1);
+}
+
 int
 main(int argc, char *argv[])
 {
-	game_app(800, 400).event_loop();
+	bool headless = false;
+	int num_frames = 600;
+	const char *dump_dir = nullptr;
+	const char *replay_path = nullptr;
+	const char *record_path = nullptr;
+
+	int c;
+
+	while ((c = getopt(argc, argv, "on:d:r:w:h")) != EOF) {
+		char *after;
+
+		switch (c) {
+			case 'o':
+				headless = true;
+				break;
+
+			case 'n':
+				num_frames = strtol(optarg, &after, 10);
+				if (after == optarg)
+					usage(*argv);
+				break;
+
+			case 'd':
+				dump_dir = optarg;
+				break;
+
+			case 'r':
+				replay_path = optarg;
+				headless = true;
+				break;
+
+			case 'w':
+				record_path = optarg;
+				break;
+
+			default:
+				usage(*argv);
+				break;
+		}
+	}
+
+	game_app app(800, 400, headless);
+
+	if (replay_path)
+		return app.run_replay(replay_path) ? 0 : 1;
+
+	replay recording;
+
+	if (record_path)
+		app.set_recording(&recording);
+
+	if (headless)
+		app.run_headless(num_frames, dump_dir);
+	else
+		app.event_loop();
+
+	if (record_path && !recording.kashi_path.empty()) {
+		if (!recording.save(record_path))
+			panic("failed to save replay %s", record_path);
+	}
 }
@@ -1,11 +1,19 @@
 #include <cassert>
 #include <cstring>
 
+#include <chrono>
+
 #include "panic.h"
 #include "ogg_player.h"
 
 ogg_player::ogg_player()
-: playing(false)
+: processed_samples(0)
+, last_samples_played(0)
+, decoding(false)
+, decoded_all(false)
+, playing(false)
+, num_underruns(0)
+, min_ring_fill(1)
 {
 	alGenSources(1, &source);
 	set_gain(1);
@@ -31,10 +39,12 @@ ogg_player::open(const std::string& path)
 	switch (info->channels) {
 		case 1:
 			format = AL_FORMAT_MONO16;
+			frame_size = sizeof(int16_t);
 			break;
 
 		case 2:
 			format = AL_FORMAT_STEREO16;
+			frame_size = 2*sizeof(int16_t);
 			break;
 
 		default:
@@ -44,6 +54,8 @@ ogg_player::open(const std::string& path)
 	rate = info->rate;
 
 	num_samples = ov_pcm_total(&ogg_stream, -1);
+
+	ring.resize(DECODE_AHEAD_SECONDS*rate*frame_size);
 }
 
 void
@@ -75,17 +87,26 @@ ogg_player::start()
 	if (playing)
 		return;
 
-	for (int i = 0; i < NUM_BUFFERS; i++) {
-		buffer& b = buffers[i];
+	start_decoder();
 
-		if (b.load(&ogg_stream) > 0)
-			b.queue(source, format, rate);
-	}
+	// give the decoder a head start so the initial queue is full
+
+	while (!decoded_all && ring.size() < NUM_BUFFERS*buffer::BUFFER_SIZE)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	next_free = 0;
+	num_free = NUM_BUFFERS;
+	queue_free_buffers();
+
+	processed_samples = last_samples_played = 0;
 
 	alSourcePlay(source);
 
 	playing = true;
 	fading_out = false;
+
+	num_underruns = 0;
+	min_ring_fill = get_ring_fill();
 }
 
 void
@@ -94,6 +115,11 @@ ogg_player::stop()
 	if (!playing)
 		return;
 
+	// freeze the clock where playback stopped; the buffers unqueued
+	// below were never heard
+
+	processed_samples = get_samples_played();
+
 	alSourceStop(source);
 
 	ALint num_processed;
@@ -102,6 +128,8 @@ ogg_player::stop()
 		alSourceUnqueueBuffers(source, 1, &id);
 	}
 
+	stop_decoder();
+
 	ov_raw_seek(&ogg_stream, 0);
 
 	playing = false;
@@ -122,11 +150,19 @@ ogg_player::update()
 
 		alSourceUnqueueBuffers(source, 1, &id);
 
-		buffer *p = get_buffer(id);
-		if (p->load(&ogg_stream) > 0)
-			p->queue(source, format, rate);
+		const buffer& b = buffers[(next_free + num_free)%NUM_BUFFERS];
+		assert(id == b.id);
+
+		processed_samples += b.size/frame_size;
+		++num_free;
 	}
 
+	const float fill = get_ring_fill();
+	if (fill < min_ring_fill)
+		min_ring_fill = fill;
+
+	queue_free_buffers();
+
 	if (state == AL_PLAYING && fading_out) {
 		if (++fade_out_tics >= fade_out_ttl) {
 			stop();
@@ -143,71 +179,119 @@ ogg_player::update()
 		alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
 
 		if (queued == 0) {
-			// we're done
-			playing = false;
+			if (decoded_all && ring.empty()) {
+				// we're done
+				stop_decoder();
+				playing = false;
+			}
 		} else {
-			// restart
+			// ran dry, restart
+			++num_underruns;
 			alSourcePlay(source);
 		}
 	}
 }
 
-int
-ogg_player::get_num_buffer_samples() const
+void
+ogg_player::queue_free_buffers()
 {
-	switch (format) {
-		case AL_FORMAT_MONO16:
-			return buffer::BUFFER_SIZE/sizeof(int16_t);
+	while (num_free > 0) {
+		buffer& b = buffers[next_free];
 
-		case AL_FORMAT_STEREO16:
-			return buffer::BUFFER_SIZE/(2*sizeof(int16_t));
+		if (b.load(ring, frame_size) == 0)
+			break;
 
-		default:
-			assert(0);
-			return 0;
+		b.queue(source, format, rate);
+
+		next_free = (next_free + 1)%NUM_BUFFERS;
+		--num_free;
 	}
 }
 
-ogg_player::buffer *
-ogg_player::get_buffer(ALuint id)
+void
+ogg_player::start_decoder()
 {
-	for (int i = 0; i < NUM_BUFFERS; i++) {
-		buffer *p = &buffers[i];
-		if (p->id == id)
-			return p;
-	}
+	ring.clear();
 
-	panic("eh? invalid buffer %d?", id);
-	return 0;
-}
+	decoded_all = false;
+	decoding = true;
 
-ogg_player::buffer::buffer()
-{
-	alGenBuffers(1, &id);
+	decoder = std::thread(&ogg_player::decode_loop, this);
 }
 
-ogg_player::buffer::~buffer()
+void
+ogg_player::stop_decoder()
 {
-	alDeleteBuffers(1, &id);
+	decoding = false;
+
+	if (decoder.joinable())
+		decoder.join();
 }
 
-long
-ogg_player::buffer::load(OggVorbis_File *stream)
+void
+ogg_player::decode_loop()
 {
-	size = 0;
+	char data[DECODE_CHUNK_SIZE];
+
+	while (decoding) {
+		if (ring.write_available() < sizeof data) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(DECODE_SLEEP_MS));
+			continue;
+		}
 
-	while (size < BUFFER_SIZE) {
 		int section;
-		long r = ov_read(stream, data + size, BUFFER_SIZE - size, 0, 2, 1, &section);
+		long r = ov_read(&ogg_stream, data, sizeof data, 0, 2, 1, &section);
 
 		if (r < 0)
 			panic("ov_read failed");
 		else if (r == 0)
 			break;
 
-		size += r;
+		ring.write(data, r);
+	}
+
+	decoded_all = true;
+}
+
+unsigned long
+ogg_player::get_samples_played() const
+{
+	unsigned long samples = processed_samples;
+
+	if (playing) {
+		// offset into the first buffer still queued
+		ALint offset;
+		alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+		samples += offset;
 	}
 
+	// the offset drops to 0 when the source runs dry before the
+	// processed buffers are unqueued; don't let the clock go backwards
+
+	if (samples < last_samples_played)
+		samples = last_samples_played;
+
+	return last_samples_played = samples;
+}
+
+ogg_player::buffer::buffer()
+{
+	alGenBuffers(1, &id);
+}
+
+ogg_player::buffer::~buffer()
+{
+	alDeleteBuffers(1, &id);
+}
+
+long
+ogg_player::buffer::load(pcm_ring& ring, int frame_size)
+{
+	const size_t available = ring.size();
+
+	size = std::min<size_t>(BUFFER_SIZE, available - available%frame_size);
+	ring.read(data, size);
+
 	return size;
 }
 
@@ -3,11 +3,15 @@
 
 #include <string>
 #include <cstdio>
+#include <thread>
+#include <atomic>
 
 #include <AL/alc.h>
 #include <AL/al.h>
 #include <vorbis/vorbisfile.h>
 
+#include "pcm_ring.h"
+
 class ogg_player
 {
 	friend class spectrum_bars;
@@ -30,17 +34,39 @@ public:
 	float get_track_duration() const
 	{ return static_cast<float>(num_samples)/rate; }
 
+	int get_rate() const
+	{ return rate; }
+
+	// monotonic count of samples actually played since start()
+	unsigned long get_samples_played() const;
+
+	unsigned get_ms_played() const
+	{ return static_cast<unsigned long long>(get_samples_played())*1000/rate; }
+
+	// times the AL queue ran dry and the source had to be restarted
+	int get_num_underruns() const
+	{ return num_underruns; }
+
+	// decoded audio ready to be queued, 0-1
+	float get_ring_fill() const
+	{ return static_cast<float>(ring.size())/ring.capacity(); }
+
+	// lowest ring fill seen by update() since start()
+	float get_min_ring_fill() const
+	{ return min_ring_fill; }
+
 private:
-	int get_num_buffer_samples() const;
+	void decode_loop();
+	void start_decoder();
+	void stop_decoder();
 
-	struct buffer;
-	buffer *get_buffer(ALuint id);
+	void queue_free_buffers();
 
 	struct buffer {
 		buffer();
 		~buffer();
 
-		long load(OggVorbis_File *stream);
+		long load(pcm_ring& ring, int frame_size);
 		void queue(ALuint source, ALenum format, int rate);
 
 		enum { BUFFER_SIZE = 2*8192 };
@@ -54,6 +80,26 @@ private:
 	enum { NUM_BUFFERS = 4, };
 	buffer buffers[NUM_BUFFERS];
 
+	// buffers are always queued round-robin, so the unqueued ones are
+	// buffers[next_free], buffers[next_free + 1], ... (mod NUM_BUFFERS)
+	int next_free;
+	int num_free;
+
+	// samples in buffers already played and unqueued
+	unsigned long processed_samples;
+	mutable unsigned long last_samples_played;
+
+	enum {
+		DECODE_AHEAD_SECONDS = 4,
+		DECODE_CHUNK_SIZE = 4096,
+		DECODE_SLEEP_MS = 5,
+	};
+
+	pcm_ring ring;
+	std::thread decoder;
+	std::atomic<bool> decoding;
+	std::atomic<bool> decoded_all;
+
 	FILE *ogg_file;
 	OggVorbis_File ogg_stream;
 
@@ -61,6 +107,7 @@ private:
 
 	ALenum format;
 	int rate;
+	int frame_size;
 	int num_samples;
 
 	float gain;
@@ -69,6 +116,9 @@ private:
 
 	bool fading_out;
 	int fade_out_tics, fade_out_ttl;
+
+	int num_underruns;
+	float min_ring_fill;
 };
 
 #endif // OGG_PLAYER_H_
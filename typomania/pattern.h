@@ -1,43 +1,147 @@
 #pragma once
 
-#include <vector>
-#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 
-struct pattern_node
+// the romaji that can be typed for a kana, like "[TC]H?I" for ち: a
+// sequence of positions, each one either a single key or a set of keys in
+// brackets, and optional if followed by '?'.
+//
+// every pattern is compiled into one flat DFA, at compile time (see
+// kana.cc). a state is a position in one of the patterns, and typing a
+// key is a lookup in the state's row of the transition table.
+
+namespace pattern_syntax {
+
+// constexpr helpers to walk a pattern string. a malformed pattern makes
+// them throw, which fails the build when they're evaluated at compile time.
+
+constexpr const char *
+skip_set(const char *p)
 {
-	pattern_node() : is_optional(false), next(0) { }
-	virtual ~pattern_node() { if (next) delete next; }
+	return *p == ']' ? p + 1 : *p == '\0' ? throw "unterminated set" : skip_set(p + 1);
+}
 
-	virtual bool match(int keysym) const = 0;
-	virtual int get_char() const = 0;
+constexpr const char *
+skip_key(const char *p)
+{
+	return *p == '[' ? skip_set(p + 1) : p + 1;
+}
 
-	bool is_optional;
-	pattern_node *next;
-};
+// past the position starting at p, including its '?'
+constexpr const char *
+skip_position(const char *p)
+{
+	return *skip_key(p) == '?' ? skip_key(p) + 1 : skip_key(p);
+}
+
+constexpr int
+get_length(const char *pattern)
+{
+	return *pattern == '\0' ? 0 : 1 + get_length(skip_position(pattern));
+}
 
-struct single_char_node : pattern_node
+constexpr const char *
+get_position(const char *pattern, int index)
 {
-	single_char_node(int ch) : ch(ch) { }
+	return index == 0 ? pattern : get_position(skip_position(pattern), index - 1);
+}
 
-	bool match(int keysym) const override
-	{ return ch == keysym; }
+constexpr bool
+set_contains(const char *p, int keysym)
+{
+	return *p != ']' && (*p == keysym || set_contains(p + 1, keysym));
+}
 
-	int get_char() const override
-	{ return ch; }
+constexpr bool
+matches(const char *position, int keysym)
+{
+	return *position == '[' ? set_contains(position + 1, keysym) : *position == keysym;
+}
 
-	int ch;
-};
+// the key shown for a position, the first one in a set
+constexpr char
+get_char(const char *position)
+{
+	return *position == '[' ? position[1] : *position;
+}
 
-struct multi_char_node : pattern_node
+constexpr bool
+is_optional(const char *position)
 {
-	bool match(int keysym) const override
-	{ return std::find(char_list.begin(), char_list.end(), keysym) != char_list.end(); }
+	return *skip_key(position) == '?';
+}
 
-	int get_char() const override
-	{ return char_list[0]; }
+}
 
-	std::vector<int> char_list;
-};
+class pattern_table
+{
+public:
+	using state = uint16_t;
 
-pattern_node *
-parse_pattern(const char *pattern_str);
+	// no pattern, or the end of one once it's been typed
+	static const state END = 0;
+
+	// returned by next() for a key that doesn't match
+	static const state REJECT = 0xffff;
+
+	// keys are mapped to columns of the transition table: A-Z, 0-9 and -
+	enum { NUM_SYMBOLS = 26 + 10 + 1 };
+
+	static constexpr int
+	get_symbol(int keysym)
+	{
+		return keysym >= 'A' && keysym <= 'Z' ? keysym - 'A'
+			: keysym >= '0' && keysym <= '9' ? 26 + keysym - '0'
+			: keysym == '-' ? 36
+			: -1;
+	}
+
+	static constexpr char
+	get_key(int symbol)
+	{
+		return "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-"[symbol];
+	}
+
+	struct state_info
+	{
+		char ch;
+		bool is_optional;
+		uint8_t num_strokes; // to the end of the pattern, without optional keys
+	};
+
+	constexpr pattern_table(const state_info *states, const state *transitions, size_t num_states)
+	: states_(states), transitions_(transitions), num_states_(num_states)
+	{ }
+
+	// keysym is matched as is, so letters must be upper case. an optional
+	// key that doesn't match is skipped if the one after it does.
+	state next(state s, int keysym) const
+	{
+		const int symbol = get_symbol(keysym);
+		return symbol != -1 ? transitions_[s*NUM_SYMBOLS + symbol] : REJECT;
+	}
+
+	// the key shown for a state
+	char get_char(state s) const
+	{ return states_[s].ch; }
+
+	bool is_optional(state s) const
+	{ return states_[s].is_optional; }
+
+	// keys left to type from a state, typing the keys shown
+	int get_num_strokes(state s) const
+	{ return states_[s].num_strokes; }
+
+	// state reached by typing the key shown
+	state next(state s) const
+	{ return next(s, get_char(s)); }
+
+	size_t get_num_states() const
+	{ return num_states_; }
+
+private:
+	const state_info *states_;
+	const state *transitions_; // NUM_SYMBOLS per state
+	size_t num_states_;
+};
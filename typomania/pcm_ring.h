@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+#include <boost/noncopyable.hpp>
+
+// single-producer/single-consumer lock-free byte ring. one thread may call
+// write(), another thread may call read(); everything else must only be
+// called while neither side is active.
+
+class pcm_ring : private boost::noncopyable
+{
+public:
+	pcm_ring()
+	: mask_(0), head_(0), tail_(0)
+	{ }
+
+	void resize(size_t min_capacity)
+	{
+		size_t capacity = 1;
+		while (capacity < min_capacity)
+			capacity <<= 1;
+
+		data_.resize(capacity);
+		mask_ = capacity - 1;
+
+		clear();
+	}
+
+	void clear()
+	{
+		head_.store(0);
+		tail_.store(0);
+	}
+
+	size_t capacity() const
+	{ return data_.size(); }
+
+	size_t size() const
+	{ return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+
+	bool empty() const
+	{ return size() == 0; }
+
+	// producer side
+
+	size_t write_available() const
+	{ return capacity() - (head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire)); }
+
+	size_t write(const char *src, size_t len)
+	{
+		const size_t head = head_.load(std::memory_order_relaxed);
+		const size_t tail = tail_.load(std::memory_order_acquire);
+
+		len = std::min(len, capacity() - (head - tail));
+
+		const size_t offset = head & mask_;
+		const size_t n = std::min(len, capacity() - offset);
+
+		memcpy(&data_[offset], src, n);
+		memcpy(&data_[0], src + n, len - n);
+
+		head_.store(head + len, std::memory_order_release);
+
+		return len;
+	}
+
+	// consumer side
+
+	size_t read(char *dest, size_t len)
+	{
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		const size_t head = head_.load(std::memory_order_acquire);
+
+		len = std::min(len, head - tail);
+
+		const size_t offset = tail & mask_;
+		const size_t n = std::min(len, capacity() - offset);
+
+		memcpy(dest, &data_[offset], n);
+		memcpy(dest + n, &data_[0], len - n);
+
+		tail_.store(tail + len, std::memory_order_release);
+
+		return len;
+	}
+
+private:
+	std::vector<char> data_;
+	size_t mask_;
+
+	// free-running byte counters, wrapped with mask_ on access
+	std::atomic<size_t> head_;
+	std::atomic<size_t> tail_;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+// stable LSD radix sort on 64-bit keys, one byte per pass. values[i] moves
+// along with keys[i]; the scratch arrays must hold n elements. passes in
+// which every key has the same digit are skipped, so keys that only use
+// a few distinct bytes sort in a couple of passes.
+
+template <typename T>
+void
+radix_sort(uint64_t *keys, T *values, uint64_t *scratch_keys, T *scratch_values, size_t n)
+{
+	enum { NUM_PASSES = 8, RADIX = 256 };
+
+	if (n == 0)
+		return;
+
+	size_t counts[NUM_PASSES][RADIX];
+	memset(counts, 0, sizeof counts);
+
+	for (size_t i = 0; i < n; i++) {
+		uint64_t k = keys[i];
+
+		for (int pass = 0; pass < NUM_PASSES; pass++) {
+			++counts[pass][k & 0xff];
+			k >>= 8;
+		}
+	}
+
+	uint64_t *from_keys = keys, *to_keys = scratch_keys;
+	T *from_values = values, *to_values = scratch_values;
+
+	for (int pass = 0; pass < NUM_PASSES; pass++) {
+		size_t *count = counts[pass];
+
+		const int shift = 8*pass;
+
+		if (count[(from_keys[0] >> shift) & 0xff] == n)
+			continue;
+
+		size_t offset = 0;
+
+		for (int i = 0; i < RADIX; i++) {
+			const size_t c = count[i];
+			count[i] = offset;
+			offset += c;
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			const size_t j = count[(from_keys[i] >> shift) & 0xff]++;
+			to_keys[j] = from_keys[i];
+			to_values[j] = from_values[i];
+		}
+
+		std::swap(from_keys, to_keys);
+		std::swap(from_values, to_values);
+	}
+
+	if (from_keys != keys) {
+		std::copy(from_keys, from_keys + n, keys);
+		std::copy(from_values, from_values + n, values);
+	}
+}
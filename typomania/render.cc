@@ -1,17 +1,26 @@
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <algorithm>
 #include <stack>
 #include <array>
+#include <vector>
+#include <unordered_map>
 
 #include <GL/glew.h>
 
 #include <boost/noncopyable.hpp>
 
+#include "panic.h"
 #include "resources.h"
+#include "radix_sort.h"
 #include "mat3.h"
 #include "gl_check.h"
+#include "gl_state.h"
 #include "gl_program.h"
 #include "gl_texture.h"
+#include "gl_buffer.h"
+#include "gl_vertex_array.h"
 #include "render.h"
 
 namespace {
@@ -20,21 +29,52 @@ void gl_set_blend_mode(blend_mode mode)
 {
 	switch (mode) {
 		case blend_mode::NO_BLEND:
-			GL_CHECK(glDisable(GL_BLEND));
+			gl::state::disable_blend();
 			break;
 
 		case blend_mode::ALPHA_BLEND:
-			GL_CHECK(glEnable(GL_BLEND));
-			GL_CHECK(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+			gl::state::enable_blend(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 			break;
 
 		case blend_mode::ADDITIVE_BLEND:
-			GL_CHECK(glEnable(GL_BLEND));
-			GL_CHECK(glBlendFunc(GL_ONE, GL_ONE));
+			gl::state::enable_blend(GL_ONE, GL_ONE);
 			break;
 	}
 }
 
+// small dense ids for pointers, in order of first appearance, so they can
+// be packed in a sort key. nullptr is 0. add_quad tends to be called with
+// the same texture/program over and over, so remember the last one.
+
+template <typename T>
+class id_table
+{
+public:
+	id_table()
+	: last_(nullptr), last_id_(0)
+	{ }
+
+	unsigned get(const T *p)
+	{
+		if (p != last_) {
+			auto it = ids_.find(p);
+
+			if (it == ids_.end())
+				it = ids_.insert(std::make_pair(p, ids_.size() + 1)).first;
+
+			last_ = p;
+			last_id_ = it->second;
+		}
+
+		return p ? last_id_ : 0;
+	}
+
+private:
+	std::unordered_map<const T *, unsigned> ids_;
+	const T *last_;
+	unsigned last_id_;
+};
+
 }
 
 namespace render {
@@ -46,9 +86,16 @@ public:
 
 	void set_viewport(int x_min, int x_max, int y_min, int y_max);
 
+	const GLfloat *get_proj_matrix() const
+	{ return &proj_matrix_[0]; }
+
+	void count_draw_call(size_t bytes_uploaded);
+
 	void begin_batch();
 	void end_batch();
 
+	void discard_batch();
+
 	void push_matrix();
 	void pop_matrix();
 
@@ -62,10 +109,17 @@ public:
 
 	void add_quad(const gl::program *program, const gl::texture *texture, const quad& verts, const quad& texcoords, int layer);
 
+	void begin_frame();
+
+	const frame_stats& get_last_frame_stats() const
+	{ return last_frame_stats_; }
+
+	int get_sprite_queue_high_water() const
+	{ return sprite_queue_high_water_; }
+
 private:
 	struct sprite
 	{
-		int layer;
 		const gl::program *program;
 		const gl::texture *texture;
 		quad verts;
@@ -74,16 +128,49 @@ private:
 		rgba color;
 	};
 
+	struct vertex
+	{
+		GLfloat x, y;
+		GLfloat u, v;
+		GLfloat r, g, b, a;
+	};
+
 	void init_programs();
+	void init_buffers();
+
+	uint64_t make_sort_key(int layer, blend_mode blend, const gl::program *program, const gl::texture *texture);
 
 	void flush_queue();
-	void render_sprites(const gl::program *program, const sprite *const *sprites, int num_sprites);
 	void render_sprites(const gl::program *program, const gl::texture *texture, const sprite *const *sprites, int num_sprites);
 
+	void grow_sprite_queue();
+
+	// initial capacity, the queue doubles whenever it fills up and keeps
+	// its storage across frames
 	static const int SPRITE_QUEUE_CAPACITY = 1024;
 
+	// quads drawn by a single glDrawElements call, limited by the
+	// GLushort indices in the shared index buffer
+	static const int MAX_DRAW_QUADS = 65536/4;
+
+	// streamed vertices are appended to the buffer until it's full, then
+	// the buffer is orphaned and we start over at offset 0
+	static const int VERTEX_BUFFER_SIZE = 4 << 20;
+
+	static_assert(MAX_DRAW_QUADS*4*sizeof(vertex) <= VERTEX_BUFFER_SIZE, "vertex buffer too small");
+
 	int sprite_queue_size_;
-	sprite sprite_queue_[SPRITE_QUEUE_CAPACITY];
+	int sprite_queue_high_water_;
+	std::vector<sprite> sprite_queue_;
+	std::vector<uint64_t> sort_keys_;
+
+	// used by flush_queue
+	std::vector<const sprite *> sorted_sprites_;
+	std::vector<const sprite *> scratch_sprites_;
+	std::vector<uint64_t> scratch_keys_;
+
+	id_table<gl::program> program_ids_;
+	id_table<gl::texture> texture_ids_;
 
 	blend_mode blend_mode_;
 	rgba color_;
@@ -94,11 +181,41 @@ private:
 	const gl::program *prog_texture_;
 
 	std::array<GLfloat, 16> proj_matrix_;
+
+	gl::vertex_array vertex_array_;
+	gl::buffer vertex_buffer_;
+	gl::buffer index_buffer_;
+	GLintptr vertex_buffer_offset_;
+
+	frame_stats cur_frame_stats_;
+	frame_stats last_frame_stats_;
 } *g_render_queue;
 
 render_queue::render_queue()
+	: sprite_queue_size_ { 0 }
+	, sprite_queue_high_water_ { 0 }
+	, vertex_buffer_ { GL_ARRAY_BUFFER }
+	, index_buffer_ { GL_ELEMENT_ARRAY_BUFFER }
+	, vertex_buffer_offset_ { 0 }
+	, cur_frame_stats_ { }
+	, last_frame_stats_ { }
 {
 	init_programs();
+	init_buffers();
+
+	grow_sprite_queue();
+}
+
+void render_queue::grow_sprite_queue()
+{
+	const size_t capacity = std::max<size_t>(2*sprite_queue_.size(), SPRITE_QUEUE_CAPACITY);
+
+	sprite_queue_.resize(capacity);
+	sort_keys_.resize(capacity);
+
+	sorted_sprites_.resize(capacity);
+	scratch_sprites_.resize(capacity);
+	scratch_keys_.resize(capacity);
 }
 
 void render_queue::init_programs()
@@ -107,6 +224,39 @@ void render_queue::init_programs()
 	prog_texture_ = get_program("data/shaders/sprite.prog");
 }
 
+void render_queue::init_buffers()
+{
+	vertex_array_.bind();
+
+	vertex_buffer_.bind();
+	vertex_buffer_.set_data(VERTEX_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+
+	GL_CHECK(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<GLvoid *>(offsetof(vertex, x))));
+	GL_CHECK(glEnableVertexAttribArray(0));
+
+	GL_CHECK(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<GLvoid *>(offsetof(vertex, u))));
+	GL_CHECK(glEnableVertexAttribArray(1));
+
+	GL_CHECK(glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<GLvoid *>(offsetof(vertex, r))));
+	GL_CHECK(glEnableVertexAttribArray(2));
+
+	// two triangles per quad, vertices are v00, v01, v11, v10
+
+	std::vector<GLushort> indices(6*MAX_DRAW_QUADS);
+
+	for (int i = 0; i < MAX_DRAW_QUADS; i++) {
+		GLushort *p = &indices[6*i];
+
+		p[0] = 4*i; p[1] = 4*i + 1; p[2] = 4*i + 2;
+		p[3] = 4*i; p[4] = 4*i + 2; p[5] = 4*i + 3;
+	}
+
+	index_buffer_.bind();
+	index_buffer_.set_data(indices.size()*sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+
+	gl::vertex_array::unbind();
+}
+
 void render_queue::set_viewport(int x_min, int x_max, int y_min, int y_max)
 {
 	const float a = 2.f/(x_max - x_min);
@@ -121,11 +271,17 @@ void render_queue::set_viewport(int x_min, int x_max, int y_min, int y_max)
 			 0, 0, 0,  1 };
 
 	prog_flat_->use();
-	prog_flat_->get_uniform("proj_modelview").set_mat4(&proj_matrix_[0]);
+	prog_flat_->get_proj_modelview_uniform().set_mat4(&proj_matrix_[0]);
 
 	prog_texture_->use();
-	prog_texture_->get_uniform("proj_modelview").set_mat4(&proj_matrix_[0]);
-	prog_texture_->get_uniform("tex").set_i(0);
+	prog_texture_->get_proj_modelview_uniform().set_mat4(&proj_matrix_[0]);
+	prog_texture_->get_tex_uniform().set_i(0);
+}
+
+void render_queue::count_draw_call(size_t bytes_uploaded)
+{
+	++cur_frame_stats_.draw_calls;
+	cur_frame_stats_.bytes_uploaded += bytes_uploaded;
 }
 
 void render_queue::begin_batch()
@@ -142,6 +298,11 @@ void render_queue::end_batch()
 	flush_queue();
 }
 
+void render_queue::discard_batch()
+{
+	sprite_queue_size_ = 0;
+}
+
 void render_queue::push_matrix()
 {
 	matrix_stack_.push(matrix_);
@@ -181,58 +342,94 @@ void render_queue::set_color(const rgba& color)
 
 void render_queue::add_quad(const gl::program *program, const gl::texture *texture, const quad& verts, const quad& texcoords, int layer)
 {
-	if (sprite_queue_size_ == SPRITE_QUEUE_CAPACITY)
-		flush_queue();
+	if (sprite_queue_size_ == static_cast<int>(sprite_queue_.size()))
+		grow_sprite_queue();
+
+	// sprites from an atlas are batched by the atlas itself
+	const gl::texture *storage = texture ? texture->get_storage() : nullptr;
+
+	sort_keys_[sprite_queue_size_] = make_sort_key(layer, blend_mode_, program, storage);
 
 	auto *p = &sprite_queue_[sprite_queue_size_++];
 
 	p->program = program;
-	p->texture = texture;
+	p->texture = storage;
 
 	p->verts.v00 = matrix_*verts.v00;
 	p->verts.v01 = matrix_*verts.v01;
 	p->verts.v10 = matrix_*verts.v10;
 	p->verts.v11 = matrix_*verts.v11;
 
-	p->texcoords = texcoords;
-
-	p->layer = layer;
+	if (texture && texture->is_region()) {
+		p->texcoords.v00 = texture->map_texcoord(texcoords.v00);
+		p->texcoords.v01 = texture->map_texcoord(texcoords.v01);
+		p->texcoords.v10 = texture->map_texcoord(texcoords.v10);
+		p->texcoords.v11 = texture->map_texcoord(texcoords.v11);
+	} else {
+		p->texcoords = texcoords;
+	}
 
 	p->blend = blend_mode_;
 	p->color = color_;
 }
 
+// sprites are sorted by layer, blend mode, program and texture, in that
+// order; pack all four in a key so a radix sort can be used:
+//
+//   63      48 47  40 39     20 19      0
+//   | layer   | blend | program | texture |
+//
+// layer is biased so negative layers sort first.
+
+uint64_t render_queue::make_sort_key(int layer, blend_mode blend, const gl::program *program, const gl::texture *texture)
+{
+	const unsigned program_id = program_ids_.get(program);
+	const unsigned texture_id = texture_ids_.get(texture);
+
+	assert(layer >= -0x8000 && layer < 0x8000);
+
+	if (program_id >= (1u << 20) || texture_id >= (1u << 20))
+		panic("too many programs or textures");
+
+	return (static_cast<uint64_t>(layer + 0x8000) << 48)
+		| (static_cast<uint64_t>(blend) << 40)
+		| (static_cast<uint64_t>(program_id) << 20)
+		| texture_id;
+}
+
+void render_queue::begin_frame()
+{
+	cur_frame_stats_.skipped_uniform_uploads = gl::program::take_skipped_uniform_uploads();
+
+	const gl::state::change_counts changes = gl::state::take_change_counts();
+	cur_frame_stats_.state_changes = changes.issued;
+	cur_frame_stats_.state_changes_elided = changes.elided;
+
+	last_frame_stats_ = cur_frame_stats_;
+	cur_frame_stats_ = { };
+}
+
 void render_queue::flush_queue()
 {
 	if (sprite_queue_size_ == 0)
 		return;
 
-	static const sprite *sorted_sprites[SPRITE_QUEUE_CAPACITY];
+	if (sprite_queue_size_ > sprite_queue_high_water_)
+		sprite_queue_high_water_ = sprite_queue_size_;
+
+	if (sprite_queue_size_ > cur_frame_stats_.max_queued_sprites)
+		cur_frame_stats_.max_queued_sprites = sprite_queue_size_;
 
 	for (int i = 0; i < sprite_queue_size_; i++)
-		sorted_sprites[i] = &sprite_queue_[i];
+		sorted_sprites_[i] = &sprite_queue_[i];
 
-	std::stable_sort(
-		&sorted_sprites[0],
-		&sorted_sprites[sprite_queue_size_],
-		[](const sprite *s0, const sprite *s1)
-		{
-			if (s0->layer != s1->layer) {
-				return s0->layer < s1->layer;
-			} else if (s0->blend != s1->blend) {
-				return static_cast<int>(s0->blend) < static_cast<int>(s1->blend);
-			} else if (s0->program != s1->program) {
-				return s0->program < s1->program;
-			} else {
-				return s0->texture < s1->texture;
-			}
-		});
+	radix_sort(&sort_keys_[0], &sorted_sprites_[0], &scratch_keys_[0], &scratch_sprites_[0], sprite_queue_size_);
 
-	blend_mode cur_blend_mode = sorted_sprites[0]->blend;
+	blend_mode cur_blend_mode = sorted_sprites_[0]->blend;
 	gl_set_blend_mode(cur_blend_mode);
 
-	const gl::texture *cur_texture = sorted_sprites[0]->texture;
-	const gl::program *cur_program = sorted_sprites[0]->program;
+	const gl::texture *cur_texture = sorted_sprites_[0]->texture;
+	const gl::program *cur_program = sorted_sprites_[0]->program;
 
 	int batch_start = 0;
 
@@ -240,17 +437,15 @@ void render_queue::flush_queue()
 		{
 			int num_sprites = batch_end - batch_start;
 
-			if (num_sprites) {
-				if (cur_texture == nullptr) {
-					render_sprites(cur_program, &sorted_sprites[batch_start], num_sprites);
-				} else {
-					render_sprites(cur_program, cur_texture, &sorted_sprites[batch_start], num_sprites);
-				}
-			}
+			if (num_sprites)
+				render_sprites(cur_program, cur_texture, &sorted_sprites_[batch_start], num_sprites);
 		};
 
+	vertex_array_.bind();
+	vertex_buffer_.bind();
+
 	for (int i = 1; i < sprite_queue_size_; i++) {
-		auto p = sorted_sprites[i];
+		auto p = sorted_sprites_[i];
 
 		if (p->blend != cur_blend_mode || p->texture != cur_texture || p->program != cur_program) {
 			do_render(i);
@@ -269,116 +464,85 @@ void render_queue::flush_queue()
 
 	do_render(sprite_queue_size_);
 
+	gl::vertex_array::unbind();
+
 	sprite_queue_size_ = 0;
 }
 
-void render_queue::render_sprites(const gl::program *program, const sprite *const *sprites, int num_sprites)
+void render_queue::render_sprites(const gl::program *program, const gl::texture *texture, const sprite *const *sprites, int num_sprites)
 {
-	static GLfloat data[SPRITE_QUEUE_CAPACITY*4*6];
-
-	struct {
-		GLfloat *dest;
-
-		void operator()(const vec2f& vert, const rgba& color)
-		{
-			*dest++ = vert.x;
-			*dest++ = vert.y;
-
-			*dest++ = color.r;
-			*dest++ = color.g;
-			*dest++ = color.b;
-			*dest++ = color.a;
-		};
-	} add_vertex { data };
-
-	for (int i = 0; i < num_sprites; i++) {
-		auto p = sprites[i];
-
-		add_vertex(p->verts.v00, p->color);
-		add_vertex(p->verts.v01, p->color);
-		add_vertex(p->verts.v11, p->color);
-		add_vertex(p->verts.v10, p->color);
-	}
+	if (texture)
+		texture->bind();
 
 	if (!program) {
-		prog_flat_->use();
+		(texture ? prog_texture_ : prog_flat_)->use();
 	} else {
 		program->use();
-		program->get_uniform("proj_modelview").set_mat4(&proj_matrix_[0]);
+		program->get_proj_modelview_uniform().set_mat4(&proj_matrix_[0]);
+		if (texture)
+			program->get_tex_uniform().set_i(0);
 	}
 
-	GL_CHECK(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), &data[0]));
-	GL_CHECK(glEnableVertexAttribArray(0));
-
-	GL_CHECK(glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 6*sizeof(GLfloat), &data[2]));
-	GL_CHECK(glEnableVertexAttribArray(1));
-
-	GL_CHECK(glDrawArrays(GL_QUADS, 0, 4*num_sprites));
-
-	GL_CHECK(glDisableVertexAttribArray(1));
-	GL_CHECK(glDisableVertexAttribArray(0));
-}
+	while (num_sprites > 0) {
+		const int num_quads = std::min(num_sprites, MAX_DRAW_QUADS);
+		const GLsizeiptr size = num_quads*4*sizeof(vertex);
 
-void render_queue::render_sprites(const gl::program *program, const gl::texture *texture, const sprite *const *sprites, int num_sprites)
-{
-	static GLfloat data[SPRITE_QUEUE_CAPACITY*4*8];
+		if (vertex_buffer_offset_ + size > VERTEX_BUFFER_SIZE) {
+			// orphan the buffer, the driver hands us fresh storage while
+			// draws still in flight keep the old one
+			vertex_buffer_.set_data(VERTEX_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+			vertex_buffer_offset_ = 0;
+		}
 
-	struct {
-		GLfloat *dest;
+		auto *dest = static_cast<vertex *>(vertex_buffer_.map_range(
+					vertex_buffer_offset_, size,
+					GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
 
-		void operator()(const vec2f& vert, const vec2f& texuv, const rgba& color)
-		{
-			*dest++ = vert.x;
-			*dest++ = vert.y;
+		auto add_vertex = [&dest](const vec2f& vert, const vec2f& texuv, const rgba& color)
+			{
+				*dest++ = { vert.x, vert.y, texuv.x, texuv.y, color.r, color.g, color.b, color.a };
+			};
 
-			*dest++ = texuv.x;
-			*dest++ = texuv.y;
+		for (int i = 0; i < num_quads; i++) {
+			auto p = sprites[i];
 
-			*dest++ = color.r;
-			*dest++ = color.g;
-			*dest++ = color.b;
-			*dest++ = color.a;
+			add_vertex(p->verts.v00, p->texcoords.v00, p->color);
+			add_vertex(p->verts.v01, p->texcoords.v01, p->color);
+			add_vertex(p->verts.v11, p->texcoords.v11, p->color);
+			add_vertex(p->verts.v10, p->texcoords.v10, p->color);
 		}
-	} add_vertex { data };
 
-	for (int i = 0; i < num_sprites; i++) {
-		auto p = sprites[i];
+		vertex_buffer_.unmap();
 
-		add_vertex(p->verts.v00, p->texcoords.v00, p->color);
-		add_vertex(p->verts.v01, p->texcoords.v01, p->color);
-		add_vertex(p->verts.v11, p->texcoords.v11, p->color);
-		add_vertex(p->verts.v10, p->texcoords.v10, p->color);
-	}
+		GL_CHECK(glDrawElementsBaseVertex(GL_TRIANGLES, 6*num_quads, GL_UNSIGNED_SHORT, nullptr, vertex_buffer_offset_/sizeof(vertex)));
 
-	texture->bind();
+		vertex_buffer_offset_ += size;
 
-	if (!program) {
-		prog_texture_->use();
-	} else {
-		program->use();
-		program->get_uniform("proj_modelview").set_mat4(&proj_matrix_[0]);
-		program->get_uniform("tex").set_i(0);
-	}
+		count_draw_call(size);
 
-	GL_CHECK(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), &data[0]));
-	GL_CHECK(glEnableVertexAttribArray(0));
-
-	GL_CHECK(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), &data[2]));
-	GL_CHECK(glEnableVertexAttribArray(1));
+		sprites += num_quads;
+		num_sprites -= num_quads;
+	}
+}
 
-	GL_CHECK(glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 8*sizeof(GLfloat), &data[4]));
-	GL_CHECK(glEnableVertexAttribArray(2));
+void init()
+{
+	g_render_queue = new render_queue;
+}
 
-	GL_CHECK(glDrawArrays(GL_QUADS, 0, 4*num_sprites));
+void begin_frame()
+{
+	g_render_queue->begin_frame();
+}
 
-	GL_CHECK(glDisableVertexAttribArray(2));
-	GL_CHECK(glDisableVertexAttribArray(1));
-	GL_CHECK(glDisableVertexAttribArray(0));
+const frame_stats& get_last_frame_stats()
+{
+	return g_render_queue->get_last_frame_stats();
 }
 
-void init()
+int get_sprite_queue_high_water()
 {
-	g_render_queue = new render_queue;
+	return g_render_queue->get_sprite_queue_high_water();
 }
 
 void set_viewport(int x_min, int x_max, int y_min, int y_max)
@@ -386,6 +550,16 @@ void set_viewport(int x_min, int x_max, int y_min, int y_max)
 	g_render_queue->set_viewport(x_min, x_max, y_min, y_max);
 }
 
+const float *get_proj_matrix()
+{
+	return g_render_queue->get_proj_matrix();
+}
+
+void count_draw_call(size_t bytes_uploaded)
+{
+	g_render_queue->count_draw_call(bytes_uploaded);
+}
+
 void begin_batch()
 {
 	g_render_queue->begin_batch();
@@ -396,6 +570,11 @@ void end_batch()
 	g_render_queue->end_batch();
 }
 
+void discard_batch()
+{
+	g_render_queue->discard_batch();
+}
+
 void push_matrix()
 {
 	g_render_queue->push_matrix();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 #include "rgba.h"
 #include "vec2.h"
 
@@ -17,13 +19,38 @@ struct quad
 
 namespace render {
 
+struct frame_stats
+{
+	int draw_calls;
+	size_t bytes_uploaded;
+	int max_queued_sprites; // largest batch sorted in one flush
+	int skipped_uniform_uploads; // values that were already set
+	int state_changes; // binds, blend and viewport changes that reached GL
+	int state_changes_elided; // the ones that didn't change anything
+};
+
 void init();
 
+// starts counting a new frame's stats
+void begin_frame();
+const frame_stats& get_last_frame_stats();
+
+// most sprites ever queued between begin_batch() and end_batch()
+int get_sprite_queue_high_water();
+
 void set_viewport(int x_min, int x_max, int y_min, int y_max);
 
+// for code that draws with GL directly: the projection set by
+// set_viewport(), and counting its draws in the frame stats
+const float *get_proj_matrix();
+void count_draw_call(size_t bytes_uploaded);
+
 void begin_batch();
 void end_batch();
 
+// drops the sprites queued since begin_batch() without drawing them
+void discard_batch();
+
 void push_matrix();
 void pop_matrix();
 
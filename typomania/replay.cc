@@ -0,0 +1,86 @@
+#include <fstream>
+#include <sstream>
+
+#include "replay.h"
+
+replay::replay()
+	: song_duration(0)
+	, has_results(false)
+{ }
+
+void
+replay::clear()
+{
+	kashi_path.clear();
+	song_duration = 0;
+	events.clear();
+	has_results = false;
+}
+
+bool
+replay::load(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file)
+		return false;
+
+	clear();
+
+	std::string line;
+
+	while (std::getline(file, line)) {
+		std::istringstream fields(line);
+
+		std::string tag;
+		if (!(fields >> tag) || tag[0] == '#')
+			continue;
+
+		if (tag == "kashi") {
+			// the rest of the line, so paths can have spaces
+			if (!std::getline(fields >> std::ws, kashi_path))
+				return false;
+		} else if (tag == "duration") {
+			if (!(fields >> song_duration))
+				return false;
+		} else if (tag == "key") {
+			key_event ev;
+			if (!(fields >> ev.song_ms >> ev.keysym))
+				return false;
+			if (!events.empty() && ev.song_ms < events.back().song_ms)
+				return false;
+			events.push_back(ev);
+		} else if (tag == "result") {
+			results& r = final_results;
+			if (!(fields >> r.score >> r.max_combo >> r.miss))
+				return false;
+			has_results = true;
+		} else {
+			return false;
+		}
+	}
+
+	return !kashi_path.empty();
+}
+
+bool
+replay::save(const std::string& path) const
+{
+	std::ofstream file(path);
+	if (!file)
+		return false;
+
+	file << "kashi " << kashi_path << '\n';
+
+	if (song_duration)
+		file << "duration " << song_duration << '\n';
+
+	for (auto& ev : events)
+		file << "key " << ev.song_ms << ' ' << ev.keysym << '\n';
+
+	if (has_results) {
+		const results& r = final_results;
+		file << "result " << r.score << ' ' << r.max_combo << ' ' << r.miss << '\n';
+	}
+
+	return static_cast<bool>(file);
+}
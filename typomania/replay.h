@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// keystrokes typed while playing a song, timed in milliseconds of song
+// time, where the song ended and the counters it ended with. saved as
+// text, one record per line:
+//
+//   kashi <path to the .kashi file>
+//   duration <song ms>
+//   key <song ms> <keysym>
+//   result <score> <max combo> <miss>
+//
+// replays recorded before durations were saved have none; they're played
+// back with the length of the lyrics.
+
+struct replay
+{
+	struct key_event
+	{
+		unsigned song_ms;
+		int keysym;
+	};
+
+	struct results
+	{
+		int score;
+		int max_combo;
+		int miss;
+
+		bool operator==(const results& other) const
+		{ return score == other.score && max_combo == other.max_combo && miss == other.miss; }
+	};
+
+	replay();
+
+	void clear();
+
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	std::string kashi_path;
+	unsigned song_duration; // 0 if it wasn't recorded
+	std::vector<key_event> events;
+
+	bool has_results;
+	results final_results;
+};
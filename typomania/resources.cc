@@ -1,13 +1,22 @@
 #include <cstdio>
+#include <cstring>
+#include <cerrno>
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <unordered_map>
 
+#include <sys/types.h>
+#include <dirent.h>
+
 #include "panic.h"
+#include "image.h"
 
 #include "font.h"
 #include "gl_texture.h"
+#include "async_texture.h"
+#include "texture_atlas.h"
 #include "gl_program.h"
 #include "resources.h"
 
@@ -43,10 +52,84 @@ const font *get_font(const std::string& path)
 	return cache[path];
 }
 
+namespace {
+
+// images no bigger than this go into a shared atlas
+const int MAX_ATLAS_IMAGE_SIZE = 256;
+const int ATLAS_SIZE = 1024;
+
+}
+
 const gl::texture *get_texture(const std::string& path)
 {
-	static resource_cache<gl::texture> cache;
-	return cache[path];
+	// declared first, so the regions in the cache go away before them
+	static std::vector<std::unique_ptr<texture_atlas>> atlases;
+
+	static std::unordered_map<std::string, std::unique_ptr<gl::texture>> cache;
+
+	auto it = cache.find(path);
+
+	if (it == cache.end()) {
+		fprintf(stderr, "loading %s...\n", path.c_str());
+
+		png_reader reader;
+
+		if (!reader.open(path))
+			panic("failed to load %s", path.c_str());
+
+		std::unique_ptr<gl::texture> texture;
+
+		if (reader.get_width() <= MAX_ATLAS_IMAGE_SIZE && reader.get_height() <= MAX_ATLAS_IMAGE_SIZE) {
+			image img(reader.get_width(), reader.get_height());
+			if (!reader.read(img.get_bits(), img.get_width(), img.get_height()))
+				panic("failed to load %s", path.c_str());
+
+			if (atlases.empty() || !(texture = atlases.back()->add(img))) {
+				atlases.emplace_back(new texture_atlas(ATLAS_SIZE, ATLAS_SIZE));
+				texture = atlases.back()->add(img);
+			}
+		} else {
+			texture.reset(new gl::texture);
+			if (!texture->load(reader))
+				panic("failed to load %s", path.c_str());
+		}
+
+		it = cache.insert(std::make_pair(path, std::move(texture))).first;
+	}
+
+	return it->second.get();
+}
+
+namespace {
+
+std::unordered_map<std::string, std::unique_ptr<async_texture>>& async_textures()
+{
+	static std::unordered_map<std::string, std::unique_ptr<async_texture>> textures;
+	return textures;
+}
+
+}
+
+const async_texture *get_texture_async(const std::string& path)
+{
+	auto& textures = async_textures();
+
+	auto it = textures.find(path);
+
+	if (it == textures.end()) {
+		fprintf(stderr, "loading %s in the background...\n", path.c_str());
+
+		std::unique_ptr<async_texture> t(new async_texture(path));
+		it = textures.insert(std::make_pair(path, std::move(t))).first;
+	}
+
+	return it->second.get();
+}
+
+void poll_async_textures()
+{
+	for (auto& p : async_textures())
+		p.second->poll();
 }
 
 const gl::program *get_program(const std::string& path)
@@ -54,3 +137,27 @@ const gl::program *get_program(const std::string& path)
 	static resource_cache<gl::program> cache;
 	return cache[path];
 }
+
+int load_programs(const std::string& dir)
+{
+	DIR *d;
+
+	if (!(d = opendir(dir.c_str())))
+		panic("failed to open %s: %s", dir.c_str(), strerror(errno));
+
+	int count = 0;
+
+	while (struct dirent *de = readdir(d)) {
+		const std::string name = de->d_name;
+		const std::string suffix = ".prog";
+
+		if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+			get_program(dir + "/" + name);
+			++count;
+		}
+	}
+
+	closedir(d);
+
+	return count;
+}
@@ -8,5 +8,15 @@ const font *get_font(const std::string& path);
 namespace gl { class texture; }
 const gl::texture *get_texture(const std::string& path);
 
+// starts loading the texture in the background the first time it's asked
+// for. the loads move along in poll_async_textures(), once per frame.
+class async_texture;
+const async_texture *get_texture_async(const std::string& path);
+void poll_async_textures();
+
 namespace gl { class program; }
 const gl::program *get_program(const std::string& path);
+
+// loads every program in dir up front, so none gets built mid-song;
+// returns how many
+int load_programs(const std::string& dir);
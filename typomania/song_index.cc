@@ -0,0 +1,197 @@
+#include <cstdio>
+#include <cstring>
+
+#include <fstream>
+
+#include "song_index.h"
+#include "utf8.h"
+
+namespace {
+
+const char INDEX_MAGIC[4] = { 'T', 'I', 'D', 'X' };
+const uint32_t INDEX_VERSION = 1;
+
+// host byte order, the index never leaves the machine
+
+template <typename T>
+void
+write_value(std::ostream& out, T value)
+{
+	out.write(reinterpret_cast<const char *>(&value), sizeof value);
+}
+
+template <typename T>
+bool
+read_value(std::istream& in, T& value)
+{
+	return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof value));
+}
+
+void
+write_string(std::ostream& out, const std::string& str)
+{
+	write_value<uint32_t>(out, str.size());
+	out.write(str.data(), str.size());
+}
+
+bool
+read_string(std::istream& in, std::string& str)
+{
+	uint32_t size;
+
+	if (!read_value(in, size) || size > (1u << 20))
+		return false;
+
+	str.resize(size);
+
+	return size == 0 || static_cast<bool>(in.read(&str[0], size));
+}
+
+bool
+from_utf8(const std::string& str, std::wstring& wstr)
+{
+	return !utf8::decode(str.data(), str.data() + str.size(), wstr);
+}
+
+void
+to_utf8(const std::wstring& wstr, std::string& str)
+{
+	utf8::encode(wstr.data(), wstr.data() + wstr.size(), str);
+}
+
+}
+
+bool
+song_index::load(const std::string& path)
+{
+	entries_.clear();
+
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		return false;
+
+	char magic[sizeof INDEX_MAGIC];
+	uint32_t version, num_entries;
+
+	if (!in.read(magic, sizeof magic) || memcmp(magic, INDEX_MAGIC, sizeof magic))
+		return false;
+
+	if (!read_value(in, version) || version != INDEX_VERSION || !read_value(in, num_entries))
+		return false;
+
+	for (uint32_t i = 0; i < num_entries; i++) {
+		std::string song_path;
+		entry e;
+		e.used = false;
+
+		if (!read_string(in, song_path)
+		  || !read_value(in, e.stamp.mtime) || !read_value(in, e.stamp.size)
+		  || !read_string(in, e.name) || !read_string(in, e.artist) || !read_string(in, e.genre)
+		  || !read_string(in, e.stream) || !read_string(in, e.background_path)
+		  || !read_value(in, e.level) || !read_value(in, e.num_strokes)) {
+			entries_.clear();
+			return false;
+		}
+
+		entries_[song_path] = std::move(e);
+	}
+
+	return true;
+}
+
+bool
+song_index::save(const std::string& path) const
+{
+	// written to a temporary first, so a crash never leaves a truncated index
+	const std::string temp_path = path + ".tmp";
+
+	{
+		std::ofstream out(temp_path, std::ios::binary);
+		if (!out)
+			return false;
+
+		out.write(INDEX_MAGIC, sizeof INDEX_MAGIC);
+		write_value<uint32_t>(out, INDEX_VERSION);
+		write_value<uint32_t>(out, entries_.size());
+
+		for (auto& it : entries_) {
+			const entry& e = it.second;
+
+			write_string(out, it.first);
+			write_value(out, e.stamp.mtime);
+			write_value(out, e.stamp.size);
+			write_string(out, e.name);
+			write_string(out, e.artist);
+			write_string(out, e.genre);
+			write_string(out, e.stream);
+			write_string(out, e.background_path);
+			write_value(out, e.level);
+			write_value(out, e.num_strokes);
+		}
+
+		if (!out.flush())
+			return false;
+	}
+
+	return rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+kashi_ptr
+song_index::find(const std::string& song_path, const file_stamp& stamp)
+{
+	auto it = entries_.find(song_path);
+
+	if (it == entries_.end() || !(it->second.stamp == stamp))
+		return nullptr;
+
+	entry& e = it->second;
+
+	kashi_ptr song(new kashi);
+
+	// a bad entry is as good as a missing one, the song is parsed again
+	if (!from_utf8(e.name, song->name) || !from_utf8(e.artist, song->artist) || !from_utf8(e.genre, song->genre))
+		return nullptr;
+
+	e.used = true;
+
+	song->path = song_path;
+	song->stream = e.stream;
+	song->background_path = e.background_path;
+	song->level = e.level;
+	song->num_strokes = e.num_strokes;
+
+	return song;
+}
+
+void
+song_index::add(const kashi& song, const file_stamp& stamp)
+{
+	entry& e = entries_[song.path];
+
+	e.stamp = stamp;
+	to_utf8(song.name, e.name);
+	to_utf8(song.artist, e.artist);
+	to_utf8(song.genre, e.genre);
+	e.stream = song.stream;
+	e.background_path = song.background_path;
+	e.level = song.level;
+	e.num_strokes = song.num_strokes;
+	e.used = true;
+}
+
+size_t
+song_index::remove_unused()
+{
+	size_t num_removed = 0;
+
+	for (auto it = entries_.begin(); it != entries_.end();) {
+		if (!it->second.used) {
+			it = entries_.erase(it);
+			++num_removed;
+		} else {
+			++it;
+		}
+	}
+
+	return num_removed;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include <boost/noncopyable.hpp>
+
+#include "kashi.h"
+#include "file_stamp.h"
+
+// song info saved between runs, so only songs whose file changed need to
+// be parsed again. entries are keyed by the path of the .kashi file and
+// are only used while its modification time and size still match.
+
+class song_index : private boost::noncopyable
+{
+public:
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	// a song with the info indexed for the file, or nullptr if it's not
+	// indexed or the file changed since
+	kashi_ptr find(const std::string& song_path, const file_stamp& stamp);
+
+	void add(const kashi& song, const file_stamp& stamp);
+
+	// drops entries that weren't found or added since the index was
+	// loaded, returns how many
+	size_t remove_unused();
+
+private:
+	struct entry
+	{
+		file_stamp stamp;
+		std::string name, artist, genre; // utf-8
+		std::string stream;
+		std::string background_path;
+		int32_t level;
+		int32_t num_strokes;
+		bool used; // not saved
+	};
+
+	std::unordered_map<std::string, entry> entries_;
+};
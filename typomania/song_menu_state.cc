@@ -22,11 +22,11 @@ static const int MENU_FADE_OUT_TICS = 60;
 class menu_item
 {
 public:
-	menu_item(int window_width, int window_height, const kashi *song);
+	menu_item(int window_width, int window_height, kashi *song);
 
 	void render(float pos, float alpha) const;
 
-	const kashi *get_song() const
+	kashi *get_song() const
 	{ return song_; }
 
 private:
@@ -37,7 +37,7 @@ private:
 	int window_width_;
 	int window_height_;
 
-	const kashi *song_;
+	kashi *song_;
 
 	const font *small_font_;
 	const font *tiny_font_;
@@ -45,12 +45,12 @@ private:
 	const gl::texture *border_texture_;
 };
 
-menu_item::menu_item(int window_width, int window_height, const kashi *song)
+menu_item::menu_item(int window_width, int window_height, kashi *song)
 	: window_width_(window_width)
 	, window_height_(window_height)
 	, song_(song)
-	, small_font_(get_font("data/fonts/small_font.fnt"))
-	, tiny_font_(get_font("data/fonts/tiny_font.fnt"))
+	, small_font_(get_font("data/fonts/small_font.fntb"))
+	, tiny_font_(get_font("data/fonts/tiny_font.fntb"))
 	, border_texture_(get_texture("data/images/item-border.png"))
 {
 }
@@ -172,7 +172,7 @@ song_menu_state::song_menu_state(game *parent, const std::vector<kashi_ptr>& kas
 
 	bg_transition_program_->use();
 	bg_transition_program_->get_uniform("resolution").set_f(parent_->get_window_width(), parent_->get_window_height());
-	bg_transition_program_->get_uniform("tex").set_i(0);
+	bg_transition_program_->get_tex_uniform().set_i(0);
 }
 
 song_menu_state::~song_menu_state()
@@ -189,11 +189,11 @@ song_menu_state::draw_background() const
 	if (cur_state_ == state::OUTRO) {
 		auto kashi = item_list_[cur_selection_]->get_song();
 
-		if (kashi->background) {
+		if (const gl::texture *background = kashi->get_background()) {
 			float t = static_cast<float>(state_tics_)/OUTRO_TICS;
 			render::set_blend_mode(blend_mode::ALPHA_BLEND);
 			render::set_color({ 1, 1, 1, t });
-			render::draw_quad(bg_transition_program_, kashi->background, { 0, 0 }, -20);
+			render::draw_quad(bg_transition_program_, background, { 0, 0 }, -20);
 		}
 	}
 }
@@ -258,6 +258,11 @@ song_menu_state::update()
 
 	++state_tics_;
 
+	// background of the selected song is loaded in the background, so
+	// it's usually there by the time the song starts
+	if (cur_state_ == state::IDLE)
+		item_list_[cur_selection_]->get_song()->get_background();
+
 	switch (cur_state_) {
 		case state::MOVING_UP:
 			if (state_tics_ == move_tics_) {
@@ -9,7 +9,8 @@
 #include "spectrum_bars.h"
 
 spectrum_bars::spectrum_bars(const ogg_player& player, int w, int h, int num_bands)
-: player(player)
+: fft(LOG2_WINDOW_SIZE)
+, player(player)
 , bar_width(w), max_height(h), num_bands(num_bands)
 , bar_texture(get_texture("data/images/spectrum-bar.png"))
 {
@@ -17,9 +18,9 @@ spectrum_bars::spectrum_bars(const ogg_player& player, int w, int h, int num_ban
 }
 
 void
-spectrum_bars::update(unsigned cur_ms)
+spectrum_bars::update()
 {
-	update_spectrum_window(cur_ms);
+	update_spectrum_window();
 }
 
 void
@@ -29,23 +30,34 @@ spectrum_bars::draw() const
 }
 
 void
-spectrum_bars::update_spectrum_window(unsigned cur_ms)
+spectrum_bars::update_spectrum_window()
 {
-	const int buffer_samples = player.get_num_buffer_samples();
-	const int total_buffer_samples = buffer_samples*ogg_player::NUM_BUFFERS;
+	// the first buffer still queued starts at player.processed_samples,
+	// so the one being played and the offset into it follow from the
+	// player's clock
 
-	// ogg_player::rate samples --> 1 second
-	// y samples --> cur_ms msecs
+	int cur_buffer = (player.next_free + player.num_free)%ogg_player::NUM_BUFFERS;
+	int num_queued = ogg_player::NUM_BUFFERS - player.num_free;
 
-	// 1 tic --> ogg_player::rate/30 samples
+	unsigned long sample_index = player.get_samples_played() - player.processed_samples;
 
-	unsigned sample_index = (static_cast<unsigned long long>(cur_ms)*player.rate/1000)%total_buffer_samples;
+	while (num_queued > 0 && sample_index >= player.buffers[cur_buffer].size/player.frame_size) {
+		sample_index -= player.buffers[cur_buffer].size/player.frame_size;
+		cur_buffer = (cur_buffer + 1)%ogg_player::NUM_BUFFERS;
+		--num_queued;
+	}
 
 	for (int i = 0; i < WINDOW_SIZE; i++) {
-		const ogg_player::buffer& buf = player.buffers[sample_index/buffer_samples];
+		if (num_queued == 0) {
+			// ran past the queued audio
+			std::fill(&sample_window[i], std::end(sample_window), 0.f);
+			break;
+		}
+
+		const ogg_player::buffer& buf = player.buffers[cur_buffer];
 		const int16_t *buffer_data = reinterpret_cast<const int16_t *>(buf.data);
 
-		int j = sample_index%buffer_samples;
+		const int j = sample_index;
 
 		switch (player.format) {
 			case AL_FORMAT_MONO16:
@@ -61,15 +73,16 @@ spectrum_bars::update_spectrum_window(unsigned cur_ms)
 				break;
 		}
 
-		if (++sample_index == total_buffer_samples)
+		if (++sample_index == buf.size/player.frame_size) {
 			sample_index = 0;
+			cur_buffer = (cur_buffer + 1)%ogg_player::NUM_BUFFERS;
+			--num_queued;
+		}
 	}
 
-	static float real[WINDOW_SIZE], imag[WINDOW_SIZE];
-	memcpy(real, sample_window, sizeof real);
-	memset(imag, 0, sizeof imag);
+	static float real[WINDOW_SIZE/2], imag[WINDOW_SIZE/2];
 
-	fft(1, LOG2_WINDOW_SIZE, real, imag);
+	fft.forward_real(sample_window, real, imag);
 
 	for (int i = 0; i < WINDOW_SIZE/2; i++)
 		spectrum_window[i] = sqrtf(real[i]*real[i] + imag[i]*imag[i]);
@@ -1,6 +1,7 @@
 #ifndef SPECTRUM_BARS_H_
 #define SPECTRUM_BARS_H_
 
+#include "fft.h"
 #include "ogg_player.h"
 
 namespace gl {
@@ -11,11 +12,11 @@ class spectrum_bars {
 public:
 	spectrum_bars(const ogg_player& player, int w, int h, int num_bars);
 
-	void update(unsigned cur_ms);
+	void update();
 	void draw() const;
 
 private:
-	void update_spectrum_window(unsigned cur_ms);
+	void update_spectrum_window();
 
 	void render_spectrum_bars(const float *samples, int num_samples, float scale) const;
 
@@ -27,6 +28,8 @@ private:
 	float sample_window[WINDOW_SIZE];
 	float spectrum_window[WINDOW_SIZE/2];
 
+	fft_plan fft;
+
 	const ogg_player& player;
 
 	int bar_width;
@@ -0,0 +1,314 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include <AL/al.h>
+#include <AL/alc.h>
+#include <AL/alext.h>
+#include <vorbis/vorbisenc.h>
+
+#include "ogg_player.h"
+
+// plays a generated tone through ogg_player on one of OpenAL Soft's devices
+// that need no sound card, and checks how far the song clock drifts from
+// the time that went by:
+//
+//   loopback  the test renders the mix itself, 10 ms at a time, so the
+//             samples rendered are the time; the clock must keep within a
+//             millisecond of them
+//   null      the "No Output" device mixes in real time on its own thread;
+//             the clock must keep within a few mixing periods of the wall
+//             clock
+//
+// exits with SKIPPED_STATUS when OpenAL doesn't have the device, so ctest
+// reports the test as skipped rather than passed
+
+namespace {
+
+// automake's convention, set as SKIP_RETURN_CODE in CMakeLists.txt
+const int SKIPPED_STATUS = 77;
+
+enum result { PASSED, FAILED, SKIPPED };
+
+const int RATE = 44100;
+const int STREAM_SECONDS = 4;
+const int PLAY_MS = 3000;
+
+const long MAX_LOOPBACK_DRIFT = RATE/1000; // in samples
+
+// for the null device, which is only as punctual as the scheduler
+const double MAX_WALL_DRIFT_MS = 50;
+
+// a stereo 440 Hz tone
+bool
+write_stream(const char *path)
+{
+	FILE *out = fopen(path, "wb");
+	if (!out)
+		return false;
+
+	vorbis_info vi;
+	vorbis_info_init(&vi);
+
+	if (vorbis_encode_init_vbr(&vi, 2, RATE, .1f) != 0) {
+		fclose(out);
+		return false;
+	}
+
+	vorbis_comment vc;
+	vorbis_comment_init(&vc);
+
+	vorbis_dsp_state vd;
+	vorbis_analysis_init(&vd, &vi);
+
+	vorbis_block vb;
+	vorbis_block_init(&vd, &vb);
+
+	ogg_stream_state os;
+	ogg_stream_init(&os, 1);
+
+	ogg_packet header, header_comment, header_code;
+	vorbis_analysis_headerout(&vd, &vc, &header, &header_comment, &header_code);
+
+	ogg_stream_packetin(&os, &header);
+	ogg_stream_packetin(&os, &header_comment);
+	ogg_stream_packetin(&os, &header_code);
+
+	ogg_page og;
+
+	while (ogg_stream_flush(&os, &og)) {
+		fwrite(og.header, 1, og.header_len, out);
+		fwrite(og.body, 1, og.body_len, out);
+	}
+
+	const int CHUNK_SIZE = 1024;
+
+	for (int written = 0; ; written += CHUNK_SIZE) {
+		if (written < STREAM_SECONDS*RATE) {
+			float **buffer = vorbis_analysis_buffer(&vd, CHUNK_SIZE);
+
+			for (int i = 0; i < CHUNK_SIZE; i++)
+				buffer[0][i] = buffer[1][i] = .5f*sinf(2*M_PI*440*(written + i)/RATE);
+
+			vorbis_analysis_wrote(&vd, CHUNK_SIZE);
+		} else {
+			vorbis_analysis_wrote(&vd, 0);
+		}
+
+		bool end_of_stream = false;
+
+		while (vorbis_analysis_blockout(&vd, &vb) == 1) {
+			vorbis_analysis(&vb, nullptr);
+			vorbis_bitrate_addblock(&vb);
+
+			ogg_packet op;
+
+			while (vorbis_bitrate_flushpacket(&vd, &op)) {
+				ogg_stream_packetin(&os, &op);
+
+				while (ogg_stream_pageout(&os, &og)) {
+					fwrite(og.header, 1, og.header_len, out);
+					fwrite(og.body, 1, og.body_len, out);
+
+					if (ogg_page_eos(&og))
+						end_of_stream = true;
+				}
+			}
+		}
+
+		if (end_of_stream)
+			break;
+	}
+
+	ogg_stream_clear(&os);
+	vorbis_block_clear(&vb);
+	vorbis_dsp_clear(&vd);
+	vorbis_comment_clear(&vc);
+	vorbis_info_clear(&vi);
+
+	return fclose(out) == 0;
+}
+
+bool
+check_player(const ogg_player& player)
+{
+	if (player.get_num_underruns() != 0) {
+		printf("%d underruns\n", player.get_num_underruns());
+		return false;
+	}
+
+	return true;
+}
+
+result
+run_loopback(const std::string& stream_path)
+{
+	if (!alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback")) {
+		printf("no ALC_SOFT_loopback, skipped\n");
+		return SKIPPED;
+	}
+
+	auto open_device = reinterpret_cast<LPALCLOOPBACKOPENDEVICESOFT>(alcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT"));
+	auto render_samples = reinterpret_cast<LPALCRENDERSAMPLESSOFT>(alcGetProcAddress(nullptr, "alcRenderSamplesSOFT"));
+
+	ALCdevice *device = open_device(nullptr);
+	if (!device) {
+		printf("alcLoopbackOpenDeviceSOFT failed\n");
+		return FAILED;
+	}
+
+	// the stream's rate, so nothing is resampled and the offsets count
+	// the same samples as the mix
+	const ALCint attrs[] = {
+		ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+		ALC_FORMAT_TYPE_SOFT, ALC_SHORT_SOFT,
+		ALC_FREQUENCY, RATE,
+		0 };
+
+	ALCcontext *context = alcCreateContext(device, attrs);
+	alcMakeContextCurrent(context);
+
+	bool ok = true;
+
+	{
+		ogg_player player;
+		player.open(stream_path);
+		player.start();
+
+		const int STEP_SAMPLES = RATE/100;
+		std::vector<ALshort> mix(2*STEP_SAMPLES);
+
+		unsigned long rendered = 0;
+		long max_drift = 0;
+
+		while (rendered < static_cast<unsigned long>(PLAY_MS)*RATE/1000) {
+			render_samples(device, &mix[0], STEP_SAMPLES);
+			rendered += STEP_SAMPLES;
+
+			player.update();
+
+			const long drift = static_cast<long>(player.get_samples_played()) - static_cast<long>(rendered);
+			max_drift = std::max(max_drift, std::abs(drift));
+
+			// lets the decoder keep up, it isn't paced by anything else
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		printf("loopback: %lu samples rendered, max drift %ld samples\n", rendered, max_drift);
+
+		if (max_drift > MAX_LOOPBACK_DRIFT)
+			ok = false;
+
+		if (!check_player(player))
+			ok = false;
+	}
+
+	alcMakeContextCurrent(nullptr);
+	alcDestroyContext(context);
+	alcCloseDevice(device);
+
+	return ok ? PASSED : FAILED;
+}
+
+result
+run_null(const std::string& stream_path)
+{
+	ALCdevice *device = alcOpenDevice("No Output");
+	if (!device) {
+		printf("no \"No Output\" device, skipped\n");
+		return SKIPPED;
+	}
+
+	ALCcontext *context = alcCreateContext(device, nullptr);
+	alcMakeContextCurrent(context);
+
+	bool ok = true;
+
+	{
+		using clock = std::chrono::steady_clock;
+
+		ogg_player player;
+		player.open(stream_path);
+		player.start();
+
+		const auto start = clock::now();
+
+		double min_drift = 0, max_drift = 0;
+
+		for (bool first = true; ; first = false) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(16));
+
+			player.update();
+
+			const double wall_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+			if (wall_ms >= PLAY_MS)
+				break;
+
+			// how late the mixer started doesn't matter, how it keeps
+			// up from there does
+			const double drift = player.get_ms_played() - wall_ms;
+
+			if (first) {
+				min_drift = max_drift = drift;
+			} else {
+				min_drift = std::min(min_drift, drift);
+				max_drift = std::max(max_drift, drift);
+			}
+		}
+
+		printf("null: drift between %.1f and %.1f ms\n", min_drift, max_drift);
+
+		if (max_drift - min_drift > MAX_WALL_DRIFT_MS)
+			ok = false;
+
+		if (!check_player(player))
+			ok = false;
+	}
+
+	alcMakeContextCurrent(nullptr);
+	alcDestroyContext(context);
+	alcCloseDevice(device);
+
+	return ok ? PASSED : FAILED;
+}
+
+}
+
+int
+main(int argc, char *argv[])
+{
+	if (argc != 2 || (strcmp(argv[1], "loopback") && strcmp(argv[1], "null"))) {
+		fprintf(stderr, "usage: %s loopback|null\n", *argv);
+		return 2;
+	}
+
+	// one per mode, ctest may run them side by side
+	const std::string stream_path = std::string("audio_clock_test-") + argv[1] + ".ogg";
+
+	if (!write_stream(stream_path.c_str())) {
+		printf("failed to write %s\n", stream_path.c_str());
+		return 1;
+	}
+
+	const result r = !strcmp(argv[1], "loopback") ? run_loopback(stream_path) : run_null(stream_path);
+
+	remove(stream_path.c_str());
+
+	switch (r) {
+		case PASSED:
+			return 0;
+
+		case SKIPPED:
+			return SKIPPED_STATUS;
+
+		default:
+			return 1;
+	}
+}
@@ -0,0 +1,234 @@
+#include <map>
+#include <tuple>
+
+#include "kana_oracle.h"
+
+namespace kana_oracle {
+
+namespace {
+
+pattern
+parse_pattern(const char *str)
+{
+	pattern p;
+
+	while (*str) {
+		position pos;
+
+		if (*str == '[') {
+			for (++str; *str != ']'; ++str)
+				pos.keys.push_back(*str);
+		} else {
+			pos.keys.push_back(*str);
+		}
+
+		++str;
+
+		pos.is_optional = *str == '?';
+		if (pos.is_optional)
+			++str;
+
+		p.push_back(pos);
+	}
+
+	return p;
+}
+
+// only for the hiragana block; ー has no hiragana of its own, the old
+// tables got a bogus U+315C for it
+bool
+has_katakana(wchar_t ch)
+{
+	return ch >= L'ぁ' && ch <= L'ゖ';
+}
+
+wchar_t
+hira_to_kata(wchar_t ch)
+{
+	return ch - L'あ' + L'ア';
+}
+
+wchar_t
+half_to_full(wchar_t ch)
+{
+	return ch - L'a' + L'ａ';
+}
+
+std::map<wchar_t, pattern>
+init_kana_to_pattern_map()
+{
+	std::map<wchar_t, pattern> map;
+
+	static const std::pair<wchar_t, const char *> kana_to_romaji[]
+		{ { L'あ', "A"  }, { L'い', "I"  }, { L'う', "U"  }, { L'え', "E"  }, { L'お', "O"  },
+		  { L'か', "KA" }, { L'き', "KI" }, { L'く', "KU" }, { L'け', "KE" }, { L'こ', "KO" },
+		  { L'さ', "SA" }, { L'し', "SH?I" }, { L'す', "SU" }, { L'せ', "SE" }, { L'そ', "SO" },
+		  { L'た', "TA" }, { L'ち', "[TC]H?I" }, { L'つ', "TS?U" }, { L'て', "TE" }, { L'と', "TO" },
+		  { L'な', "NA" }, { L'に', "NI" }, { L'ぬ', "NU" }, { L'ね', "NE" }, { L'の', "NO" },
+		  { L'は', "HA" }, { L'ひ', "HI" }, { L'ふ', "[HF]U" }, { L'へ', "HE" }, { L'ほ', "HO" },
+		  { L'ま', "MA" }, { L'み', "MI" }, { L'む', "MU" }, { L'め', "ME" }, { L'も', "MO" },
+		  { L'や', "YA" }, { L'ゆ', "YU" }, { L'よ', "YO" },
+		  { L'ら', "RA" }, { L'り', "RI" }, { L'る', "RU" }, { L'れ', "RE" }, { L'ろ', "RO" },
+		  { L'わ', "WA" }, { L'を', "WO" },
+		  { L'ん', "N"  }, { L'ー', "-" },
+		  { L'が', "GA" }, { L'ぎ', "GI" }, { L'ぐ', "GU" }, { L'げ', "GE" }, { L'ご', "GO" },
+		  { L'ざ', "ZA" }, { L'じ', "[ZJ]I" }, { L'ず', "ZU" }, { L'ぜ', "ZE" }, { L'ぞ', "ZO" },
+		  { L'だ', "DA" }, { L'ぢ', "DI" }, { L'づ', "[DZ]U" }, { L'で', "DE" }, { L'ど', "DO" },
+		  { L'ば', "BA" }, { L'び', "BI" }, { L'ぶ', "BU" }, { L'べ', "BE" }, { L'ぼ', "BO" },
+		  { L'ぱ', "PA" }, { L'ぴ', "PI" }, { L'ぷ', "PU" }, { L'ぺ', "PE" }, { L'ぽ', "PO" },
+		  { L'ぁ', "[LX]A"  }, { L'ぃ', "[LX]I"  }, { L'ぅ', "[LX]U"  }, { L'ぇ', "[LX]E"  }, { L'ぉ', "[LX]O"  },
+		  { L'っ', "[LX]TS?U" } };
+
+	for (auto& p : kana_to_romaji) {
+		const pattern romaji = parse_pattern(p.second);
+
+		map.insert(std::make_pair(p.first, romaji));
+		if (has_katakana(p.first))
+			map.insert(std::make_pair(hira_to_kata(p.first), romaji));
+	}
+
+	for (char i = 'A'; i <= 'Z'; i++) {
+		const char pattern_str[] { i, '\0' };
+		const pattern romaji = parse_pattern(pattern_str);
+
+		map.insert(std::make_pair(i, romaji));
+		map.insert(std::make_pair(half_to_full(i), romaji));
+
+		map.insert(std::make_pair(i - 'A' + 'a', romaji));
+		map.insert(std::make_pair(half_to_full(i - 'A' + 'a'), romaji));
+	}
+
+	for (char i = '0'; i <= '9'; i++) {
+		const char pattern_str[] { i, '\0' };
+		const pattern romaji = parse_pattern(pattern_str);
+
+		map.insert(std::make_pair(i, romaji));
+		map.insert(std::make_pair(half_to_full(i), romaji));
+	}
+
+	return map;
+}
+
+std::map<std::pair<wchar_t, wchar_t>, pattern>
+init_kana_pair_to_pattern_map()
+{
+	std::map<std::pair<wchar_t, wchar_t>, pattern> map;
+
+	static const std::pair<const wchar_t *, const char *> kana_pair_to_romaji[]
+		{ { L"きゃ", "KYA" }, { L"きゅ", "KYU" }, { L"きょ", "KYO" },
+		  { L"しゃ", "S[YH]A" }, { L"しゅ", "S[YH]U" }, { L"しょ", "S[YH]O" },
+		  { L"ちゃ", "[TC][YH]A" }, { L"ちゅ", "[TC][YH]U" }, { L"ちょ", "[TC][YH]O" },
+		  { L"にゃ", "NYA" }, { L"にゅ", "NYU" }, { L"にょ", "NYO" },
+		  { L"ひゃ", "HYA" }, { L"ひゅ", "HYU" }, { L"ひょ", "HYO" },
+		  { L"みゃ", "MYA" }, { L"みゅ", "MYU" }, { L"みょ", "MYO" },
+		  { L"りゃ", "RYA" }, { L"りゅ", "RYU" }, { L"りょ", "RYO" },
+		  { L"ぎゃ", "GYA" }, { L"ぎゅ", "GYU" }, { L"ぎょ", "GYO" },
+		  { L"じゃ", "[JZ]Y?A"  }, { L"じゅ", "[JZ]Y?U"  }, { L"じょ", "[JZ]Y?O"  }, // XXX:should display ZYA/ZYU/ZYO for consistency
+		  { L"びゃ", "BYA" }, { L"びゅ", "BYU" }, { L"びょ", "BYO" },
+		  { L"ぴゃ", "PYA" }, { L"ぴゅ", "PYU" }, { L"ぴょ", "PYO" },
+		  { L"った", "TTA" }, { L"っち", "TTI" }, { L"っつ", "TTU" }, { L"って", "TTE" }, { L"っと", "TTO" },
+		  { L"っさ", "SSA" }, { L"っし", "SSI" }, { L"っす", "SSU" }, { L"っせ", "SSE" }, { L"っそ", "SSO" },
+		  { L"っか", "KKA" }, { L"っき", "KKI" }, { L"っく", "KKU" }, { L"っけ", "KKE" }, { L"っこ", "KKO" },
+		  { L"っぱ", "PPA" }, { L"っぴ", "PPI" }, { L"っぷ", "PPU" }, { L"っぺ", "PPE" }, { L"っぽ", "PPO" } };
+
+	for (auto& p : kana_pair_to_romaji) {
+		const pattern romaji = parse_pattern(p.second);
+
+		auto kana = p.first;
+		map.insert(std::make_pair(std::make_pair(kana[0], kana[1]), romaji));
+		map.insert(std::make_pair(std::make_pair(hira_to_kata(kana[0]), hira_to_kata(kana[1])), romaji));
+	}
+
+	return map;
+}
+
+std::map<std::tuple<wchar_t, wchar_t, wchar_t>, pattern>
+init_kana_triple_to_pattern_map()
+{
+	std::map<std::tuple<wchar_t, wchar_t, wchar_t>, pattern> map;
+
+	static const std::pair<const wchar_t *, const char *> kana_triple_to_romaji[]
+		{ { L"っきゃ", "KKYA" }, { L"っきゅ", "KKYU" }, { L"っきょ", "KKYO" },
+		  { L"っしゃ", "SS[YH]A" }, { L"っしゅ", "SS[YH]U" }, { L"っしょ", "SS[YH]O" },
+		  { L"っちゃ", "[TC][TC][YH]A" }, { L"っちゅ", "[TC][TC][YH]U" }, { L"っちょ", "[TC][TC][YH]O" },
+		  { L"っひゃ", "HHYA" }, { L"っひゅ", "HHYU" }, { L"っひょ", "HHYO" },
+		  { L"っみゃ", "MMYA" }, { L"っみゅ", "MMYU" }, { L"っみょ", "MMYO" },
+		  { L"っりゃ", "RRYA" }, { L"っりゅ", "RRYU" }, { L"っりょ", "RRYO" },
+		  { L"っぎゃ", "GGYA" }, { L"っぎゅ", "GGYU" }, { L"っぎょ", "GGYO" },
+		  { L"っじゃ", "[JZ][JZ]Y?A"  }, { L"っじゅ", "[JZ][JZ]Y?U"  }, { L"っじょ", "[JZ][JZ]Y?O"  }, // XXX:should display ZYA/ZYU/ZYO for consistency
+		  { L"っびゃ", "BBYA" }, { L"っびゅ", "BBYU" }, { L"っびょ", "BBYO" },
+		  { L"っぴゃ", "PPYA" }, { L"っぴゅ", "PPYU" }, { L"っぴょ", "PPYO" } };
+
+	for (auto& p : kana_triple_to_romaji) {
+		const pattern romaji = parse_pattern(p.second);
+
+		auto kana = p.first;
+		map.insert(std::make_pair(std::make_tuple(kana[0], kana[1], kana[2]), romaji));
+		map.insert(std::make_pair(std::make_tuple(hira_to_kata(kana[0]), hira_to_kata(kana[1]), hira_to_kata(kana[2])), romaji));
+	}
+
+	return map;
+}
+
+const std::map<wchar_t, pattern>&
+single_map()
+{
+	static const std::map<wchar_t, pattern> map(init_kana_to_pattern_map());
+	return map;
+}
+
+const std::map<std::pair<wchar_t, wchar_t>, pattern>&
+pair_map()
+{
+	static const std::map<std::pair<wchar_t, wchar_t>, pattern> map(init_kana_pair_to_pattern_map());
+	return map;
+}
+
+const std::map<std::tuple<wchar_t, wchar_t, wchar_t>, pattern>&
+triple_map()
+{
+	static const std::map<std::tuple<wchar_t, wchar_t, wchar_t>, pattern> map(init_kana_triple_to_pattern_map());
+	return map;
+}
+
+}
+
+const pattern *
+find_pattern(wchar_t kana)
+{
+	auto it = single_map().find(kana);
+	return it != single_map().end() ? &it->second : nullptr;
+}
+
+const pattern *
+find_pattern(wchar_t kana0, wchar_t kana1)
+{
+	auto it = pair_map().find(std::make_pair(kana0, kana1));
+	return it != pair_map().end() ? &it->second : nullptr;
+}
+
+const pattern *
+find_pattern(wchar_t kana0, wchar_t kana1, wchar_t kana2)
+{
+	auto it = triple_map().find(std::make_tuple(kana0, kana1, kana2));
+	return it != triple_map().end() ? &it->second : nullptr;
+}
+
+std::vector<entry>
+get_entries()
+{
+	std::vector<entry> entries;
+
+	for (auto& p : single_map())
+		entries.push_back({ std::wstring(1, p.first), &p.second });
+
+	for (auto& p : pair_map())
+		entries.push_back({ { p.first.first, p.first.second }, &p.second });
+
+	for (auto& p : triple_map())
+		entries.push_back({ { std::get<0>(p.first), std::get<1>(p.first), std::get<2>(p.first) }, &p.second });
+
+	return entries;
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// the kana tables the way they were before kana.cc compiled them: pattern
+// strings parsed at startup into std::maps, and matched a position at a
+// time. only here to check the compiled tables against.
+
+namespace kana_oracle {
+
+struct position
+{
+	std::string keys; // any of them matches; the first one is shown
+	bool is_optional;
+};
+
+using pattern = std::vector<position>;
+
+// nullptr if there's no pattern for the kana
+const pattern *find_pattern(wchar_t kana0, wchar_t kana1, wchar_t kana2);
+const pattern *find_pattern(wchar_t kana0, wchar_t kana1);
+const pattern *find_pattern(wchar_t kana);
+
+// every kana sequence that has a pattern, and the pattern
+struct entry
+{
+	std::wstring kana;
+	const pattern *romaji;
+};
+
+std::vector<entry> get_entries();
+
+}
@@ -0,0 +1,186 @@
+#include <cstdio>
+#include <cstring>
+#include <clocale>
+
+#include "pattern.h"
+#include "kana.h"
+#include "utf8.h"
+#include "kana_oracle.h"
+
+// checks the tables compiled in kana.cc against the old std::map ones in
+// kana_oracle.cc:
+//
+//   dfa     every key typed from every state of every pattern is accepted
+//           or rejected the same way, and leads to the same position
+//   lookup  every single character, and every pair and triple in the kana
+//           blocks, has a pattern in both or in neither, and it's the same
+
+namespace {
+
+const pattern_table& patterns = kana::get_patterns();
+
+// keys the patterns use, and some they never do
+const char KEYS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-a ?[]";
+
+long num_checked = 0;
+long num_failed = 0;
+
+void
+fail(const std::wstring& kana, const char *typed, const char *what)
+{
+	++num_failed;
+	printf("%ls after \"%s\": %s\n", kana.c_str(), typed, what);
+}
+
+// the old kana_buffer::on_key_down: an optional position that doesn't
+// match is skipped if the one after it does. false if the key's rejected.
+bool
+oracle_next(const kana_oracle::pattern& romaji, size_t& pos, int keysym)
+{
+	auto matches = [&romaji](size_t pos, int keysym)
+		{
+			return pos < romaji.size() && romaji[pos].keys.find(keysym) != std::string::npos;
+		};
+
+	if (!matches(pos, keysym)) {
+		if (!romaji[pos].is_optional || !matches(pos + 1, keysym))
+			return false;
+
+		++pos;
+	}
+
+	++pos;
+
+	return true;
+}
+
+void
+compare_states(const std::wstring& kana, const kana_oracle::pattern& romaji, size_t pos, pattern_table::state s, std::string& typed)
+{
+	if (pos == romaji.size()) {
+		if (s != pattern_table::END)
+			fail(kana, typed.c_str(), "pattern goes on");
+		return;
+	}
+
+	if (s == pattern_table::END) {
+		fail(kana, typed.c_str(), "pattern ends early");
+		return;
+	}
+
+	if (patterns.get_char(s) != romaji[pos].keys[0])
+		fail(kana, typed.c_str(), "different key shown");
+
+	if (patterns.is_optional(s) != romaji[pos].is_optional)
+		fail(kana, typed.c_str(), "different optional flag");
+
+	for (const char *key = KEYS; *key; key++) {
+		++num_checked;
+
+		size_t next_pos = pos;
+		const bool accepted = oracle_next(romaji, next_pos, *key);
+
+		const pattern_table::state next = patterns.next(s, *key);
+
+		if (accepted != (next != pattern_table::REJECT)) {
+			typed.push_back(*key);
+			fail(kana, typed.c_str(), accepted ? "key rejected" : "key accepted");
+			typed.pop_back();
+		} else if (accepted) {
+			typed.push_back(*key);
+			compare_states(kana, romaji, next_pos, next, typed);
+			typed.pop_back();
+		}
+	}
+}
+
+pattern_table::state
+find_compiled(const std::wstring& kana)
+{
+	switch (kana.size()) {
+		case 1:
+			return kana::find_pattern(kana[0]);
+
+		case 2:
+			return kana::find_pattern(kana[0], kana[1]);
+
+		default:
+			return kana::find_pattern(kana[0], kana[1], kana[2]);
+	}
+}
+
+void
+check_lookup(const std::wstring& kana, const kana_oracle::pattern *romaji, pattern_table::state s)
+{
+	++num_checked;
+
+	if (!romaji != (s == pattern_table::END)) {
+		fail(kana, "", romaji ? "no pattern" : "unexpected pattern");
+	} else if (romaji) {
+		std::string typed;
+		compare_states(kana, *romaji, 0, s, typed);
+	}
+}
+
+void
+check_lookups()
+{
+	// past the kana blocks only single characters have patterns
+	const wchar_t KANA_FIRST = 0x3040, KANA_LAST = 0x30ff;
+
+	for (wchar_t c0 = 1; c0 <= static_cast<wchar_t>(utf8::MAX_CODEPOINT); c0++) {
+		check_lookup({ c0 }, kana_oracle::find_pattern(c0), kana::find_pattern(c0));
+
+		if (c0 < KANA_FIRST || c0 > KANA_LAST)
+			continue;
+
+		for (wchar_t c1 = KANA_FIRST; c1 <= KANA_LAST; c1++) {
+			check_lookup({ c0, c1 }, kana_oracle::find_pattern(c0, c1), kana::find_pattern(c0, c1));
+
+			for (wchar_t c2 = KANA_FIRST; c2 <= KANA_LAST; c2++)
+				check_lookup({ c0, c1, c2 }, kana_oracle::find_pattern(c0, c1, c2), kana::find_pattern(c0, c1, c2));
+		}
+	}
+}
+
+void
+check_dfa()
+{
+	for (auto& e : kana_oracle::get_entries()) {
+		const pattern_table::state s = find_compiled(e.kana);
+
+		if (s == pattern_table::END) {
+			fail(e.kana, "", "no pattern");
+			continue;
+		}
+
+		std::string typed;
+		compare_states(e.kana, *e.romaji, 0, s, typed);
+	}
+}
+
+}
+
+int
+main(int argc, char *argv[])
+{
+	setlocale(LC_ALL, "C.UTF-8");
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s dfa|lookup\n", *argv);
+		return 2;
+	}
+
+	if (!strcmp(argv[1], "dfa")) {
+		check_dfa();
+	} else if (!strcmp(argv[1], "lookup")) {
+		check_lookups();
+	} else {
+		fprintf(stderr, "unknown check %s\n", argv[1]);
+		return 2;
+	}
+
+	printf("%ld checked, %ld failed, %zu states\n", num_checked, num_failed, patterns.get_num_states());
+
+	return num_failed != 0;
+}
@@ -0,0 +1,213 @@
+#include <cstdio>
+#include <cstdlib>
+#include <clocale>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <iterator>
+
+#include "pattern.h"
+#include "kana.h"
+#include "kashi.h"
+
+// checks the clusters and stroke counts each serifu works out when it's
+// parsed against counting the romaji on the fly, the way it was done
+// before, for every line of the .kashi files given: for the whole line,
+// and for what's left at every step of random walks through it
+
+namespace {
+
+const pattern_table& patterns = kana::get_patterns();
+
+// typing walks per serifu
+const int NUM_WALKS = 20;
+
+long num_checked = 0;
+long num_failed = 0;
+
+// the old serifu::romaji_iterator, looking the patterns up as it goes
+struct romaji_walker
+{
+	romaji_walker(serifu::kana_iterator kana, pattern_table::state cur_pattern)
+	: kana(kana), cur_pattern(cur_pattern)
+	{
+		if (!cur_pattern)
+			consume_kana();
+		skip_optional();
+	}
+
+	void consume_kana()
+	{
+		int num_kana;
+		std::tie(cur_pattern, num_kana) = kana::find_pattern(kana);
+		std::advance(kana, num_kana);
+	}
+
+	void next()
+	{
+		if ((cur_pattern = patterns.next(cur_pattern)) == pattern_table::END)
+			consume_kana();
+	}
+
+	void skip_optional()
+	{
+		while (cur_pattern && patterns.is_optional(cur_pattern))
+			next();
+	}
+
+	// romaji left, typing the keys shown
+	int count()
+	{
+		int n = 0;
+
+		while (cur_pattern) {
+			next();
+			skip_optional();
+			++n;
+		}
+
+		return n;
+	}
+
+	serifu::kana_iterator kana;
+	pattern_table::state cur_pattern;
+};
+
+void
+fail(const char *path, int line, const char *what, int expected, int got)
+{
+	++num_failed;
+	printf("%s:%d: %s: expected %d, got %d\n", path, line, what, expected, got);
+}
+
+void
+check_serifu(const char *path, int line, const serifu& s)
+{
+	const int total = romaji_walker(s.kana_begin(), pattern_table::END).count();
+
+	++num_checked;
+	if (s.get_num_strokes() != total)
+		fail(path, line, "strokes in the line", total, s.get_num_strokes());
+
+	++num_checked;
+	const int num_romaji = std::distance(s.romaji_begin(), s.romaji_end());
+	if (num_romaji != total)
+		fail(path, line, "romaji iterated", total, num_romaji);
+
+	for (int i = 0; i < NUM_WALKS; i++) {
+		// as kana_buffer types it
+		serifu::kana_iterator kana = s.kana_begin();
+		size_t next_cluster = 0;
+		pattern_table::state cur_pattern = pattern_table::END;
+
+		auto consume_cluster = [&]
+			{
+				int num_kana;
+				std::tie(cur_pattern, num_kana) = kana::find_pattern(kana);
+				std::advance(kana, num_kana);
+
+				++num_checked;
+
+				if (next_cluster < s.get_num_clusters()) {
+					const kana_cluster& cluster = s.get_cluster(next_cluster++);
+
+					if (cluster.pattern != cur_pattern)
+						fail(path, line, "cluster pattern", cur_pattern, cluster.pattern);
+
+					if (cluster.num_kana != num_kana)
+						fail(path, line, "kana in cluster", num_kana, cluster.num_kana);
+				} else if (cur_pattern) {
+					fail(path, line, "clusters", next_cluster + 1, s.get_num_clusters());
+				}
+			};
+
+		consume_cluster();
+
+		for (;;) {
+			const int left = romaji_walker(kana, cur_pattern).count();
+
+			++num_checked;
+
+			const int strokes = patterns.get_num_strokes(cur_pattern) + s.get_num_strokes(next_cluster);
+			if (strokes != left)
+				fail(path, line, "strokes left", left, strokes);
+
+			const int num_romaji = std::distance(serifu::romaji_iterator(&s, next_cluster, cur_pattern), s.romaji_end());
+			if (num_romaji != left)
+				fail(path, line, "romaji left", left, num_romaji);
+
+			if (!cur_pattern)
+				break;
+
+			// any key that's accepted
+			pattern_table::state next;
+
+			do {
+				next = patterns.next(cur_pattern, pattern_table::get_key(rand() % pattern_table::NUM_SYMBOLS));
+			} while (next == pattern_table::REJECT);
+
+			if (!(cur_pattern = next))
+				consume_cluster();
+		}
+	}
+}
+
+// the serifu lines of a .kashi file, past the song info
+bool
+check_kashi(const char *path)
+{
+	std::ifstream file(path);
+	if (!file) {
+		printf("%s: failed to open\n", path);
+		return false;
+	}
+
+	std::string line;
+	std::getline(file, line);
+
+	for (int line_number = 2; std::getline(file, line); line_number++) {
+		const size_t tab = line.find('\t');
+		const size_t text = tab == std::string::npos ? line.size() : line.find_first_not_of('\t', tab);
+
+		const char *begin = line.data() + (text == std::string::npos ? line.size() : text);
+		const char *end = line.data() + line.size();
+
+		serifu_arena arena;
+		serifu_arena::syntax_error error;
+
+		if (!arena.add_serifu(atoi(line.c_str()), begin, end, error)) {
+			printf("%s:%d: %s\n", path, line_number, error.what);
+			return false;
+		}
+
+		check_serifu(path, line_number, *arena.begin());
+	}
+
+	return true;
+}
+
+}
+
+int
+main(int argc, char *argv[])
+{
+	setlocale(LC_ALL, "C.UTF-8");
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s file.kashi...\n", *argv);
+		return 2;
+	}
+
+	srand(1);
+
+	for (int i = 1; i < argc; i++) {
+		if (!check_kashi(argv[i]))
+			return 1;
+	}
+
+	printf("%d files, %ld checked, %ld failed\n", argc - 1, num_checked, num_failed);
+
+	return num_failed != 0;
+}
@@ -0,0 +1,42 @@
+#include <vector>
+#include <algorithm>
+
+#include "image.h"
+#include "texture_atlas.h"
+
+texture_atlas::texture_atlas(int width, int height)
+	: row_x_(PADDING)
+	, row_y_(PADDING)
+	, row_height_(0)
+{
+	texture_.set_size(width, height);
+
+	std::vector<unsigned> bits(texture_.get_texture_width()*texture_.get_texture_height());
+	texture_.initialize(&bits[0]);
+}
+
+std::unique_ptr<gl::texture>
+texture_atlas::add(const image& img)
+{
+	const int width = img.get_width();
+	const int height = img.get_height();
+
+	if (row_x_ + width + PADDING > texture_.get_texture_width()) {
+		// start a new row
+		row_x_ = PADDING;
+		row_y_ += row_height_ + PADDING;
+		row_height_ = 0;
+	}
+
+	if (row_x_ + width + PADDING > texture_.get_texture_width() || row_y_ + height + PADDING > texture_.get_texture_height())
+		return nullptr;
+
+	texture_.set_sub_image(row_x_, row_y_, width, height, img.get_bits());
+
+	std::unique_ptr<gl::texture> region(new gl::texture(texture_, row_x_, row_y_, width, height));
+
+	row_x_ += width + PADDING;
+	row_height_ = std::max(row_height_, height);
+
+	return region;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+
+#include <boost/noncopyable.hpp>
+
+#include "gl_texture.h"
+
+class image;
+
+// packs small images into a single texture, in rows, so sprites drawn
+// from any of them end up in the same batch
+
+class texture_atlas : private boost::noncopyable
+{
+public:
+	texture_atlas(int width, int height);
+
+	// copies the image in and returns its region, or nullptr if there's no
+	// room left. regions draw from the atlas, so they mustn't outlive it.
+	std::unique_ptr<gl::texture> add(const image& img);
+
+private:
+	// transparent texels between regions, so filtering at a region's edge
+	// doesn't pick up its neighbours
+	static const int PADDING = 1;
+
+	gl::texture texture_;
+	int row_x_, row_y_;
+	int row_height_;
+};
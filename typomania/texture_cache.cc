@@ -0,0 +1,74 @@
+#include <GL/glew.h>
+
+#include <cstdio>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "gl_texture.h"
+#include "texture_file.h"
+#include "texture_cache.h"
+
+namespace {
+
+const char *CACHE_DIR = "data/cache";
+
+std::string
+cache_path(const std::string& png_path)
+{
+	std::string name = png_path;
+	std::replace(name.begin(), name.end(), '/', '_');
+
+	return std::string(CACHE_DIR) + "/" + name + ".tex";
+}
+
+}
+
+namespace texture_cache {
+
+bool
+open(const std::string& png_path, texture_file& file)
+{
+	const texture_file::format fmt = GLEW_EXT_texture_compression_s3tc ? texture_file::format::DXT5 : texture_file::format::RGBA;
+
+	file_stamp stamp;
+
+	if (!get_file_stamp(png_path, stamp)) {
+		fprintf(stderr, "failed to open %s\n", png_path.c_str());
+		return false;
+	}
+
+	const std::string path = cache_path(png_path);
+
+	if (file.open(path)
+	  && file.source_stamp == stamp
+	  && file.get_format() == fmt
+	  && file.get_levels()[0].width == gl::texture::get_texture_size(file.get_image_width())
+	  && file.get_levels()[0].height == gl::texture::get_texture_size(file.get_image_height()))
+		return true;
+
+	fprintf(stderr, "converting %s...\n", png_path.c_str());
+
+	image img;
+
+	if (!img.load(png_path))
+		return false;
+
+	const int width = gl::texture::get_texture_size(img.get_width());
+	const int height = gl::texture::get_texture_size(img.get_height());
+
+	file.build(img, width, height, fmt);
+	file.source_stamp = stamp;
+
+	// still usable if it can't be saved, it'll just be converted again
+	mkdir(CACHE_DIR, 0755);
+
+	if (!file.save(path))
+		fprintf(stderr, "failed to save %s\n", path.c_str());
+
+	return true;
+}
+
+}
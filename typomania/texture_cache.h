@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+class texture_file;
+
+// PNGs converted once to a form that's ready to upload (mipmapped, and
+// DXT5 compressed when the GL takes it) and kept under data/cache, so
+// later loads skip decoding.
+
+namespace texture_cache {
+
+// opens the cached form of a PNG, converting the PNG first if it's
+// missing or stale. slow when it converts, so best left to a worker.
+// false if the PNG can't be loaded.
+bool open(const std::string& png_path, texture_file& file);
+
+}
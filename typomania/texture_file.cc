@@ -0,0 +1,240 @@
+#include <cstring>
+
+#include <algorithm>
+
+#include "panic.h"
+#include "image.h"
+#include "dxt.h"
+#include "texture_file.h"
+
+namespace {
+
+const char TEXTURE_MAGIC[4] = { 'T', 'T', 'E', 'X' };
+const uint32_t TEXTURE_VERSION = 1;
+
+// host byte order, cached textures never leave the machine
+
+template <typename T>
+bool
+write_value(FILE *fp, T value)
+{
+	return fwrite(&value, sizeof value, 1, fp) == 1;
+}
+
+template <typename T>
+bool
+read_value(FILE *fp, T& value)
+{
+	return fread(&value, sizeof value, 1, fp) == 1;
+}
+
+// 2x2 box filter; odd sizes repeat the last column or row
+std::vector<unsigned>
+downsample(const std::vector<unsigned>& pixels, int width, int height)
+{
+	const int half_width = std::max(width/2, 1);
+	const int half_height = std::max(height/2, 1);
+
+	std::vector<unsigned> half(half_width*half_height);
+
+	for (int y = 0; y < half_height; y++) {
+		const unsigned *row0 = &pixels[std::min(2*y, height - 1)*width];
+		const unsigned *row1 = &pixels[std::min(2*y + 1, height - 1)*width];
+
+		for (int x = 0; x < half_width; x++) {
+			const int x0 = std::min(2*x, width - 1);
+			const int x1 = std::min(2*x + 1, width - 1);
+
+			const unsigned p[4] = { row0[x0], row0[x1], row1[x0], row1[x1] };
+
+			unsigned result = 0;
+
+			for (int shift = 0; shift < 32; shift += 8) {
+				unsigned sum = 2;
+				for (unsigned v : p)
+					sum += (v >> shift) & 0xff;
+				result |= (sum/4) << shift;
+			}
+
+			half[y*half_width + x] = result;
+		}
+	}
+
+	return half;
+}
+
+}
+
+texture_file::texture_file()
+	: format_(format::RGBA)
+	, image_width_(0)
+	, image_height_(0)
+	, fp_(nullptr)
+{ }
+
+texture_file::~texture_file()
+{
+	close();
+}
+
+void
+texture_file::close()
+{
+	if (fp_) {
+		fclose(fp_);
+		fp_ = nullptr;
+	}
+}
+
+bool
+texture_file::open(const std::string& path)
+{
+	close();
+
+	levels_.clear();
+	data_.clear();
+
+	if ((fp_ = fopen(path.c_str(), "rb")) == nullptr)
+		return false;
+
+	char magic[sizeof TEXTURE_MAGIC];
+	uint32_t version, fmt, num_levels;
+	int32_t image_width, image_height;
+
+	if (fread(magic, sizeof magic, 1, fp_) != 1 || memcmp(magic, TEXTURE_MAGIC, sizeof magic)
+	  || !read_value(fp_, version) || version != TEXTURE_VERSION
+	  || !read_value(fp_, fmt) || fmt > static_cast<uint32_t>(format::DXT5)
+	  || !read_value(fp_, source_stamp.mtime) || !read_value(fp_, source_stamp.size)
+	  || !read_value(fp_, image_width) || !read_value(fp_, image_height)
+	  || !read_value(fp_, num_levels) || num_levels == 0 || num_levels > 32) {
+		close();
+		return false;
+	}
+
+	format_ = static_cast<format>(fmt);
+	image_width_ = image_width;
+	image_height_ = image_height;
+
+	for (uint32_t i = 0; i < num_levels; i++) {
+		int32_t width, height;
+
+		if (!read_value(fp_, width) || !read_value(fp_, height) || width <= 0 || height <= 0) {
+			close();
+			return false;
+		}
+
+		add_level(width, height);
+	}
+
+	// make sure every level is there
+	const long data_start = ftell(fp_);
+
+	if (fseek(fp_, 0, SEEK_END) != 0 || static_cast<size_t>(ftell(fp_) - data_start) != get_data_size()
+	  || fseek(fp_, data_start, SEEK_SET) != 0) {
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void
+texture_file::build(const image& img, int width, int height, format fmt)
+{
+	close();
+
+	format_ = fmt;
+	image_width_ = img.get_width();
+	image_height_ = img.get_height();
+
+	levels_.clear();
+
+	std::vector<unsigned> pixels(width*height, 0);
+
+	for (int i = 0; i < std::min(height, image_height_); i++) {
+		const unsigned *src = img.get_bits() + i*image_width_;
+		std::copy(src, src + std::min(width, image_width_), &pixels[i*width]);
+	}
+
+	for (;;) {
+		add_level(width, height);
+
+		const level& l = levels_.back();
+		data_.resize(l.offset + l.size);
+
+		if (format_ == format::DXT5)
+			compress_dxt5(&pixels[0], width, height, &data_[l.offset]);
+		else
+			memcpy(&data_[l.offset], &pixels[0], l.size);
+
+		if (width == 1 && height == 1)
+			break;
+
+		pixels = downsample(pixels, width, height);
+
+		width = std::max(width/2, 1);
+		height = std::max(height/2, 1);
+	}
+}
+
+bool
+texture_file::save(const std::string& path) const
+{
+	// written to a temporary first, so a crash never leaves a truncated file
+	const std::string temp_path = path + ".tmp";
+
+	FILE *fp = fopen(temp_path.c_str(), "wb");
+	if (!fp)
+		return false;
+
+	bool ok = fwrite(TEXTURE_MAGIC, sizeof TEXTURE_MAGIC, 1, fp) == 1
+		&& write_value<uint32_t>(fp, TEXTURE_VERSION)
+		&& write_value<uint32_t>(fp, static_cast<uint32_t>(format_))
+		&& write_value(fp, source_stamp.mtime)
+		&& write_value(fp, source_stamp.size)
+		&& write_value<int32_t>(fp, image_width_)
+		&& write_value<int32_t>(fp, image_height_)
+		&& write_value<uint32_t>(fp, levels_.size());
+
+	for (auto& l : levels_)
+		ok = ok && write_value<int32_t>(fp, l.width) && write_value<int32_t>(fp, l.height);
+
+	ok = ok && fwrite(&data_[0], data_.size(), 1, fp) == 1;
+
+	if (fclose(fp) != 0 || !ok) {
+		remove(temp_path.c_str());
+		return false;
+	}
+
+	return rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+void
+texture_file::read(void *dest)
+{
+	const size_t size = get_data_size();
+
+	if (fp_) {
+		if (fread(dest, 1, size, fp_) != size)
+			panic("failed to read cached texture");
+
+		close();
+	} else {
+		memcpy(dest, &data_[0], size);
+	}
+}
+
+size_t
+texture_file::get_data_size() const
+{
+	return levels_.empty() ? 0 : levels_.back().offset + levels_.back().size;
+}
+
+void
+texture_file::add_level(int width, int height)
+{
+	const size_t offset = get_data_size();
+	const size_t size = format_ == format::DXT5 ? dxt5_size(width, height) : width*height*sizeof(unsigned);
+
+	levels_.push_back({ width, height, offset, size });
+}
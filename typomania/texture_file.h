@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include "file_stamp.h"
+
+class image;
+
+// a texture with its whole mip chain, ready to be uploaded. it's either
+// built from an image or read back from a file, in two steps like
+// png_reader: the header first, so the destination can be set up, then
+// the pixels of every level, largest first and back to back.
+
+class texture_file : private boost::noncopyable
+{
+public:
+	enum class format : uint32_t { RGBA, DXT5 };
+
+	struct level
+	{
+		int width, height;
+		size_t offset, size;
+	};
+
+	texture_file();
+	~texture_file();
+
+	// reads the header of a file saved by save()
+	bool open(const std::string& path);
+
+	// builds the mip chain from an image, padded to width by height
+	void build(const image& img, int width, int height, format fmt);
+
+	bool save(const std::string& path) const;
+
+	// copies the pixels of every level to dest, get_data_size() bytes
+	void read(void *dest);
+
+	format get_format() const
+	{ return format_; }
+
+	int get_image_width() const
+	{ return image_width_; }
+
+	int get_image_height() const
+	{ return image_height_; }
+
+	const std::vector<level>& get_levels() const
+	{ return levels_; }
+
+	size_t get_data_size() const;
+
+	// the file the image was built from
+	file_stamp source_stamp;
+
+private:
+	void close();
+	void add_level(int width, int height);
+
+	format format_;
+	int image_width_, image_height_;
+	std::vector<level> levels_;
+
+	FILE *fp_; // set between open() and read()
+	std::vector<uint8_t> data_; // set by build()
+};
@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+thread_pool::thread_pool(int num_threads)
+	: stopping_(false)
+{
+	for (int i = 0; i < num_threads; i++)
+		threads_.emplace_back(&thread_pool::worker, this);
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+
+	cond_.notify_all();
+
+	for (auto& t : threads_)
+		t.join();
+}
+
+void
+thread_pool::worker()
+{
+	for (;;) {
+		std::function<void()> job;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+
+			cond_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+
+			if (jobs_.empty())
+				return;
+
+			job = std::move(jobs_.front());
+			jobs_.pop_front();
+		}
+
+		job();
+	}
+}
+
+thread_pool&
+get_thread_pool()
+{
+	static thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+	return pool;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <type_traits>
+
+#include <boost/noncopyable.hpp>
+
+// fixed set of worker threads running jobs in submission order
+
+class thread_pool : private boost::noncopyable
+{
+public:
+	thread_pool(int num_threads);
+	~thread_pool();
+
+	template <typename F>
+	std::future<typename std::result_of<F()>::type>
+	submit(F job)
+	{
+		using result_type = typename std::result_of<F()>::type;
+
+		auto task = std::make_shared<std::packaged_task<result_type()>>(std::move(job));
+		auto result = task->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			jobs_.push_back([task] { (*task)(); });
+		}
+
+		cond_.notify_one();
+
+		return result;
+	}
+
+private:
+	void worker();
+
+	std::vector<std::thread> threads_;
+
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<std::function<void()>> jobs_;
+	bool stopping_;
+};
+
+// shared pool with a thread per core
+thread_pool& get_thread_pool();
@@ -0,0 +1,197 @@
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "utf8.h"
+
+namespace {
+
+#if defined(__SSE2__)
+
+// the first 12 bytes as four 3-byte sequences: a lead byte 1110xxxx and two
+// continuation bytes 10xxxxxx each, which is how kana are encoded
+const __m128i THREE_BYTE_MASK = _mm_setr_epi32(0xf0c0c0f0, 0xc0f0c0c0, 0xc0c0f0c0, 0);
+const __m128i THREE_BYTE_BITS = _mm_setr_epi32(0xe08080e0, 0x80e08080, 0x8080e080, 0);
+
+// the 16 bytes in v as 16 characters at out; only the ones that are ASCII
+// are used
+inline void
+widen_ascii(__m128i v, wchar_t *out)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	const __m128i lo = _mm_unpacklo_epi8(v, zero);
+	const __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+	__m128i *dest = reinterpret_cast<__m128i *>(out);
+
+	if (sizeof(wchar_t) == 4) {
+		_mm_storeu_si128(dest, _mm_unpacklo_epi16(lo, zero));
+		_mm_storeu_si128(dest + 1, _mm_unpackhi_epi16(lo, zero));
+		_mm_storeu_si128(dest + 2, _mm_unpacklo_epi16(hi, zero));
+		_mm_storeu_si128(dest + 3, _mm_unpackhi_epi16(hi, zero));
+	} else {
+		_mm_storeu_si128(dest, lo);
+		_mm_storeu_si128(dest + 1, hi);
+	}
+}
+
+// decodes the 3-byte sequences v starts with, up to four, into out; returns
+// how many. the bits are checked for all of them at once, which only leaves
+// overlong sequences and surrogates to check one at a time.
+inline int
+decode_three_byte_run(__m128i v, const char *p, wchar_t *out)
+{
+	const __m128i matches = _mm_cmpeq_epi8(_mm_and_si128(v, THREE_BYTE_MASK), THREE_BYTE_BITS);
+
+	int bits = _mm_movemask_epi8(matches);
+
+	const unsigned char *s = reinterpret_cast<const unsigned char *>(p);
+
+	int n = 0;
+
+	for (; n < 4 && (bits & 7) == 7; n++, s += 3, bits >>= 3) {
+		const uint32_t cp = ((s[0] & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+
+		if (cp < 0x800 || (cp >= 0xd800 && cp <= 0xdfff))
+			break;
+
+		out[n] = cp;
+	}
+
+	return n;
+}
+
+#else
+
+const uint64_t HIGH_BITS = 0x8080808080808080ull;
+
+#endif
+
+}
+
+namespace utf8 {
+
+const char *
+decode(const char *p, const char *end, std::wstring& str)
+{
+	str.clear();
+	return append(p, end, str);
+}
+
+const char *
+append(const char *p, const char *end, std::wstring& str)
+{
+	// every byte decodes to at most one character; str is cut back to
+	// what was decoded at the end
+	const size_t start = str.size();
+	str.resize(start + (end - p));
+
+	wchar_t *out = &str[start];
+	const char *bad = nullptr;
+
+	while (p != end) {
+#if defined(__SSE2__)
+		// ASCII up to sixteen bytes at a time, and kana up to four at a
+		// time
+		if (end - p >= 16) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+
+			if (const int high_bits = _mm_movemask_epi8(v)) {
+				const int num_ascii = __builtin_ctz(high_bits);
+
+				if (num_ascii) {
+					widen_ascii(v, out);
+					p += num_ascii;
+					out += num_ascii;
+					continue;
+				}
+
+				if (const int num_kana = decode_three_byte_run(v, p, out)) {
+					p += 3*num_kana;
+					out += num_kana;
+					continue;
+				}
+			} else {
+				widen_ascii(v, out);
+				p += 16;
+				out += 16;
+				continue;
+			}
+		}
+#else
+		// ASCII eight bytes at a time
+		if (end - p >= 8) {
+			uint64_t word;
+			memcpy(&word, p, 8);
+
+			if (!(word & HIGH_BITS)) {
+				std::copy(p, p + 8, out);
+				p += 8;
+				out += 8;
+				continue;
+			}
+		}
+#endif
+
+		const char *next = decode(p, end, *out);
+		if (!next) {
+			bad = p;
+			break;
+		}
+
+		++out;
+		p = next;
+	}
+
+	str.resize(out - str.data());
+
+	return bad;
+}
+
+void
+encode(const wchar_t *p, const wchar_t *end, std::string& str)
+{
+	str.clear();
+
+	for (; p != end; p++) {
+		uint32_t cp = static_cast<uint32_t>(*p);
+
+		if ((cp >= 0xd800 && cp <= 0xdfff) || cp > MAX_CODEPOINT)
+			cp = 0xfffd;
+
+		if (cp < 0x80) {
+			str.push_back(cp);
+		} else if (cp < 0x800) {
+			str.push_back(0xc0 | (cp >> 6));
+			str.push_back(0x80 | (cp & 0x3f));
+		} else if (cp < 0x10000) {
+			str.push_back(0xe0 | (cp >> 12));
+			str.push_back(0x80 | ((cp >> 6) & 0x3f));
+			str.push_back(0x80 | (cp & 0x3f));
+		} else {
+			str.push_back(0xf0 | (cp >> 18));
+			str.push_back(0x80 | ((cp >> 12) & 0x3f));
+			str.push_back(0x80 | ((cp >> 6) & 0x3f));
+			str.push_back(0x80 | (cp & 0x3f));
+		}
+	}
+}
+
+size_t
+count(const char *p, const char *end)
+{
+	size_t n = 0;
+
+	for (; p != end; p++) {
+		if ((*p & 0xc0) != 0x80)
+			++n;
+	}
+
+	return n;
+}
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// UTF-8 decoding for text read in place. malformed sequences (overlong,
+// surrogates, past what wchar_t holds, or cut short) are errors rather
+// than replaced. encoding is only for text that was decoded.
+
+namespace utf8 {
+
+enum : uint32_t { MAX_CODEPOINT = sizeof(wchar_t) > 2 ? 0x10ffff : 0xffff };
+
+// decodes the code point at p, which is before end; returns the byte
+// after it, or nullptr if it's malformed
+inline const char *
+decode(const char *p, const char *end, wchar_t& ch)
+{
+	const unsigned char *s = reinterpret_cast<const unsigned char *>(p);
+
+	if (s[0] < 0x80) {
+		ch = s[0];
+		return p + 1;
+	}
+
+	int len;
+	uint32_t cp, min_cp;
+
+	if ((s[0] & 0xe0) == 0xc0) {
+		len = 2;
+		cp = s[0] & 0x1f;
+		min_cp = 0x80;
+	} else if ((s[0] & 0xf0) == 0xe0) {
+		len = 3;
+		cp = s[0] & 0x0f;
+		min_cp = 0x800;
+	} else if ((s[0] & 0xf8) == 0xf0) {
+		len = 4;
+		cp = s[0] & 0x07;
+		min_cp = 0x10000;
+	} else {
+		return nullptr;
+	}
+
+	if (end - p < len)
+		return nullptr;
+
+	for (int i = 1; i < len; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return nullptr;
+
+		cp = (cp << 6) | (s[i] & 0x3f);
+	}
+
+	if (cp < min_cp || (cp >= 0xd800 && cp <= 0xdfff) || cp > MAX_CODEPOINT)
+		return nullptr;
+
+	ch = cp;
+
+	return p + len;
+}
+
+// decodes [p, end) into str, replacing what was in it; returns nullptr, or
+// the first malformed sequence
+const char *decode(const char *p, const char *end, std::wstring& str);
+
+// same, but onto the end of str. what comes before a malformed sequence is
+// kept.
+const char *append(const char *p, const char *end, std::wstring& str);
+
+// encodes [p, end) into str, replacing what was in it. what isn't a code
+// point (surrogates, past MAX_CODEPOINT) becomes U+FFFD
+void encode(const wchar_t *p, const wchar_t *end, std::string& str);
+
+// code points in [p, end), going by their lead bytes
+size_t count(const char *p, const char *end);
+
+}